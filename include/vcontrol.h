@@ -23,13 +23,58 @@ extern "C" {
 void VControl_Init (void);
 void VControl_Uninit (void);
 
-/* Control of bindings */
+/* Memory.  Every allocation VControl makes goes through an allocator,
+ * the C library's unless the library is initialized with one of the
+ * variants below; Uninit goes back to it.  InitWithArena carves
+ * everything out of one block of caller memory instead, and never
+ * touches the heap.  Neither variant covers SDL's own allocations,
+ * such as opening a joystick the first time one of its inputs is
+ * bound; SDL_SetMemoryFunctions covers those.
+ *
+ * Nothing allocates while events are processed, input is reset or
+ * layers change, except that the combo matcher is rebuilt on the first
+ * press after the combos or the name table change.  Adding bindings
+ * allocates only when the binding pool is full, in chunks of 64
+ * bindings (about 4KB on 64-bit systems); ReserveBindings grows the
+ * pool ahead of time so that the next count bindings need nothing,
+ * and ApplyBindings can check a batch of up to count specs without
+ * allocating.  RemoveAllBindings keeps the memory it had.  Beyond the pool, the
+ * library needs a few KB of tables, plus a little for each name in
+ * the name table, chord, combo and timed binding, so an arena of 16KB
+ * plus 5KB per 64 bindings is ample for a typical game.  Both variants
+ * return 0 on success and -1 if the initial tables don't fit. */
+typedef struct _vcontrol_allocator {
+	void *(*alloc) (void *data, size_t size);
+	void *(*resize) (void *data, void *block, size_t size);
+	void  (*release) (void *data, void *block);
+	void *data;
+} VControl_Allocator;
+
+int  VControl_InitWithAllocator (const VControl_Allocator *allocator);
+int  VControl_InitWithArena (void *memory, size_t size);
+int  VControl_ReserveBindings (int count);
+
+/* Control of bindings.  The single-input bindings made and removed
+ * by these may be changed from one other thread while input is being
+ * handled, say by a rebinding screen that runs apart from the input
+ * thread.  Each change to a chain is a single pointer store, so
+ * dispatch never sees one half done and takes no lock for it, and a
+ * removed binding's slot isn't reused until every dispatch that could
+ * be looking at it has finished.  The Add routines return 0 on
+ * success, or -1 if the input doesn't exist or there is no memory
+ * left for the binding.  Only one thread may change bindings at a
+ * time.  Chords, combos, timed bindings, layers, joystick settings,
+ * configuration files and the RemoveAll routines still belong to the
+ * thread handling input (CommitConfiguration is there for
+ * configuration files). */
 int  VControl_AddBinding (SDL_Event *e, int *target);
 void VControl_RemoveBinding (SDL_Event *e, int *target);
 
 /* For more specific control */				
 int  VControl_AddKeyBinding (sdl_key_t symbol, int *target);
 void VControl_RemoveKeyBinding (sdl_key_t symbol, int *target);
+int  VControl_AddScancodeBinding (int scancode, int *target);
+void VControl_RemoveScancodeBinding (int scancode, int *target);
 int  VControl_AddJoyAxisBinding (int port, int axis, int polarity, int *target);
 void VControl_RemoveJoyAxisBinding (int port, int axis, int polarity, int *target);
 int  VControl_SetJoyThreshold (int port, int threshold);
@@ -38,22 +83,139 @@ void VControl_RemoveJoyButtonBinding (int port, int button, int *target);
 int  VControl_AddJoyHatBinding (int port, int which, Uint8 dir, int *target);
 void VControl_RemoveJoyHatBinding (int port, int which, Uint8 dir, int *target);
 
+/* Axis conditioning.  SetJoyAxisThreshold gives one axis its own
+ * threshold: it is pressed beyond press and stays pressed until it
+ * falls back to release, which may be no higher.  A negative press
+ * goes back to the joystick threshold.  SetJoyStickDeadzone treats two
+ * axes as one stick, centred on both while its distance from the
+ * middle is less than radius; a radius of 0 separates them again.
+ * SetJoyDebounce passes on the first change of a button at once, then
+ * holds the button for ms milliseconds, after which it passes on where
+ * the button has settled; 0 turns it off.  Debouncing needs
+ * VControl_Tick, as timed bindings do.  Each returns 0 on success. */
+int  VControl_SetJoyAxisThreshold (int port, int axis, int press, int release);
+int  VControl_SetJoyStickDeadzone (int port, int xaxis, int yaxis, int radius);
+int  VControl_SetJoyDebounce (int port, int ms);
+
 void VControl_RemoveAllBindings (void);
 
 /* The listener.  Routines besides HandleEvent may be used to 'fake' inputs without 
- * fabricating an SDL_Event. 
+ * fabricating an SDL_Event.  A key event signals both the bindings of
+ * its key symbol and those of its scancode, which name the key by its
+ * position on the keyboard whatever the layout.
  */
 void VControl_HandleEvent (SDL_Event *e);
 void VControl_ProcessKeyDown (sdl_key_t symbol);
 void VControl_ProcessKeyUp (sdl_key_t symbol);
+void VControl_ProcessScancodeDown (int scancode);
+void VControl_ProcessScancodeUp (int scancode);
 void VControl_ProcessJoyButtonDown (int port, int button);
 void VControl_ProcessJoyButtonUp (int port, int button);
 void VControl_ProcessJoyAxis (int port, int axis, int value);
 void VControl_ProcessJoyHat (int port, int which, Uint8 value);
 
+/* Immediate mode (SDL 2 only).  Instead of waiting for the event loop
+ * to reach HandleEvent, keyboard and joystick events are processed as
+ * soon as SDL queues them, from an event watch.  If consume is
+ * nonzero, they are dropped from the queue as well; any event filter
+ * already set still sees every event first.  HandleEvent ignores the
+ * events immediate mode has taken care of.  SDL may queue events from
+ * any thread, so the listener serializes itself in this mode; targets
+ * may be read from any thread as usual.  Returns 0 on success. */
+int  VControl_SetImmediateMode (int enable, int consume);
+
+/* Polling mode.  Instead of trusting every event, PollInput reads the
+ * keyboard and joystick state once a frame, compares it with what it
+ * read last time and handles only the inputs that changed, through
+ * the same bindings.  HandleEvent ignores input events in this mode.
+ * Since the state is read rather than pieced together from events,
+ * nothing stays stuck after a dropped event or a focus change, and
+ * ResetInput followed by a poll brings back whatever is really held.
+ * Switching it on resets the input.  It can't be combined with
+ * immediate mode; returns 0 on success. */
+int  VControl_SetPollingMode (int enable);
+void VControl_PollInput (void);
+
+/* Joystick sampling (SDL 2 only).  StartJoySampling starts a thread
+ * that reads every open joystick hz times a second and handles what
+ * changed, as PollInput does, so joystick controls change between
+ * frames and their press and release times are those of the sample
+ * that saw them.  Each sample is handled under the listener's lock,
+ * which HandleEvent, Tick and the Process routines take too with
+ * SDL 2; joystick events are ignored while it runs, by HandleEvent and
+ * by immediate mode alike.  Rates above 1000 are limited by
+ * SDL_Delay's millisecond granularity.  Only single-input
+ * bindings may change while it runs, as described under "Control of
+ * bindings".  Returns 0 on success. */
+int  VControl_StartJoySampling (int hz);
+void VControl_StopJoySampling (void);
+
+/* Input injection (SDL 2 on systems with Unix domain sockets).  The
+ * server listens at path for one connection at a time from a test
+ * driver or bot, which writes VControl_Injection records in host byte
+ * order, as many per write as it likes.  A server thread queues them
+ * without taking any lock, and nothing happens to the controls until
+ * the application calls ProcessInjectedInput from its event loop,
+ * which applies every record queued so far, in order, and returns how
+ * many there were.  Records naming inputs that don't exist are
+ * dropped.  An action record sets control number index in the name
+ * table straight to value.  The socket is created readable and
+ * writable by the owner only; the umask is changed briefly to do that,
+ * so avoid starting injection while other threads create files.
+ * Returns 0 on success. */
+
+typedef enum {
+	VCONTROL_INJECT_KEYDOWN,        /* value is the key symbol */
+	VCONTROL_INJECT_KEYUP,
+	VCONTROL_INJECT_JOYBUTTONDOWN,  /* port, index */
+	VCONTROL_INJECT_JOYBUTTONUP,
+	VCONTROL_INJECT_JOYAXIS,        /* port, index, value */
+	VCONTROL_INJECT_JOYHAT,         /* port, index, value */
+	VCONTROL_INJECT_ACTION          /* index, value */
+} VControl_InjectionType;
+
+typedef struct _vcontrol_injection {
+	Uint32 type;
+	Sint32 port, index, value;
+} VControl_Injection;
+
+int  VControl_StartInjectionServer (const char *path);
+void VControl_StopInjectionServer (void);
+int  VControl_ProcessInjectedInput (void);
+
+/* Trace recording.  StartTrace records event handling, control
+ * transitions, joystick opens and configuration parsing, along with a
+ * span for each frame, for the next frames frames; the application
+ * ends each frame with TraceFrame.  The trace is then written to path
+ * as Chrome trace-event JSON, for chrome://tracing or Perfetto, with
+ * CLOCK_MONOTONIC timestamps where there is one, the clock perf uses.
+ * StopTrace writes whatever has been recorded early.  Returns 0 on
+ * success.  Building with VCONTROL_USDT defined adds the same points
+ * as sys/sdt.h probes for perf and bpftrace. */
+int  VControl_StartTrace (const char *path, int frames);
+void VControl_TraceFrame (void);
+void VControl_StopTrace (void);
+
 /* Force the input into the blank state.  For preventing "sticky" keys. */
 void VControl_ResetInput (void);
 
+/* Rollback.  SaveState copies the whole input state into state: every
+ * target's value and the count behind it, what is held, chord, timed
+ * and combo progress, the layer stack and pending timers.
+ * RestoreState puts it all back, so input handled afterwards behaves
+ * exactly as it would have then.  StateSize gives the bytes needed,
+ * which stay the same until the bindings, name table or joysticks
+ * change.  A state saved before such a change must not be restored
+ * after it; RestoreState refuses one that doesn't fit.  The
+ * state is plain data and may be copied with memcpy.  HashState hashes
+ * everything but the times, which differ between machines, for
+ * comparing states across a network.  Save and Restore return 0 on
+ * success and -1 if the size is wrong. */
+size_t VControl_StateSize (void);
+int    VControl_SaveState (void *state, size_t size);
+int    VControl_RestoreState (const void *state, size_t size);
+Uint64 VControl_HashState (const void *state);
+
 /* Name control.  To provide a table of names and bindings, declare
  * a persistent, unchanging array of VControl_NameBinding and end it
  * with a {0, 0} entry.  Pass this array to VControl_RegisterNameTable.
@@ -67,11 +229,285 @@ typedef struct _vcontrol_namebinding {
 
 void VControl_RegisterNameTable (VControl_NameBinding *table);
 
+/* Timing.  For each control in the name table, VControl records when
+ * it last went from released to pressed and back.  Times are on the
+ * SDL_GetTicks clock and come from the event timestamp when there is
+ * one, so they are not rounded to the frame.  HeldFor returns how long
+ * the control has been held as of now, or 0 if it isn't held;
+ * PressedSince returns nonzero if it was pressed at or after time.
+ * Controls not in the name table read as never pressed. */
+Uint32 VControl_HeldFor (int *target, Uint32 now);
+int    VControl_PressedSince (int *target, Uint32 time);
+Uint32 VControl_GetPressTime (int *target);
+Uint32 VControl_GetReleaseTime (int *target);
+
+/* State publication (POSIX only).  PublishState mirrors the value of
+ * every control in the name table into the shared memory object name
+ * (as for shm_open, e.g. "/mygame-input"), so that other processes can
+ * map it read-only and watch the controls.  The object starts with a
+ * VControl_SharedState, followed by the control names in table order
+ * and then their values.  Values are written as VControl changes them,
+ * with sequence odd while a write is in progress; readers copy the
+ * values and start over if sequence was odd or has changed since.
+ * Combo targets, which the application clears, are not mirrored.
+ * Registering a name table replaces the object; the old one has its
+ * magic set to 0, which tells readers to map the name again.  NULL
+ * stops publishing and removes the object.  Returns 0 on success. */
+
+#define VCONTROL_SHARED_MAGIC 0x4c544356 /* "VCTL" */
+#define VCONTROL_SHARED_VERSION 1
+
+typedef struct _vcontrol_sharedstate {
+	Uint32 magic;
+	Uint32 version;
+	Uint32 size;    /* Of the whole object */
+	Uint32 count;   /* Number of controls */
+	Uint32 names;   /* Offset of count NUL-terminated names */
+	Uint32 values;  /* Offset of count Sint32 values */
+	volatile Uint32 sequence;
+} VControl_SharedState;
+
+int VControl_PublishState (const char *name);
+
 /* Dump a configuration file corresponding to the current bindings and names. */
 void VControl_Dump (FILE *out);
+
+/* Memory statistics.  GetMemoryStats reports what the library has
+ * allocated, by subsystem, and how the binding tables are used.  Byte
+ * counts are what was asked of the allocator, without its overhead.
+ * Slots are binding pool entries; chord and timed bindings use one for
+ * each of their inputs.  The key hash figures count the chains of the
+ * buckets key bindings are hashed into.  It is cheap enough to call
+ * every frame: the hash figures are only recounted after the bindings
+ * change, and the rest takes a step per pool chunk, joystick and combo.
+ * GetJoystickMemory gives the bytes held for one joystick, or 0 if it
+ * isn't open. */
+typedef struct _vcontrol_memorystats {
+	int chunks;              /* Binding pool chunks allocated */
+	int live_slots, free_slots;
+	size_t pool_bytes;       /* The binding pool */
+	size_t joystick_bytes;   /* Input tables of the open joysticks */
+	size_t name_bytes;       /* Transition times for the name table */
+	size_t index_bytes;      /* The index of bindings by target, and
+	                          * ApplyBindings' scratch space */
+	size_t chord_bytes;
+	size_t timed_bytes;
+	size_t combo_bytes;      /* Combos and their matcher */
+	size_t total_bytes;
+	int key_buckets;         /* Buckets in the key hash */
+	int buckets_used;
+	int longest_chain;
+	int joysticks_open;
+} VControl_MemoryStats;
+
+void   VControl_GetMemoryStats (VControl_MemoryStats *stats);
+size_t VControl_GetJoystickMemory (int port);
+
 /* Read a configuration file.  Returns number of errors encountered. */
 int VControl_ReadConfiguration (FILE *in);
 
+/* Background loading.  LoadConfigurationAsync reads and parses the
+ * configuration file at path on a thread of its own and returns at
+ * once, or returns -1 if a load is already under way.  Nothing changes
+ * until CommitConfiguration is called from the event loop, usually
+ * once a frame.  While the file is still loading it returns 0 at once.
+ * When loading is finished, it applies the whole file in one call and
+ * returns 1, storing the number of lines in error in *errors if errors
+ * is not NULL.  If replace was nonzero, every binding is removed first,
+ * as RemoveAllBindings does, but only once every line of the file has
+ * been checked and the memory its bindings need reserved.  A file with
+ * any line in error, or too big for the memory left, is not applied:
+ * it returns -1, with the error count in *errors, and the bindings are
+ * left as they were.  So it does if the file could not be read.
+ * Input is never handled against a half-loaded file; in immediate mode
+ * the commit holds the listener's lock.  A custom allocator is called
+ * from the loading thread too, so it must be thread-safe; the arena
+ * is, with SDL 2. */
+int VControl_LoadConfigurationAsync (const char *path, int replace);
+int VControl_CommitConfiguration (int *errors);
+
+/* Bulk binding.  Each VControl_BindingSpec is the equivalent of one
+ * line of a configuration file.  If target is NULL, name is looked up
+ * in the registered name table.  index is the axis, button or hat
+ * number, or the scancode; value is the polarity, hat direction or
+ * threshold.  The joystick settings take no name: an axis threshold
+ * has the press level in value and the release level in extra, a
+ * deadzone has its axes in index and extra and its radius in value,
+ * and a debounce its time in value.  modifier
+ * and period make it a timed binding, as described below; leave them
+ * zero for an ordinary one.  Returns number of errors encountered,
+ * like VControl_ReadConfiguration. */
+
+typedef enum {
+	VCONTROL_SPEC_KEY,
+	VCONTROL_SPEC_JOYAXIS,
+	VCONTROL_SPEC_JOYBUTTON,
+	VCONTROL_SPEC_JOYHAT,
+	VCONTROL_SPEC_JOYTHRESHOLD,
+	VCONTROL_SPEC_SCANCODE,
+	VCONTROL_SPEC_JOYAXISTHRESHOLD,
+	VCONTROL_SPEC_JOYDEADZONE,
+	VCONTROL_SPEC_JOYDEBOUNCE
+} VControl_SpecType;
+
+typedef enum {
+	VCONTROL_MODIFIER_NONE,
+	VCONTROL_MODIFIER_HOLD,
+	VCONTROL_MODIFIER_TAP,
+	VCONTROL_MODIFIER_TURBO
+} VControl_Modifier;
+
+typedef struct _vcontrol_bindingspec {
+	int type;
+	const char *name;
+	int *target;
+	sdl_key_t symbol;
+	int port, index, value;
+	int modifier, period;
+	int extra;
+} VControl_BindingSpec;
+
+int VControl_AddBindings (const VControl_BindingSpec *specs, int count);
+
+/* Transactional bulk binding.  Every spec is checked before anything
+ * changes, and either all of them are applied or none are.  Nothing is
+ * printed; if status is not NULL, it receives one VControl_BindStatus
+ * per spec.  Specs that are already bound, or repeat an earlier spec,
+ * are reported as duplicates and are not errors.  When the batch is
+ * rejected, good specs are reported as skipped.  Timed bindings can't
+ * be applied this way and are reported as bad types.  The specs are
+ * checked in scratch space that is kept between calls, so only a batch
+ * larger than any before it, or than ReserveBindings made room for,
+ * allocates for it.  Returns the number of specs in error, so 0 means
+ * the batch was applied. */
+
+typedef enum {
+	VCONTROL_BIND_OK,
+	VCONTROL_BIND_DUPLICATE,
+	VCONTROL_BIND_SKIPPED,
+	VCONTROL_BIND_BADNAME,
+	VCONTROL_BIND_BADTYPE,
+	VCONTROL_BIND_BADPORT,
+	VCONTROL_BIND_BADINPUT,
+	VCONTROL_BIND_NOMEMORY
+} VControl_BindStatus;
+
+int VControl_ApplyBindings (const VControl_BindingSpec *specs, size_t n, int *status);
+
+/* Parsing without binding.  ParseConfiguration reads a configuration
+ * file and hands each line to the callbacks instead of acting on it.
+ * It uses no global state, so it needs no name table or joysticks and
+ * may run on several threads at once.  binding receives a joystick
+ * setting, a single input, or the inputs of a chord, with the control
+ * name in every spec and target NULL.  combo receives the control name
+ * and the names of its steps, and layer the layer name.  A nonzero return
+ * from any of these marks the line as an error.  error receives each
+ * syntax error.  Callbacks may be NULL.  Returns the number of lines
+ * in error, as ReadConfiguration does. */
+
+typedef struct _vcontrol_parsecallbacks {
+	int  (*binding) (void *data, int line, const VControl_BindingSpec *inputs, int count);
+	int  (*combo) (void *data, int line, const char *name, const char **steps, int length, Uint32 window);
+	int  (*layer) (void *data, int line, const char *name);
+	void (*error) (void *data, int line, const char *message);
+} VControl_ParseCallbacks;
+
+int VControl_ParseConfiguration (FILE *in, const VControl_ParseCallbacks *callbacks, void *data);
+
+/* Write one input, or a joystick setting, in configuration file syntax */
+void VControl_FormatInput (char *buf, size_t size, const VControl_BindingSpec *spec);
+
+/* Chords.  A chord binding signals its target only while every one of
+ * its inputs is held, as in "Special: key LeftShift + key Space".
+ * inputs holds up to 8 specs of the key, scancode or joystick input
+ * types; their name and target fields are ignored.  Chords are matched
+ * as bitmasks, and only when one of the physical inputs in some chord
+ * changes. */
+int  VControl_AddChordBinding (const VControl_BindingSpec *inputs, int count, int *target);
+void VControl_RemoveChordBinding (const VControl_BindingSpec *inputs, int count, int *target);
+
+/* Combos.  A combo is a sequence of up to 16 controls from the name
+ * table, given by name and separated by spaces, as in "Down Right
+ * Fire".  Each time they are pressed in that order with no more than
+ * window milliseconds from the first press to the last, the target is
+ * incremented; the application should zero it once it has acted on
+ * it.  Any other press in between breaks the sequence.  Bind a chord
+ * to a control to use simultaneous presses as a step.  All combos are
+ * matched together, so adding more does not slow down each press. */
+int  VControl_AddComboBinding (const char *sequence, Uint32 window, int *target);
+void VControl_RemoveComboBinding (const char *sequence, int *target);
+
+/* Hooks.  The transition hook is called whenever a control in the
+ * name table goes from released to pressed (value 1) or back (value
+ * 0), with its index in the table.  The input hook is called whenever
+ * a key or joystick input is pressed, bound or not, with the input
+ * as a binding spec; keys are reported by symbol only.  Hooks run in
+ * the middle of dispatch, and in immediate mode on whichever thread
+ * queued the event, so they must not change bindings, layers or the
+ * name table: note what happened and act on it afterwards.  Passing
+ * NULL removes a hook.  vcontrol_coro.hpp builds C++20 coroutine
+ * waits on these. */
+typedef void (*VControl_TransitionHook) (void *data, int action, int value);
+typedef void (*VControl_InputHook) (void *data, const VControl_BindingSpec *input);
+
+void VControl_SetTransitionHook (VControl_TransitionHook hook, void *data);
+void VControl_SetInputHook (VControl_InputHook hook, void *data);
+
+/* Timed bindings.  A spec with a modifier signals its target on a
+ * schedule instead of for as long as the input is held:
+ *
+ *   HOLD  - once the input has been held for period milliseconds,
+ *           until it is let go ("Charge: key Space hold 500")
+ *   TAP   - briefly, when the input is let go no more than period
+ *           milliseconds after it was pressed ("Dodge: key c tap 200")
+ *   TURBO - on and off period times a second while the input is held
+ *           ("Fire: joystick 0 button 0 turbo 15hz")
+ *
+ * Chords can't have modifiers.  Deadlines wait in a timer wheel that
+ * only moves when VControl_Tick is called, normally once a frame with
+ * SDL_GetTicks (), so a tap stays signalled until the next tick.  A
+ * tick costs time for the timers that expire, not for the number of
+ * timed bindings. */
+int  VControl_AddTimedBinding (const VControl_BindingSpec *input, int *target);
+void VControl_RemoveTimedBinding (const VControl_BindingSpec *input, int *target);
+void VControl_Tick (Uint32 now);
+
+/* Reverse lookup.  EnumerateBindings calls callback for each binding
+ * of target in the edit layer, with its input, or a chord's inputs, as
+ * ParseCallbacks.binding would receive them but with target filled in.
+ * A nonzero return stops the enumeration.  The callback must not add
+ * or remove bindings.  Returns the number of bindings visited.
+ * RemoveAllBindingsForTarget removes every binding and chord of target
+ * in the edit layer; combos are left alone.  Both take time in
+ * proportion to the bindings target has, plus a pass over the chords,
+ * so they are cheap enough to call every frame for button prompts. */
+typedef int (*VControl_BindingCallback) (void *data, const VControl_BindingSpec *inputs, int count);
+int  VControl_EnumerateBindings (int *target, VControl_BindingCallback callback, void *data);
+void VControl_RemoveAllBindingsForTarget (int *target);
+
+/* Layers.  Every binding and chord belongs to a layer, and only those
+ * in layers on the layer stack respond to input.  Layer 0, "base", is
+ * always at the bottom of the stack.  The binding routines above add
+ * to and remove from the edit layer, which is the base layer unless
+ * SetEditLayer says otherwise; SetEditLayer returns the previous one.
+ * In a configuration file, "layer NAME" switches the rest of the file
+ * to that layer.  Up to 32 layers may be created; CreateLayer returns
+ * the existing layer if there is one by that name.
+ *
+ * Push, Pop and Swap (which replaces the top layer, or pushes if only
+ * the base is there) take effect at once without rebuilding anything.
+ * An input held across the change is carried over: it now signals the
+ * targets the new stack binds it to, and a target bound in both stays
+ * held throughout.  An input bound in a layer pushed with consume set
+ * is hidden from the layers below it.  Pop returns the layer removed,
+ * and all return -1 on failure. */
+int VControl_CreateLayer (const char *name);
+int VControl_FindLayer (const char *name);
+int VControl_SetEditLayer (int layer);
+int VControl_PushLayer (int layer, int consume);
+int VControl_PopLayer (void);
+int VControl_SwapLayer (int layer, int consume);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,366 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+/* Waiting for input from C++20 coroutines.
+ *
+ * Menus, tutorials and rebinding screens can be written as coroutines
+ * that wait for the input they need instead of checking targets every
+ * frame:
+ *
+ *   vcontrol::flow rebind (vcontrol::input_events &vc)
+ *   {
+ *           co_await vc.pressed ("Fire");
+ *           int which = co_await vc.any_of ({"Left", "Right"}, 5000);
+ *           if (which < 0)
+ *                   ... neither within five seconds ...
+ *           VControl_BindingSpec input = co_await vc.next_raw_input ();
+ *           ...
+ *   }
+ *
+ *   vcontrol::input_events vc (table);
+ *   rebind (vc);
+ *   ... and once a frame, after handling events:
+ *   vc.run (SDL_GetTicks ());
+ *
+ * input_events takes VControl's transition and input hooks, so only
+ * one may exist at a time, and it needs the name table that is
+ * registered to look names up.  A waiting coroutine sits on a list
+ * for each control it waits on and costs nothing until one of them
+ * changes.  The hooks then move it to a ready list, and run resumes it;
+ * it isn't resumed from the hook itself, because the hooks are called
+ * in the middle of dispatch, where a flow that changes bindings would
+ * pull the chains out from under it.  Timeouts are kept in deadline
+ * order, so run looks at only the earliest.  Since the hooks are
+ * called on SDL's thread in immediate mode, input_events is for
+ * queued mode only.  Destroying a waiting coroutine withdraws its
+ * wait, and destroying input_events destroys those still waiting. */
+
+#ifndef VCONTROL_CORO_HPP_
+#define VCONTROL_CORO_HPP_
+
+#include <coroutine>
+#include <cstdio>
+#include <exception>
+#include <initializer_list>
+#include <map>
+#include <vector>
+#include <SDL.h>
+#include "vcontrol.h"
+
+namespace vcontrol {
+
+/* A coroutine that starts at once and runs until it finishes, resumed
+ * by whatever it waits on.  Nothing waits for it in turn. */
+struct flow {
+	struct promise_type {
+		flow get_return_object () { return {}; }
+		std::suspend_never initial_suspend () noexcept { return {}; }
+		std::suspend_never final_suspend () noexcept { return {}; }
+		void return_void () { }
+		void unhandled_exception () { std::terminate (); }
+	};
+};
+
+class input_events;
+
+namespace detail {
+
+class wait;
+
+/* One list a wait is on: the waiters for a control's press or
+ * release, or for raw input.  which is what the wait returns if this
+ * list's event comes first. */
+struct link {
+	link *next = nullptr, **pprev = nullptr;
+	wait *owner = nullptr;
+	int action = -1, value = 0, which = 0;
+
+	void insert (link **head)
+	{
+		next = *head;
+		if (next)
+			next->pprev = &next;
+		pprev = head;
+		*head = this;
+	}
+
+	void unlink ()
+	{
+		if (!pprev)
+			return;
+		*pprev = next;
+		if (next)
+			next->pprev = pprev;
+		next = nullptr;
+		pprev = nullptr;
+	}
+};
+
+/* What every awaitable shares.  The links are all set up when the wait
+ * is made and only put on their lists when the coroutine suspends, so
+ * the vector never moves while they are linked. */
+class wait {
+	friend class vcontrol::input_events;
+protected:
+	input_events *events;
+	std::coroutine_handle<> handle;
+	std::vector<link> links;
+	bool raw = false;
+	link rawlink;
+	Uint32 timeout = 0;
+	std::multimap<Uint32, wait *>::iterator deadline;
+	bool timed = false, queued = false;
+	int result = -1;
+	VControl_BindingSpec input {};
+
+	wait (input_events *e) : events (e) { }
+	void add (int action, int value, int which)
+	{
+		if (action < 0)
+			return;
+		links.emplace_back ();
+		links.back ().owner = this;
+		links.back ().action = action;
+		links.back ().value = value;
+		links.back ().which = which;
+	}
+	void cancel ();
+public:
+	wait (const wait &) = delete;
+	wait &operator= (const wait &) = delete;
+	~wait ();
+
+	/* With nothing to wait for (names not found), go straight on */
+	bool await_ready () const noexcept { return links.empty () && !raw; }
+	void await_suspend (std::coroutine_handle<> h);
+};
+
+/* co_await pressed or released: nothing */
+class control_wait : public wait {
+	friend class vcontrol::input_events;
+	control_wait (input_events *e, int action, int value) : wait (e)
+	{
+		add (action, value, 0);
+	}
+public:
+	void await_resume () const noexcept { }
+};
+
+/* co_await any_of: the position of the name pressed, or -1 */
+class any_wait : public wait {
+	friend class vcontrol::input_events;
+	any_wait (input_events *e, const std::vector<int> &actions, Uint32 t) : wait (e)
+	{
+		links.reserve (actions.size ());
+		for (std::size_t i = 0; i < actions.size (); ++i)
+			add (actions[i], 1, (int)i);
+		timeout = t;
+	}
+public:
+	int await_resume () const noexcept { return result; }
+};
+
+/* co_await next_raw_input: the input */
+class raw_wait : public wait {
+	friend class vcontrol::input_events;
+	raw_wait (input_events *e) : wait (e)
+	{
+		raw = true;
+		rawlink.owner = this;
+	}
+public:
+	VControl_BindingSpec await_resume () const noexcept { return input; }
+};
+
+} /* namespace detail */
+
+class input_events {
+	friend class detail::wait;
+
+	const VControl_NameBinding *table;
+	int count;
+	std::vector<detail::link *> lists[2];	/* [value][action] */
+	detail::link *raw;
+	std::multimap<Uint32, detail::wait *> timeouts;
+	std::vector<detail::wait *> ready;
+
+	static void transition (void *data, int action, int value)
+	{
+		input_events *self = static_cast<input_events *> (data);
+		if (action < 0 || action >= self->count)
+			return;
+		detail::link **head = &self->lists[value ? 1 : 0][action];
+		while (*head)
+			self->complete ((*head)->owner, (*head)->which);
+	}
+
+	static void raw_input (void *data, const VControl_BindingSpec *spec)
+	{
+		input_events *self = static_cast<input_events *> (data);
+		while (self->raw)
+		{
+			self->raw->owner->input = *spec;
+			self->complete (self->raw->owner, 0);
+		}
+	}
+
+	/* Take w off its lists and queue it to be resumed */
+	void complete (detail::wait *w, int result)
+	{
+		w->result = result;
+		w->cancel ();
+		w->queued = true;
+		ready.push_back (w);
+	}
+
+public:
+	explicit input_events (const VControl_NameBinding *t) : table (t), count (0), raw (nullptr)
+	{
+		while (table[count].target)
+			++count;
+		lists[0].assign (count, nullptr);
+		lists[1].assign (count, nullptr);
+		VControl_SetTransitionHook (transition, this);
+		VControl_SetInputHook (raw_input, this);
+	}
+
+	/* Coroutines still waiting are destroyed, since nothing could
+	 * resume them now */
+	~input_events ()
+	{
+		for (std::vector<detail::link *> &list : lists)
+		{
+			for (detail::link *&head : list)
+			{
+				while (head)
+					head->owner->handle.destroy ();
+			}
+		}
+		while (raw)
+			raw->owner->handle.destroy ();
+		for (std::size_t i = 0; i < ready.size (); ++i)
+		{
+			if (ready[i])
+				ready[i]->handle.destroy ();
+		}
+		VControl_SetTransitionHook (NULL, NULL);
+		VControl_SetInputHook (NULL, NULL);
+	}
+
+	input_events (const input_events &) = delete;
+	input_events &operator= (const input_events &) = delete;
+
+	/* The index of the named control in the table, or -1 */
+	int action (const char *name) const
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			if (!SDL_strcasecmp (table[i].name, name))
+				return i;
+		}
+		fprintf (stderr, "VControl: No control named '%s' to wait for\n", name);
+		return -1;
+	}
+
+	/* The next time the named control is pressed, or released */
+	detail::control_wait pressed (const char *name)
+	{
+		return detail::control_wait (this, action (name), 1);
+	}
+
+	detail::control_wait released (const char *name)
+	{
+		return detail::control_wait (this, action (name), 0);
+	}
+
+	/* The next press of any of the named controls, giving its position
+	 * in names.  With a timeout in milliseconds, gives -1 if none is
+	 * pressed by then; the deadline is checked by run.  GCC before 13
+	 * rejects a braced list inside a co_await expression, so there,
+	 * make the wait first: auto w = vc.any_of ({...}); co_await w; */
+	detail::any_wait any_of (std::initializer_list<const char *> names, Uint32 timeout = 0)
+	{
+		std::vector<int> actions;
+		for (const char *name : names)
+			actions.push_back (action (name));
+		return detail::any_wait (this, actions, timeout);
+	}
+
+	/* The next key or joystick input pressed, bound or not, as a
+	 * binding spec ready for rebinding */
+	detail::raw_wait next_raw_input ()
+	{
+		return detail::raw_wait (this);
+	}
+
+	/* Expire the waits whose deadlines have passed and resume every
+	 * coroutine whose wait is over.  Call once a frame. */
+	void run (Uint32 now)
+	{
+		while (!timeouts.empty () && (Sint32)(now - timeouts.begin ()->first) >= 0)
+			complete (timeouts.begin ()->second, -1);
+		/* Resuming may queue or destroy other waits, so go by index
+		 * and let a destroyed wait blank its entry */
+		for (std::size_t i = 0; i < ready.size (); ++i)
+		{
+			detail::wait *w = ready[i];
+			if (!w)
+				continue;
+			ready[i] = nullptr;
+			w->queued = false;
+			w->handle.resume ();
+		}
+		ready.clear ();
+	}
+};
+
+namespace detail {
+
+inline void wait::await_suspend (std::coroutine_handle<> h)
+{
+	handle = h;
+	for (link &l : links)
+		l.insert (&events->lists[l.value][l.action]);
+	if (raw)
+		rawlink.insert (&events->raw);
+	if (timeout)
+	{
+		deadline = events->timeouts.emplace (SDL_GetTicks () + timeout, this);
+		timed = true;
+	}
+}
+
+inline void wait::cancel ()
+{
+	for (link &l : links)
+		l.unlink ();
+	rawlink.unlink ();
+	if (timed)
+	{
+		events->timeouts.erase (deadline);
+		timed = false;
+	}
+}
+
+inline wait::~wait ()
+{
+	cancel ();
+	if (queued)
+	{
+		for (wait *&w : events->ready)
+		{
+			if (w == this)
+				w = nullptr;
+		}
+	}
+}
+
+} /* namespace detail */
+
+} /* namespace vcontrol */
+
+#endif
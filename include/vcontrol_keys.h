@@ -0,0 +1,160 @@
+/* 
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+/* The table of key names understood by the configuration file.  This
+ * file has no include guards: define VCONTROL_KEYNAME (name, code)
+ * before including it and it expands to one entry per key.  Both
+ * keynames.c and the compile-time parser in vcontrol_static.hpp build
+ * their tables from it, so the two can never disagree. */
+
+VCONTROL_KEYNAME ("Backspace", SDLK_BACKSPACE)
+VCONTROL_KEYNAME ("Tab", SDLK_TAB)
+VCONTROL_KEYNAME ("Clear", SDLK_CLEAR)
+VCONTROL_KEYNAME ("Return", SDLK_RETURN)
+VCONTROL_KEYNAME ("Pause", SDLK_PAUSE)
+VCONTROL_KEYNAME ("Escape", SDLK_ESCAPE)
+VCONTROL_KEYNAME ("Space", SDLK_SPACE)
+VCONTROL_KEYNAME ("!", SDLK_EXCLAIM)
+VCONTROL_KEYNAME ("\"", SDLK_QUOTEDBL)
+VCONTROL_KEYNAME ("Hash", SDLK_HASH)
+VCONTROL_KEYNAME ("$", SDLK_DOLLAR)
+VCONTROL_KEYNAME ("&", SDLK_AMPERSAND)
+VCONTROL_KEYNAME ("'", SDLK_QUOTE)
+VCONTROL_KEYNAME ("(", SDLK_LEFTPAREN)
+VCONTROL_KEYNAME (")", SDLK_RIGHTPAREN)
+VCONTROL_KEYNAME ("*", SDLK_ASTERISK)
+VCONTROL_KEYNAME ("+", SDLK_PLUS)
+VCONTROL_KEYNAME (",", SDLK_COMMA)
+VCONTROL_KEYNAME ("-", SDLK_MINUS)
+VCONTROL_KEYNAME (".", SDLK_PERIOD)
+VCONTROL_KEYNAME ("/", SDLK_SLASH)
+VCONTROL_KEYNAME ("0", SDLK_0)
+VCONTROL_KEYNAME ("1", SDLK_1)
+VCONTROL_KEYNAME ("2", SDLK_2)
+VCONTROL_KEYNAME ("3", SDLK_3)
+VCONTROL_KEYNAME ("4", SDLK_4)
+VCONTROL_KEYNAME ("5", SDLK_5)
+VCONTROL_KEYNAME ("6", SDLK_6)
+VCONTROL_KEYNAME ("7", SDLK_7)
+VCONTROL_KEYNAME ("8", SDLK_8)
+VCONTROL_KEYNAME ("9", SDLK_9)
+VCONTROL_KEYNAME (":", SDLK_COLON)
+VCONTROL_KEYNAME (";", SDLK_SEMICOLON)
+VCONTROL_KEYNAME ("<", SDLK_LESS)
+VCONTROL_KEYNAME ("=", SDLK_EQUALS)
+VCONTROL_KEYNAME (">", SDLK_GREATER)
+VCONTROL_KEYNAME ("?", SDLK_QUESTION)
+VCONTROL_KEYNAME ("@", SDLK_AT)
+VCONTROL_KEYNAME ("[", SDLK_LEFTBRACKET)
+VCONTROL_KEYNAME ("\\", SDLK_BACKSLASH)
+VCONTROL_KEYNAME ("]", SDLK_RIGHTBRACKET)
+VCONTROL_KEYNAME ("^", SDLK_CARET)
+VCONTROL_KEYNAME ("_", SDLK_UNDERSCORE)
+VCONTROL_KEYNAME ("`", SDLK_BACKQUOTE)
+VCONTROL_KEYNAME ("a", SDLK_a)
+VCONTROL_KEYNAME ("b", SDLK_b)
+VCONTROL_KEYNAME ("c", SDLK_c)
+VCONTROL_KEYNAME ("d", SDLK_d)
+VCONTROL_KEYNAME ("e", SDLK_e)
+VCONTROL_KEYNAME ("f", SDLK_f)
+VCONTROL_KEYNAME ("g", SDLK_g)
+VCONTROL_KEYNAME ("h", SDLK_h)
+VCONTROL_KEYNAME ("i", SDLK_i)
+VCONTROL_KEYNAME ("j", SDLK_j)
+VCONTROL_KEYNAME ("k", SDLK_k)
+VCONTROL_KEYNAME ("l", SDLK_l)
+VCONTROL_KEYNAME ("m", SDLK_m)
+VCONTROL_KEYNAME ("n", SDLK_n)
+VCONTROL_KEYNAME ("o", SDLK_o)
+VCONTROL_KEYNAME ("p", SDLK_p)
+VCONTROL_KEYNAME ("q", SDLK_q)
+VCONTROL_KEYNAME ("r", SDLK_r)
+VCONTROL_KEYNAME ("s", SDLK_s)
+VCONTROL_KEYNAME ("t", SDLK_t)
+VCONTROL_KEYNAME ("u", SDLK_u)
+VCONTROL_KEYNAME ("v", SDLK_v)
+VCONTROL_KEYNAME ("w", SDLK_w)
+VCONTROL_KEYNAME ("x", SDLK_x)
+VCONTROL_KEYNAME ("y", SDLK_y)
+VCONTROL_KEYNAME ("z", SDLK_z)
+VCONTROL_KEYNAME ("Delete", SDLK_DELETE)
+#if SDL_MAJOR_VERSION == 1
+VCONTROL_KEYNAME ("Keypad-0", SDLK_KP0)
+VCONTROL_KEYNAME ("Keypad-1", SDLK_KP1)
+VCONTROL_KEYNAME ("Keypad-2", SDLK_KP2)
+VCONTROL_KEYNAME ("Keypad-3", SDLK_KP3)
+VCONTROL_KEYNAME ("Keypad-4", SDLK_KP4)
+VCONTROL_KEYNAME ("Keypad-5", SDLK_KP5)
+VCONTROL_KEYNAME ("Keypad-6", SDLK_KP6)
+VCONTROL_KEYNAME ("Keypad-7", SDLK_KP7)
+VCONTROL_KEYNAME ("Keypad-8", SDLK_KP8)
+VCONTROL_KEYNAME ("Keypad-9", SDLK_KP9)
+#else
+VCONTROL_KEYNAME ("Keypad-0", SDLK_KP_0)
+VCONTROL_KEYNAME ("Keypad-1", SDLK_KP_1)
+VCONTROL_KEYNAME ("Keypad-2", SDLK_KP_2)
+VCONTROL_KEYNAME ("Keypad-3", SDLK_KP_3)
+VCONTROL_KEYNAME ("Keypad-4", SDLK_KP_4)
+VCONTROL_KEYNAME ("Keypad-5", SDLK_KP_5)
+VCONTROL_KEYNAME ("Keypad-6", SDLK_KP_6)
+VCONTROL_KEYNAME ("Keypad-7", SDLK_KP_7)
+VCONTROL_KEYNAME ("Keypad-8", SDLK_KP_8)
+VCONTROL_KEYNAME ("Keypad-9", SDLK_KP_9)
+#endif
+VCONTROL_KEYNAME ("Keypad-.", SDLK_KP_PERIOD)
+VCONTROL_KEYNAME ("Keypad-/", SDLK_KP_DIVIDE)
+VCONTROL_KEYNAME ("Keypad-*", SDLK_KP_MULTIPLY)
+VCONTROL_KEYNAME ("Keypad--", SDLK_KP_MINUS)
+VCONTROL_KEYNAME ("Keypad-+", SDLK_KP_PLUS)
+VCONTROL_KEYNAME ("Keypad-Enter", SDLK_KP_ENTER)
+VCONTROL_KEYNAME ("Keypad-=", SDLK_KP_EQUALS)
+VCONTROL_KEYNAME ("Up", SDLK_UP)
+VCONTROL_KEYNAME ("Down", SDLK_DOWN)
+VCONTROL_KEYNAME ("Right", SDLK_RIGHT)
+VCONTROL_KEYNAME ("Left", SDLK_LEFT)
+VCONTROL_KEYNAME ("Insert", SDLK_INSERT)
+VCONTROL_KEYNAME ("Home", SDLK_HOME)
+VCONTROL_KEYNAME ("End", SDLK_END)
+VCONTROL_KEYNAME ("PageUp", SDLK_PAGEUP)
+VCONTROL_KEYNAME ("PageDown", SDLK_PAGEDOWN)
+VCONTROL_KEYNAME ("F1", SDLK_F1)
+VCONTROL_KEYNAME ("F2", SDLK_F2)
+VCONTROL_KEYNAME ("F3", SDLK_F3)
+VCONTROL_KEYNAME ("F4", SDLK_F4)
+VCONTROL_KEYNAME ("F5", SDLK_F5)
+VCONTROL_KEYNAME ("F6", SDLK_F6)
+VCONTROL_KEYNAME ("F7", SDLK_F7)
+VCONTROL_KEYNAME ("F8", SDLK_F8)
+VCONTROL_KEYNAME ("F9", SDLK_F9)
+VCONTROL_KEYNAME ("F10", SDLK_F10)
+VCONTROL_KEYNAME ("F11", SDLK_F11)
+VCONTROL_KEYNAME ("F12", SDLK_F12)
+VCONTROL_KEYNAME ("F13", SDLK_F13)
+VCONTROL_KEYNAME ("F14", SDLK_F14)
+VCONTROL_KEYNAME ("F15", SDLK_F15)
+VCONTROL_KEYNAME ("RightShift", SDLK_RSHIFT)
+VCONTROL_KEYNAME ("LeftShift", SDLK_LSHIFT)
+VCONTROL_KEYNAME ("RightControl", SDLK_RCTRL)
+VCONTROL_KEYNAME ("LeftControl", SDLK_LCTRL)
+VCONTROL_KEYNAME ("RightAlt", SDLK_RALT)
+VCONTROL_KEYNAME ("LeftAlt", SDLK_LALT)
+#if SDL_MAJOR_VERSION == 1
+VCONTROL_KEYNAME ("RightMeta", SDLK_RMETA)
+VCONTROL_KEYNAME ("LeftMeta", SDLK_LMETA)
+VCONTROL_KEYNAME ("RightSuper", SDLK_RSUPER)
+VCONTROL_KEYNAME ("LeftSuper", SDLK_LSUPER)
+VCONTROL_KEYNAME ("AltGr", SDLK_MODE)
+VCONTROL_KEYNAME ("Compose", SDLK_COMPOSE)
+VCONTROL_KEYNAME ("Help", SDLK_HELP)
+VCONTROL_KEYNAME ("Print", SDLK_PRINT)
+VCONTROL_KEYNAME ("SysReq", SDLK_SYSREQ)
+VCONTROL_KEYNAME ("Break", SDLK_BREAK)
+VCONTROL_KEYNAME ("Menu", SDLK_MENU)
+VCONTROL_KEYNAME ("Power", SDLK_POWER)
+VCONTROL_KEYNAME ("Euro", SDLK_EURO)
+VCONTROL_KEYNAME ("Undo", SDLK_UNDO)
+#endif
@@ -0,0 +1,338 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+/* Compile-time configuration parsing for C++17 and later.
+ *
+ * Default bindings can be embedded in the program as a string literal
+ * in the configuration file format and turned into a binding table
+ * while the program is being compiled:
+ *
+ *   VCONTROL_STATIC_CONFIG (defaults,
+ *           "Fire: key Return\n"
+ *           "joystick 0 threshold 15000\n"
+ *           "Fire: joystick 0 button 0\n");
+ *   ...
+ *   vcontrol::install (defaults);
+ *
+ * The grammar is the one documented above parse_config_line in
+ * vcontrol.c.  Any syntax error, unknown key name or malformed number
+ * stops the compile, since evaluation reaches a throw inside a
+ * constant expression.  Control names are only checked for form here;
+ * they are resolved against the registered name table by install,
+ * which adds the whole table with one call to VControl_AddBindings.
+ * Chords ("key a + key b"), scancodes, layers, hold, tap and turbo
+ * modifiers, and joystick settings other than the threshold are not
+ * supported here. */
+
+#ifndef VCONTROL_STATIC_HPP_
+#define VCONTROL_STATIC_HPP_
+
+#include <array>
+#include <cstddef>
+#include <string_view>
+#include "vcontrol.h"
+
+namespace vcontrol {
+
+/* Matches TOKEN_SIZE in vcontrol.c */
+constexpr std::size_t max_token = 63;
+
+struct static_binding {
+	int type;
+	char name[max_token + 1];
+	sdl_key_t symbol;
+	int port, index, value;
+};
+
+template <std::size_t N>
+struct static_config {
+	std::array<static_binding, N> bindings;
+};
+
+/* Thrown (and therefore a compile error) when the text is malformed. */
+struct config_error {
+	const char *message;
+	int line;
+};
+
+namespace detail {
+
+struct keyname {
+	const char *name;
+	sdl_key_t code;
+};
+
+inline constexpr keyname keynames[] = {
+#define VCONTROL_KEYNAME(name, code) { name, code },
+#include "vcontrol_keys.h"
+#undef VCONTROL_KEYNAME
+};
+
+constexpr char lower (char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+constexpr bool space (char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+constexpr bool same (std::string_view a, std::string_view b)
+{
+	if (a.size () != b.size ())
+		return false;
+	for (std::size_t i = 0; i < a.size (); ++i)
+	{
+		if (lower (a[i]) != lower (b[i]))
+			return false;
+	}
+	return true;
+}
+
+/* Splits the text into lines (comments removed) and lines into tokens. */
+class tokenizer {
+	std::string_view text;
+	std::size_t pos, line_end;
+	int linenum;
+public:
+	constexpr tokenizer (std::string_view t) : text (t), pos (0), line_end (0), linenum (0) { }
+
+	/* Advance to the next line; false at end of text. */
+	constexpr bool next_line ()
+	{
+		if (linenum > 0)
+		{
+			pos = line_end;
+			while (pos < text.size () && text[pos] != '\n')
+				++pos;
+			if (pos >= text.size ())
+				return false;
+			++pos;
+		}
+		else if (text.empty ())
+		{
+			return false;
+		}
+		++linenum;
+		line_end = pos;
+		while (line_end < text.size () && text[line_end] != '\n' && text[line_end] != '#')
+			++line_end;
+		return true;
+	}
+
+	constexpr std::string_view token ()
+	{
+		while (pos < line_end && space (text[pos]))
+			++pos;
+		std::size_t start = pos;
+		while (pos < line_end && !space (text[pos]))
+			++pos;
+		if (pos - start > max_token)
+			throw error ("token too long");
+		return text.substr (start, pos - start);
+	}
+
+	constexpr std::string_view peek ()
+	{
+		std::size_t saved = pos;
+		std::string_view result = token ();
+		pos = saved;
+		return result;
+	}
+
+	constexpr bool blank ()
+	{
+		return peek ().empty ();
+	}
+
+	/* The error to throw at the current line */
+	constexpr config_error error (const char *message) const
+	{
+		return config_error { message, linenum };
+	}
+
+	constexpr void consume (std::string_view expected, const char *message)
+	{
+		if (!same (token (), expected))
+			throw error (message);
+	}
+
+	/* A decimal integer with an optional sign, as strtol reads it */
+	constexpr int num ()
+	{
+		std::string_view t = token ();
+		std::size_t i = 0;
+		bool negative = false;
+		int result = 0;
+		if (!t.empty () && (t[0] == '-' || t[0] == '+'))
+		{
+			negative = (t[0] == '-');
+			++i;
+		}
+		if (i == t.size ())
+			throw error ("expected integer");
+		for (; i < t.size (); ++i)
+		{
+			if (t[i] < '0' || t[i] > '9')
+				throw error ("expected integer");
+			result = result * 10 + (t[i] - '0');
+		}
+		return negative ? -result : result;
+	}
+};
+
+constexpr sdl_key_t keycode (tokenizer &tok)
+{
+	std::string_view name = tok.token ();
+	for (const keyname &k : keynames)
+	{
+		if (same (name, k.name))
+			return k.code;
+	}
+	throw tok.error ("illegal key name");
+}
+
+constexpr void joybinding (tokenizer &tok, static_binding &b)
+{
+	b.port = tok.num ();
+	std::string_view kind = tok.token ();
+	if (same (kind, "axis"))
+	{
+		std::string_view polarity;
+		b.type = VCONTROL_SPEC_JOYAXIS;
+		b.index = tok.num ();
+		polarity = tok.token ();
+		if (same (polarity, "positive"))
+			b.value = 1;
+		else if (same (polarity, "negative"))
+			b.value = -1;
+		else
+			throw tok.error ("expected 'positive' or 'negative'");
+	}
+	else if (same (kind, "button"))
+	{
+		b.type = VCONTROL_SPEC_JOYBUTTON;
+		b.index = tok.num ();
+	}
+	else if (same (kind, "hat"))
+	{
+		std::string_view dir;
+		b.type = VCONTROL_SPEC_JOYHAT;
+		b.index = tok.num ();
+		dir = tok.token ();
+		if (same (dir, "left"))
+			b.value = SDL_HAT_LEFT;
+		else if (same (dir, "right"))
+			b.value = SDL_HAT_RIGHT;
+		else if (same (dir, "up"))
+			b.value = SDL_HAT_UP;
+		else if (same (dir, "down"))
+			b.value = SDL_HAT_DOWN;
+		else
+			throw tok.error ("expected 'left', 'right', 'up' or 'down'");
+	}
+	else
+	{
+		throw tok.error ("expected 'axis', 'button', or 'hat'");
+	}
+}
+
+constexpr static_binding config_line (tokenizer &tok)
+{
+	static_binding b {};
+	std::string_view first = tok.token ();
+	if (same (first, "joystick"))
+	{
+		b.type = VCONTROL_SPEC_JOYTHRESHOLD;
+		b.port = tok.num ();
+		tok.consume ("threshold", "expected 'threshold'");
+		b.value = tok.num ();
+	}
+	else
+	{
+		std::string_view kind;
+		if (first.size () < 2 || first[first.size () - 1] != ':')
+			throw tok.error ("expected ':'");
+		for (std::size_t i = 0; i + 1 < first.size (); ++i)
+			b.name[i] = first[i];
+		kind = tok.token ();
+		if (same (kind, "key"))
+		{
+			b.type = VCONTROL_SPEC_KEY;
+			b.symbol = keycode (tok);
+		}
+		else if (same (kind, "joystick"))
+		{
+			joybinding (tok, b);
+		}
+		else
+		{
+			throw tok.error ("expected 'key' or 'joystick'");
+		}
+	}
+	if (!tok.blank ())
+		throw tok.error ("unexpected text at end of line");
+	return b;
+}
+
+} /* namespace detail */
+
+/* Number of bindings the text will produce: one per non-blank line. */
+constexpr std::size_t count_bindings (std::string_view text)
+{
+	detail::tokenizer tok (text);
+	std::size_t count = 0;
+	while (tok.next_line ())
+	{
+		if (!tok.blank ())
+			++count;
+	}
+	return count;
+}
+
+template <std::size_t N>
+constexpr static_config<N> parse_config (std::string_view text)
+{
+	static_config<N> result {};
+	detail::tokenizer tok (text);
+	std::size_t i = 0;
+	while (tok.next_line ())
+	{
+		if (!tok.blank ())
+			result.bindings[i++] = detail::config_line (tok);
+	}
+	return result;
+}
+
+/* Add every binding in the table.  Returns the number of errors, as
+ * VControl_AddBindings does; these can only come from control names
+ * missing from the name table or joysticks that are not present. */
+template <std::size_t N>
+int install (const static_config<N> &config)
+{
+	std::array<VControl_BindingSpec, N> specs {};
+	for (std::size_t i = 0; i < N; ++i)
+	{
+		const static_binding &b = config.bindings[i];
+		specs[i].type = b.type;
+		specs[i].name = b.name;
+		specs[i].target = NULL;
+		specs[i].symbol = b.symbol;
+		specs[i].port = b.port;
+		specs[i].index = b.index;
+		specs[i].value = b.value;
+	}
+	return VControl_AddBindings (specs.data (), (int)N);
+}
+
+} /* namespace vcontrol */
+
+#define VCONTROL_STATIC_CONFIG(var, text) \
+	static constexpr auto var = ::vcontrol::parse_config< ::vcontrol::count_bindings (text)> (text)
+
+#endif
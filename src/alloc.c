@@ -0,0 +1,276 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcontrol.h"
+#include "alloc.h"
+
+static void *
+system_alloc (void *data, size_t size)
+{
+	return malloc (size);
+}
+
+static void *
+system_resize (void *data, void *block, size_t size)
+{
+	return realloc (block, size);
+}
+
+static void
+system_release (void *data, void *block)
+{
+	free (block);
+}
+
+static const VControl_Allocator system_allocator = {
+	system_alloc, system_resize, system_release, NULL
+};
+
+static VControl_Allocator current = {
+	system_alloc, system_resize, system_release, NULL
+};
+
+void
+alloc_set (const VControl_Allocator *allocator)
+{
+	current = allocator ? *allocator : system_allocator;
+}
+
+void *
+vc_malloc (size_t size)
+{
+	return current.alloc (current.data, size ? size : 1);
+}
+
+void *
+vc_calloc (size_t count, size_t size)
+{
+	void *block;
+	if (size && count > (size_t)-1 / size)
+		return NULL;
+	block = vc_malloc (count * size);
+	if (block)
+		memset (block, 0, count * size);
+	return block;
+}
+
+void *
+vc_realloc (void *block, size_t size)
+{
+	if (!block)
+		return vc_malloc (size);
+	return current.resize (current.data, block, size ? size : 1);
+}
+
+void
+vc_free (void *block)
+{
+	if (block)
+		current.release (current.data, block);
+}
+
+/* The arena allocator.  The arena is a single run of blocks, each with
+ * a header giving its size and whether it is free; free blocks are
+ * also on a list in address order, so that a freed block can be merged
+ * with free neighbours.  Allocation is first fit.  This is meant for
+ * the library's modest, mostly long-lived tables, not general use.
+ * Background loading allocates from its own thread, so with SDL 2 the
+ * arena is guarded by a spinlock. */
+
+#define ARENA_ALIGN 16
+
+typedef struct vcontrol_arena_block_s {
+	size_t size;  /* Including this header */
+	int free;
+	struct vcontrol_arena_block_s *next, *prev;  /* Free list */
+} arena_block;
+
+/* Room for the header, rounded so that blocks stay aligned */
+#define ARENA_HEADER ((sizeof (arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+typedef struct vcontrol_arena_s {
+	char *start, *end;
+	arena_block *free_list;
+#if SDL_MAJOR_VERSION > 1
+	SDL_SpinLock lock;
+#endif
+} arena;
+
+#if SDL_MAJOR_VERSION > 1
+#define LOCK_ARENA(a) SDL_AtomicLock (&(a)->lock)
+#define UNLOCK_ARENA(a) SDL_AtomicUnlock (&(a)->lock)
+#else
+#define LOCK_ARENA(a) ((void)0)
+#define UNLOCK_ARENA(a) ((void)0)
+#endif
+
+static arena_block *
+block_after (arena *a, arena_block *b)
+{
+	char *next = (char *)b + b->size;
+	return (next < a->end) ? (arena_block *)next : NULL;
+}
+
+static void
+unlink_free (arena *a, arena_block *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		a->free_list = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+	b->free = 0;
+}
+
+static void *
+take_block (arena *a, size_t size)
+{
+	arena_block *b;
+	size_t need = ARENA_HEADER + ((size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+	if (need < size)
+		return NULL;
+	for (b = a->free_list; b != NULL; b = b->next)
+	{
+		if (b->size >= need)
+			break;
+	}
+	if (!b)
+		return NULL;
+	if (b->size - need >= ARENA_HEADER + ARENA_ALIGN)
+	{
+		/* Split, leaving the tail on the free list in b's place */
+		arena_block *rest = (arena_block *)((char *)b + need);
+		rest->size = b->size - need;
+		rest->free = 1;
+		rest->prev = b->prev;
+		rest->next = b->next;
+		if (rest->prev)
+			rest->prev->next = rest;
+		else
+			a->free_list = rest;
+		if (rest->next)
+			rest->next->prev = rest;
+		b->size = need;
+		b->free = 0;
+	}
+	else
+	{
+		unlink_free (a, b);
+	}
+	return (char *)b + ARENA_HEADER;
+}
+
+static void
+give_block (arena *a, void *block)
+{
+	arena_block *b = (arena_block *)((char *)block - ARENA_HEADER);
+	arena_block *prev = NULL, *next = a->free_list, *after;
+
+	while (next && next < b)
+	{
+		prev = next;
+		next = next->next;
+	}
+	b->free = 1;
+	b->prev = prev;
+	b->next = next;
+	if (prev)
+		prev->next = b;
+	else
+		a->free_list = b;
+	if (next)
+		next->prev = b;
+
+	/* Merge with the following block, then the preceding one */
+	after = block_after (a, b);
+	if (after && after->free)
+	{
+		unlink_free (a, after);
+		b->size += after->size;
+	}
+	if (prev && block_after (a, prev) == b)
+	{
+		unlink_free (a, b);
+		prev->size += b->size;
+	}
+}
+
+static void *
+arena_alloc (void *data, size_t size)
+{
+	arena *a = data;
+	void *block;
+	LOCK_ARENA (a);
+	block = take_block (a, size);
+	UNLOCK_ARENA (a);
+	return block;
+}
+
+static void
+arena_release (void *data, void *block)
+{
+	arena *a = data;
+	LOCK_ARENA (a);
+	give_block (a, block);
+	UNLOCK_ARENA (a);
+}
+
+static void *
+arena_resize (void *data, void *block, size_t size)
+{
+	arena *a = data;
+	arena_block *b = (arena_block *)((char *)block - ARENA_HEADER);
+	size_t have = b->size - ARENA_HEADER;
+	void *fresh;
+	if (size <= have)
+		return block;
+	LOCK_ARENA (a);
+	fresh = take_block (a, size);
+	if (fresh)
+	{
+		memcpy (fresh, block, have);
+		give_block (a, block);
+	}
+	UNLOCK_ARENA (a);
+	return fresh;
+}
+
+int
+alloc_arena (void *memory, size_t size)
+{
+	VControl_Allocator allocator;
+	char *base = memory;
+	size_t skip = (ARENA_ALIGN - ((size_t)base % ARENA_ALIGN)) % ARENA_ALIGN;
+	size_t used = skip + ((sizeof (arena) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1));
+	arena *a;
+	arena_block *first;
+
+	if (!memory || size < used + ARENA_HEADER + ARENA_ALIGN)
+		return -1;
+	a = (arena *)(base + skip);
+	a->start = base + used;
+	a->end = a->start + ((size - used) & ~(size_t)(ARENA_ALIGN - 1));
+	first = (arena_block *)a->start;
+	first->size = a->end - a->start;
+	first->free = 1;
+	first->next = first->prev = NULL;
+	a->free_list = first;
+#if SDL_MAJOR_VERSION > 1
+	a->lock = 0;
+#endif
+
+	allocator.alloc = arena_alloc;
+	allocator.resize = arena_resize;
+	allocator.release = arena_release;
+	allocator.data = a;
+	alloc_set (&allocator);
+	return 0;
+}
@@ -0,0 +1,20 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef ALLOC_H_
+#define ALLOC_H_
+
+/* Every allocation the library makes goes through these, and so
+ * through the allocator given to VControl_InitWithAllocator. */
+void *vc_malloc (size_t size);
+void *vc_calloc (size_t count, size_t size);
+void *vc_realloc (void *block, size_t size);
+void  vc_free (void *block);
+
+void alloc_set (const VControl_Allocator *allocator);
+int  alloc_arena (void *memory, size_t size);
+#endif
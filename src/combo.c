@@ -0,0 +1,431 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vcontrol.h"
+#include "combo.h"
+#include "alloc.h"
+
+/* Combos are sequences of presses of named controls, which must all
+ * happen within a time window.  Rather than checking every combo
+ * against a history of presses, all of them are compiled into a
+ * single Aho-Corasick automaton whose alphabet is the set of controls
+ * that appear in some combo.  Each press is then one table lookup,
+ * plus a window check for each combo that ends at the new state.
+ *
+ * Sequences are stored as targets and only turned into name table
+ * indices when the automaton is built, so registering a new name
+ * table just forces a rebuild. */
+
+typedef struct vcontrol_combo_s {
+	int *sequence[MAX_COMBO_LENGTH];
+	int length;
+	Uint32 window;
+	int *target;
+} combo;
+
+static combo *combos;
+static int combocount, combospace;
+
+/* The compiled automaton.  delta is a full statecount x columns
+ * transition table; column maps a name table index to its column,
+ * or -1 for controls in no combo.  The combos that match on entering
+ * state s are outlist[outstart[s]] to outlist[outstart[s+1]-1]. */
+static int built;
+static int statecount, columns, actioncount;
+static int *column;
+static int *delta;
+static int *outstart, *outlist;
+
+/* Current state and the times of the most recent presses */
+static int state;
+static Uint32 history[MAX_COMBO_LENGTH];
+static unsigned int presses;
+
+static void
+free_automaton (void)
+{
+	vc_free (column);
+	vc_free (delta);
+	vc_free (outstart);
+	vc_free (outlist);
+	column = delta = outstart = outlist = NULL;
+	statecount = columns = actioncount = 0;
+	state = 0;
+	built = 0;
+}
+
+/* Compile the combos into the automaton, given scratch arrays sized
+ * for the worst case of maxstates states.  Returns 0 on success. */
+static int
+compile (int maxstates, int *actions, int *fail, int *queue, int *first, int *nextc, int *total)
+{
+	int i, j, c, head, tail;
+
+	/* Resolve every sequence and assign columns to the controls used */
+	for (i = 0; i < combocount; i++)
+	{
+		for (j = 0; j < combos[i].length; j++)
+		{
+			int a = VControl_target2action (combos[i].sequence[j]);
+			actions[i * MAX_COMBO_LENGTH + j] = a;
+			if (a >= actioncount)
+				actioncount = a + 1;
+		}
+	}
+	column = vc_malloc (sizeof (int) * (actioncount + 1));
+	if (!column)
+		return -1;
+	for (i = 0; i < actioncount; i++)
+		column[i] = -1;
+	for (i = 0; i < combocount * MAX_COMBO_LENGTH; i++)
+	{
+		int a = actions[i];
+		if ((i % MAX_COMBO_LENGTH) < combos[i / MAX_COMBO_LENGTH].length && a >= 0 && column[a] < 0)
+			column[a] = columns++;
+	}
+	if (!columns)
+		return 0;
+
+	/* Build the trie.  first[s] heads a list, linked through nextc,
+	 * of the combos that end exactly at state s. */
+	delta = vc_malloc (sizeof (int) * maxstates * columns);
+	if (!delta)
+		return -1;
+	for (i = 0; i < maxstates * columns; i++)
+		delta[i] = -1;
+	for (i = 0; i < maxstates; i++)
+		first[i] = -1;
+	statecount = 1;
+	for (i = 0; i < combocount; i++)
+	{
+		int s = 0;
+		for (j = 0; j < combos[i].length; j++)
+		{
+			int a = actions[i * MAX_COMBO_LENGTH + j];
+			if (a < 0)
+				break;
+			c = column[a];
+			if (delta[s * columns + c] < 0)
+				delta[s * columns + c] = statecount++;
+			s = delta[s * columns + c];
+		}
+		if (j == combos[i].length)
+		{
+			nextc[i] = first[s];
+			first[s] = i;
+		}
+		/* Otherwise it names a control that isn't in the name
+		 * table, and can never match. */
+	}
+
+	/* Breadth-first pass filling in failure links and turning the
+	 * trie into a complete transition table. */
+	head = tail = 0;
+	fail[0] = 0;
+	queue[tail++] = 0;
+	while (head < tail)
+	{
+		int s = queue[head++];
+		for (c = 0; c < columns; c++)
+		{
+			int t = delta[s * columns + c];
+			if (t < 0)
+			{
+				delta[s * columns + c] = s ? delta[fail[s] * columns + c] : 0;
+			}
+			else
+			{
+				fail[t] = s ? delta[fail[s] * columns + c] : 0;
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	/* The combos matched on entering s are its own plus those of its
+	 * failure state.  BFS order visits fail[s] before s. */
+	for (i = 0; i < statecount; i++)
+	{
+		int s = queue[i], k;
+		total[s] = s ? total[fail[s]] : 0;
+		for (k = first[s]; k >= 0; k = nextc[k])
+			total[s]++;
+	}
+	outstart = vc_malloc (sizeof (int) * (statecount + 1));
+	if (!outstart)
+		return -1;
+	outstart[0] = 0;
+	for (i = 0; i < statecount; i++)
+		outstart[i + 1] = outstart[i] + total[i];
+	outlist = vc_malloc (sizeof (int) * (outstart[statecount] + 1));
+	if (!outlist)
+		return -1;
+	for (i = 0; i < statecount; i++)
+	{
+		int s = queue[i], n = outstart[s], k;
+		for (k = first[s]; k >= 0; k = nextc[k])
+			outlist[n++] = k;
+		if (s)
+		{
+			for (k = outstart[fail[s]]; k < outstart[fail[s] + 1]; k++)
+				outlist[n++] = outlist[k];
+		}
+	}
+	return 0;
+}
+
+/* Build the automaton.  Returns 0 on success; on failure there is no
+ * automaton and presses are ignored until the combos change. */
+static int
+build_automaton (void)
+{
+	int *actions, *fail, *queue, *first, *nextc, *total;
+	int i, maxstates, result = -1;
+
+	free_automaton ();
+	built = 1;
+
+	maxstates = 1;
+	for (i = 0; i < combocount; i++)
+		maxstates += combos[i].length;
+	actions = vc_malloc (sizeof (int) * combocount * MAX_COMBO_LENGTH);
+	fail = vc_malloc (sizeof (int) * maxstates);
+	queue = vc_malloc (sizeof (int) * maxstates);
+	first = vc_malloc (sizeof (int) * maxstates);
+	total = vc_malloc (sizeof (int) * maxstates);
+	nextc = vc_malloc (sizeof (int) * combocount);
+	if (actions && fail && queue && first && total && nextc)
+	{
+		result = compile (maxstates, actions, fail, queue, first, nextc, total);
+	}
+	vc_free (actions);
+	vc_free (fail);
+	vc_free (queue);
+	vc_free (first);
+	vc_free (total);
+	vc_free (nextc);
+	if (result)
+	{
+		fprintf (stderr, "VControl: Out of memory building combo table\n");
+		free_automaton ();
+		built = 1;
+	}
+	return result;
+}
+
+static int
+same_combo (const combo *c, int **sequence, int length, int *target)
+{
+	int i;
+	if (c->target != target || c->length != length)
+		return 0;
+	for (i = 0; i < length; i++)
+	{
+		if (c->sequence[i] != sequence[i])
+			return 0;
+	}
+	return 1;
+}
+
+/* Make room for count combos in all, so adding that many needs no
+ * more memory */
+int
+combo_reserve (int count)
+{
+	int newspace = combospace ? combospace : 16;
+	combo *newcombos;
+	if (count <= combospace)
+		return 0;
+	while (newspace < count)
+		newspace *= 2;
+	newcombos = vc_realloc (combos, sizeof (combo) * newspace);
+	if (!newcombos)
+		return -1;
+	combos = newcombos;
+	combospace = newspace;
+	return 0;
+}
+
+int
+combo_add (int **sequence, int length, Uint32 window, int *target)
+{
+	int i;
+	if (length < 1 || length > MAX_COMBO_LENGTH)
+	{
+		fprintf (stderr, "VControl: Combos must have between 1 and %d steps\n", MAX_COMBO_LENGTH);
+		return -1;
+	}
+	for (i = 0; i < combocount; i++)
+	{
+		if (same_combo (&combos[i], sequence, length, target))
+		{
+			combos[i].window = window;
+			return 0;
+		}
+	}
+	if (combocount == combospace)
+	{
+		int newspace = combospace ? combospace * 2 : 16;
+		combo *newcombos = vc_realloc (combos, sizeof (combo) * newspace);
+		if (!newcombos)
+		{
+			fprintf (stderr, "VControl: Out of memory adding combo\n");
+			return -1;
+		}
+		combos = newcombos;
+		combospace = newspace;
+	}
+	for (i = 0; i < length; i++)
+		combos[combocount].sequence[i] = sequence[i];
+	combos[combocount].length = length;
+	combos[combocount].window = window;
+	combos[combocount].target = target;
+	combocount++;
+	free_automaton ();
+	return 0;
+}
+
+void
+combo_remove (int **sequence, int length, int *target)
+{
+	int i;
+	for (i = 0; i < combocount; i++)
+	{
+		if (same_combo (&combos[i], sequence, length, target))
+		{
+			combos[i] = combos[--combocount];
+			free_automaton ();
+			return;
+		}
+	}
+}
+
+void
+combo_clear (void)
+{
+	free_automaton ();
+	vc_free (combos);
+	combos = NULL;
+	combocount = combospace = 0;
+}
+
+void
+combo_remove_all (void)
+{
+	free_automaton ();
+	combocount = 0;
+}
+
+void
+combo_invalidate (void)
+{
+	free_automaton ();
+}
+
+void
+combo_reset (void)
+{
+	int i;
+	state = 0;
+	for (i = 0; i < combocount; i++)
+		*(combos[i].target) = 0;
+}
+
+void
+combo_press (int action, Uint32 time)
+{
+	int c, i;
+	if (!combocount)
+		return;
+	if (!built && build_automaton ())
+		return;
+	if (!statecount)
+		return;
+	history[presses++ % MAX_COMBO_LENGTH] = time;
+	c = (action >= 0 && action < actioncount) ? column[action] : -1;
+	state = (c < 0) ? 0 : delta[state * columns + c];
+	for (i = outstart[state]; i < outstart[state + 1]; i++)
+	{
+		combo *m = &combos[outlist[i]];
+		Uint32 start = history[(presses - m->length) % MAX_COMBO_LENGTH];
+		if (time - start <= m->window)
+		{
+			*(m->target) = *(m->target)+1;
+		}
+	}
+}
+
+int
+combo_get (int index, int ***sequence, int *length, Uint32 *window, int **target)
+{
+	if (index < 0 || index >= combocount)
+		return 0;
+	*sequence = combos[index].sequence;
+	*length = combos[index].length;
+	*window = combos[index].window;
+	*target = combos[index].target;
+	return 1;
+}
+
+/* Rollback state: the automaton state, the press count and the value
+ * of each combo's target, then the times of the recent presses.  The
+ * automaton is only valid while the combos stay the same, and
+ * restoring needs it built if it was when saved. */
+void
+combo_state_words (size_t *logic, size_t *times)
+{
+	*logic += 2 + combocount;
+	*times += MAX_COMBO_LENGTH;
+}
+
+void
+combo_state (Uint32 **logic, Uint32 **times, int restore)
+{
+	Uint32 *w = *logic, *t = *times;
+	int i;
+	if (restore)
+	{
+		if (combocount && !built)
+			build_automaton ();
+		state = (w[0] < (Uint32)statecount) ? (int)w[0] : 0;
+		presses = w[1];
+		for (i = 0; i < combocount; i++)
+			*(combos[i].target) = (int)w[2 + i];
+		memcpy (history, t, sizeof (history));
+	}
+	else
+	{
+		w[0] = (Uint32)state;
+		w[1] = presses;
+		for (i = 0; i < combocount; i++)
+			w[2 + i] = (Uint32)*(combos[i].target);
+		memcpy (t, history, sizeof (history));
+	}
+	*logic = w + 2 + combocount;
+	*times = t + MAX_COMBO_LENGTH;
+}
+
+/* Bytes allocated for the combos and the automaton */
+size_t
+combo_memory (void)
+{
+	size_t bytes = sizeof (combo) * combospace;
+	if (column)
+		bytes += sizeof (int) * (actioncount + 1);
+	if (delta)
+	{
+		int maxstates = 1, i;
+		for (i = 0; i < combocount; i++)
+			maxstates += combos[i].length;
+		bytes += sizeof (int) * maxstates * columns;
+	}
+	if (outstart)
+		bytes += sizeof (int) * (statecount + 1) + sizeof (int) * (outstart[statecount] + 1);
+	return bytes;
+}
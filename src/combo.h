@@ -0,0 +1,29 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef COMBO_H_
+#define COMBO_H_
+
+/* Longest sequence a combo may have */
+#define MAX_COMBO_LENGTH 16
+
+int  combo_reserve (int count);
+int  combo_add (int **sequence, int length, Uint32 window, int *target);
+void combo_remove (int **sequence, int length, int *target);
+void combo_clear (void);
+void combo_remove_all (void);
+void combo_invalidate (void);
+void combo_reset (void);
+void combo_press (int action, Uint32 time);
+int  combo_get (int index, int ***sequence, int *length, Uint32 *window, int **target);
+size_t combo_memory (void);
+void combo_state_words (size_t *logic, size_t *times);
+void combo_state (Uint32 **logic, Uint32 **times, int restore);
+
+/* Provided by vcontrol.c: index of target in the name table, or -1 */
+int VControl_target2action (int *target);
+#endif
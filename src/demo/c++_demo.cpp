@@ -10,9 +10,20 @@
 #include <string.h>
 #include <SDL.h>
 #include "vcontrol.h"
+#include "vcontrol_static.hpp"
 
 using namespace std;
 
+/* Used when test.cfg can't be found.  Parsed by the compiler. */
+VCONTROL_STATIC_CONFIG (default_config,
+	"# Normal-key controls\n"
+	"Up:      key Up\n"
+	"Down:    key Down\n"
+	"Left:    key Left\n"
+	"Right:   key Right\n"
+	"Fire:    key Return\n"
+	"Special: key Space\n");
+
 class DemoState {
 public:
 	int up, down, left, right, fire, special;
@@ -114,9 +125,17 @@ main (int argc, char **argv)
 	DemoInput input;
 
 	FILE *x = fopen ("test.cfg", "rt");
-	int errs = VControl_ReadConfiguration (x);
-	fclose (x);
-	printf ("%d errors in config file.\n", errs);
+	if (x)
+	{
+		int errs = VControl_ReadConfiguration (x);
+		fclose (x);
+		printf ("%d errors in config file.\n", errs);
+	}
+	else
+	{
+		int errs = vcontrol::install (default_config);
+		printf ("No test.cfg; %d errors in built-in defaults.\n", errs);
+	}
 	VControl_Dump (stdout);
 
 	VControl_ResetInput ();
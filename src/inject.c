@@ -0,0 +1,216 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdio.h>
+#include <string.h>
+#include "vcontrol.h"
+#include "inject.h"
+
+#if SDL_MAJOR_VERSION > 1 && (defined(__unix__) || defined(__APPLE__))
+#define HAVE_INJECTION 1
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+
+#ifdef HAVE_INJECTION
+
+/* Injected records travel from the server thread to the event thread
+ * through a single-producer, single-consumer ring.  head is only
+ * written by the server and tail only by the event thread, so neither
+ * side ever waits for the other except when the ring is full. */
+#define QUEUE_SIZE 4096
+
+/* Records read from the socket at once */
+#define READ_BATCH 256
+
+static VControl_Injection queue[QUEUE_SIZE];
+static SDL_atomic_t head, tail;
+static SDL_atomic_t running;
+static SDL_Thread *server;
+static int listener = -1;
+static char sockpath[sizeof (((struct sockaddr_un *)0)->sun_path)];
+
+/* Queue one record, waiting for room if the event thread is behind.
+ * Returns -1 if the server is shutting down. */
+static int
+enqueue (const VControl_Injection *msg)
+{
+	unsigned int h = (unsigned int)SDL_AtomicGet (&head);
+	while (h - (unsigned int)SDL_AtomicGet (&tail) >= QUEUE_SIZE)
+	{
+		if (!SDL_AtomicGet (&running))
+			return -1;
+		SDL_Delay (1);
+	}
+	queue[h % QUEUE_SIZE] = *msg;
+	SDL_MemoryBarrierRelease ();
+	SDL_AtomicSet (&head, (int)(h + 1));
+	return 0;
+}
+
+int
+inject_next (VControl_Injection *msg)
+{
+	unsigned int t = (unsigned int)SDL_AtomicGet (&tail);
+	if (t == (unsigned int)SDL_AtomicGet (&head))
+		return 0;
+	SDL_MemoryBarrierAcquire ();
+	*msg = queue[t % QUEUE_SIZE];
+	SDL_AtomicSet (&tail, (int)(t + 1));
+	return 1;
+}
+
+/* Serve one connection at a time.  poll times out now and then so
+ * that the thread notices when it is asked to stop. */
+static int SDLCALL
+serve (void *data)
+{
+	char buf[sizeof (VControl_Injection) * READ_BATCH];
+	size_t have = 0;
+	int client = -1;
+	while (SDL_AtomicGet (&running))
+	{
+		struct pollfd p;
+		ssize_t n;
+		size_t i;
+		p.fd = (client >= 0) ? client : listener;
+		p.events = POLLIN;
+		p.revents = 0;
+		if (poll (&p, 1, 100) <= 0)
+			continue;
+		if (client < 0)
+		{
+			client = accept (listener, NULL, NULL);
+			have = 0;
+			continue;
+		}
+		n = read (client, buf + have, sizeof (buf) - have);
+		if (n <= 0)
+		{
+			close (client);
+			client = -1;
+			continue;
+		}
+		have += n;
+		for (i = 0; i + sizeof (VControl_Injection) <= have; i += sizeof (VControl_Injection))
+		{
+			VControl_Injection msg;
+			memcpy (&msg, buf + i, sizeof (msg));
+			if (enqueue (&msg))
+				break;
+		}
+		/* Keep any partial record for the next read */
+		memmove (buf, buf + i, have - i);
+		have -= i;
+	}
+	if (client >= 0)
+		close (client);
+	return 0;
+}
+
+int
+inject_start (const char *path)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	mode_t mask;
+	int failed;
+
+	inject_stop ();
+	if (strlen (path) >= sizeof (addr.sun_path))
+	{
+		fprintf (stderr, "VControl: Injection socket path '%s' is too long\n", path);
+		return -1;
+	}
+	/* Clear away a socket left behind by an earlier run */
+	if (!stat (path, &st) && S_ISSOCK (st.st_mode))
+		unlink (path);
+
+	listener = socket (AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		fprintf (stderr, "VControl: Couldn't create injection socket: %s\n", strerror (errno));
+		return -1;
+	}
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, path);
+	/* Anyone who can connect can drive the controls, so the socket is
+	 * created for this user only.  Connecting needs write permission
+	 * on it, and the mask keeps it from ever existing without that
+	 * restriction, as a chmod after bind would. */
+	mask = umask (0177);
+	failed = bind (listener, (struct sockaddr *)&addr, sizeof (addr)) < 0;
+	umask (mask);
+	if (failed || listen (listener, 4) < 0)
+	{
+		fprintf (stderr, "VControl: Couldn't listen on '%s': %s\n", path, strerror (errno));
+		close (listener);
+		listener = -1;
+		return -1;
+	}
+	strcpy (sockpath, path);
+
+	SDL_AtomicSet (&head, 0);
+	SDL_AtomicSet (&tail, 0);
+	SDL_AtomicSet (&running, 1);
+	server = SDL_CreateThread (serve, "VControl injection", NULL);
+	if (!server)
+	{
+		fprintf (stderr, "VControl: Couldn't start injection server: %s\n", SDL_GetError ());
+		inject_stop ();
+		return -1;
+	}
+	return 0;
+}
+
+void
+inject_stop (void)
+{
+	SDL_AtomicSet (&running, 0);
+	if (server)
+	{
+		SDL_WaitThread (server, NULL);
+		server = NULL;
+	}
+	if (listener >= 0)
+	{
+		close (listener);
+		unlink (sockpath);
+		listener = -1;
+	}
+	SDL_AtomicSet (&head, 0);
+	SDL_AtomicSet (&tail, 0);
+}
+
+#else
+
+int
+inject_start (const char *path)
+{
+	fprintf (stderr, "VControl: Input injection requires SDL 2 and Unix domain sockets\n");
+	return -1;
+}
+
+void
+inject_stop (void)
+{
+}
+
+int
+inject_next (VControl_Injection *msg)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef INJECT_H_
+#define INJECT_H_
+
+int  inject_start (const char *path);
+void inject_stop (void);
+int  inject_next (VControl_Injection *msg);
+#endif
@@ -6,7 +6,9 @@
  */
 
 #include <SDL.h>
+#include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include "keynames.h"
 
 /* If we're in Windows, we don't have strcasecmp */
@@ -33,153 +35,9 @@ typedef struct keyname_s {
 } keyname;
 
 static keyname keynames[] = {
-	{"Backspace", SDLK_BACKSPACE},
-	{"Tab", SDLK_TAB},
-	{"Clear", SDLK_CLEAR},
-	{"Return", SDLK_RETURN},
-	{"Pause", SDLK_PAUSE},
-	{"Escape", SDLK_ESCAPE},
-	{"Space", SDLK_SPACE},
-	{"!", SDLK_EXCLAIM},
-	{"\"", SDLK_QUOTEDBL},
-	{"Hash", SDLK_HASH},
-	{"$", SDLK_DOLLAR},
-	{"&", SDLK_AMPERSAND},
-	{"'", SDLK_QUOTE},
-	{"(", SDLK_LEFTPAREN},
-	{")", SDLK_RIGHTPAREN},
-	{"*", SDLK_ASTERISK},
-	{"+", SDLK_PLUS},
-	{",", SDLK_COMMA},
-	{"-", SDLK_MINUS},
-	{".", SDLK_PERIOD},
-	{"/", SDLK_SLASH},
-	{"0", SDLK_0},
-	{"1", SDLK_1},
-	{"2", SDLK_2},
-	{"3", SDLK_3},
-	{"4", SDLK_4},
-	{"5", SDLK_5},
-	{"6", SDLK_6},
-	{"7", SDLK_7},
-	{"8", SDLK_8},
-	{"9", SDLK_9},
-	{":", SDLK_COLON},
-	{";", SDLK_SEMICOLON},
-	{"<", SDLK_LESS},
-	{"=", SDLK_EQUALS},
-	{">", SDLK_GREATER},
-	{"?", SDLK_QUESTION},
-	{"@", SDLK_AT},
-	{"[", SDLK_LEFTBRACKET},
-	{"\\", SDLK_BACKSLASH},
-	{"]", SDLK_RIGHTBRACKET},
-	{"^", SDLK_CARET},
-	{"_", SDLK_UNDERSCORE},
-	{"`", SDLK_BACKQUOTE},
-	{"a", SDLK_a},
-	{"b", SDLK_b},
-	{"c", SDLK_c},
-	{"d", SDLK_d},
-	{"e", SDLK_e},
-	{"f", SDLK_f},
-	{"g", SDLK_g},
-	{"h", SDLK_h},
-	{"i", SDLK_i},
-	{"j", SDLK_j},
-	{"k", SDLK_k},
-	{"l", SDLK_l},
-	{"m", SDLK_m},
-	{"n", SDLK_n},
-	{"o", SDLK_o},
-	{"p", SDLK_p},
-	{"q", SDLK_q},
-	{"r", SDLK_r},
-	{"s", SDLK_s},
-	{"t", SDLK_t},
-	{"u", SDLK_u},
-	{"v", SDLK_v},
-	{"w", SDLK_w},
-	{"x", SDLK_x},
-	{"y", SDLK_y},
-	{"z", SDLK_z},
-	{"Delete", SDLK_DELETE},
-#if SDL_MAJOR_VERSION == 1
-	{"Keypad-0", SDLK_KP0},
-	{"Keypad-1", SDLK_KP1},
-	{"Keypad-2", SDLK_KP2},
-	{"Keypad-3", SDLK_KP3},
-	{"Keypad-4", SDLK_KP4},
-	{"Keypad-5", SDLK_KP5},
-	{"Keypad-6", SDLK_KP6},
-	{"Keypad-7", SDLK_KP7},
-	{"Keypad-8", SDLK_KP8},
-	{"Keypad-9", SDLK_KP9},
-#else
-	{"Keypad-0", SDLK_KP_0},
-	{"Keypad-1", SDLK_KP_1},
-	{"Keypad-2", SDLK_KP_2},
-	{"Keypad-3", SDLK_KP_3},
-	{"Keypad-4", SDLK_KP_4},
-	{"Keypad-5", SDLK_KP_5},
-	{"Keypad-6", SDLK_KP_6},
-	{"Keypad-7", SDLK_KP_7},
-	{"Keypad-8", SDLK_KP_8},
-	{"Keypad-9", SDLK_KP_9},
-#endif
-	{"Keypad-.", SDLK_KP_PERIOD},
-	{"Keypad-/", SDLK_KP_DIVIDE},
-	{"Keypad-*", SDLK_KP_MULTIPLY},
-	{"Keypad--", SDLK_KP_MINUS},
-	{"Keypad-+", SDLK_KP_PLUS},
-	{"Keypad-Enter", SDLK_KP_ENTER},
-	{"Keypad-=", SDLK_KP_EQUALS},
-	{"Up", SDLK_UP},
-	{"Down", SDLK_DOWN},
-	{"Right", SDLK_RIGHT},
-	{"Left", SDLK_LEFT},
-	{"Insert", SDLK_INSERT},
-	{"Home", SDLK_HOME},
-	{"End", SDLK_END},
-	{"PageUp", SDLK_PAGEUP},
-	{"PageDown", SDLK_PAGEDOWN},
-	{"F1", SDLK_F1},
-	{"F2", SDLK_F2},
-	{"F3", SDLK_F3},
-	{"F4", SDLK_F4},
-	{"F5", SDLK_F5},
-	{"F6", SDLK_F6},
-	{"F7", SDLK_F7},
-	{"F8", SDLK_F8},
-	{"F9", SDLK_F9},
-	{"F10", SDLK_F10},
-	{"F11", SDLK_F11},
-	{"F12", SDLK_F12},
-	{"F13", SDLK_F13},
-	{"F14", SDLK_F14},
-	{"F15", SDLK_F15},
-	{"RightShift", SDLK_RSHIFT},
-	{"LeftShift", SDLK_LSHIFT},
-	{"RightControl", SDLK_RCTRL},
-	{"LeftControl", SDLK_LCTRL},
-	{"RightAlt", SDLK_RALT},
-	{"LeftAlt", SDLK_LALT},
-#if SDL_MAJOR_VERSION == 1
-	{"RightMeta", SDLK_RMETA},
-	{"LeftMeta", SDLK_LMETA},
-	{"RightSuper", SDLK_RSUPER},
-	{"LeftSuper", SDLK_LSUPER},
-	{"AltGr", SDLK_MODE},
-	{"Compose", SDLK_COMPOSE},
-	{"Help", SDLK_HELP},
-	{"Print", SDLK_PRINT},
-	{"SysReq", SDLK_SYSREQ},
-	{"Break", SDLK_BREAK},
-	{"Menu", SDLK_MENU},
-	{"Power", SDLK_POWER},
-	{"Euro", SDLK_EURO},
-	{"Undo", SDLK_UNDO},
-#endif
+#define VCONTROL_KEYNAME(name, code) {name, code},
+#include "vcontrol_keys.h"
+#undef VCONTROL_KEYNAME
 	{"Unknown", 0}};  
 /* Last element must have code zero */
 
@@ -213,3 +71,80 @@ VControl_name2code (char *name)
 		++i;
 	}
 }
+
+/* Scancodes are written with SDL's names for them, less the spaces,
+ * so that each is one token ("Left Shift" becomes "LeftShift").  SDL
+ * 1.2 has no names for its scancodes, which are hardware dependent;
+ * there, and for scancodes SDL doesn't name, the number is written in
+ * hexadecimal ("0x64"), since SDL names the number row "1" to "0" and
+ * '#' starts a comment.  A plain decimal number is still read, as in
+ * files written before, but only when it isn't a name. */
+
+void
+VControl_scancode2name (int code, char *buf, size_t size)
+{
+	size_t n = 0;
+#if SDL_MAJOR_VERSION > 1
+	const char *name = SDL_GetScancodeName ((SDL_Scancode)code);
+	for (; *name && n + 1 < size; name++)
+	{
+		if (*name != ' ')
+			buf[n++] = *name;
+	}
+#endif
+	if (n == 0)
+		snprintf (buf, size, "0x%02X", code);
+	else
+		buf[n] = 0;
+}
+
+/* The number in name, in the given base, or 0 if it isn't all digits */
+static int
+scancode_number (const char *name, int base)
+{
+	const char *p = name;
+	int code = 0;
+	for (; *p && code < 0x10000; p++)
+	{
+		int digit;
+		if (*p >= '0' && *p <= '9')
+			digit = *p - '0';
+		else if (base == 16 && isxdigit ((unsigned char)*p))
+			digit = tolower ((unsigned char)*p) - 'a' + 10;
+		else
+			return 0;
+		code = code * base + digit;
+	}
+	return (p != name && !*p) ? code : 0;
+}
+
+/* Returns 0 if name isn't a scancode */
+int
+VControl_name2scancode (const char *name)
+{
+#if SDL_MAJOR_VERSION > 1
+	const char *p;
+	int code;
+#endif
+	if (name[0] == '0' && (name[1] == 'x' || name[1] == 'X'))
+		return scancode_number (name + 2, 16);
+#if SDL_MAJOR_VERSION > 1
+	for (code = 1; code < SDL_NUM_SCANCODES; code++)
+	{
+		const char *test = SDL_GetScancodeName ((SDL_Scancode)code);
+		if (!*test)
+			continue;
+		for (p = name; *test; test++)
+		{
+			if (*test == ' ')
+				continue;
+			if (tolower ((unsigned char)*test) != tolower ((unsigned char)*p))
+				break;
+			p++;
+		}
+		if (!*test && !*p)
+			return code;
+	}
+#endif
+	return scancode_number (name, 10);
+}
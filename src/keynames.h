@@ -10,4 +10,6 @@
 
 char *VControl_code2name (int code);
 int VControl_name2code (char *code);
+void VControl_scancode2name (int code, char *buf, size_t size);
+int VControl_name2scancode (const char *name);
 #endif
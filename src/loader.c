@@ -0,0 +1,366 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdio.h>
+#include <string.h>
+#include "vcontrol.h"
+#include "loader.h"
+#include "alloc.h"
+#include "combo.h"
+
+/* A configuration file is parsed on a thread of its own, with
+ * callbacks that only record what they are given.  Once it is done,
+ * the event thread replays the record through the callbacks that
+ * bind, all at once.  Strings are kept in one buffer and referred to
+ * by offset, since it moves as it grows. */
+
+enum {
+	STAGED_BINDING,
+	STAGED_COMBO,
+	STAGED_LAYER,
+	STAGED_ERROR
+};
+
+typedef struct vcontrol_staged_s {
+	int kind;
+	int line;
+	int first, count;  /* Binding inputs in specs, or combo steps */
+	Uint32 window;
+	size_t text;       /* The name, message, or combo name and steps */
+} staged;
+
+typedef struct vcontrol_stage_s {
+	staged *ops;
+	int opcount, opspace;
+	VControl_BindingSpec *specs;
+	int speccount, specspace;
+	char *text;
+	size_t textsize, textspace;
+	int failed;
+} stage;
+
+static stage loading;
+static char *loadpath;
+static SDL_Thread *worker;
+static SDL_mutex *done_lock;
+static int running, done, status;
+
+static int
+grow (void **array, int *space, int needed, size_t size)
+{
+	if (needed > *space)
+	{
+		int newspace = *space ? *space * 2 : 64;
+		void *fresh;
+		while (newspace < needed)
+			newspace *= 2;
+		fresh = vc_realloc (*array, size * newspace);
+		if (!fresh)
+			return -1;
+		*array = fresh;
+		*space = newspace;
+	}
+	return 0;
+}
+
+/* Copy s into the text buffer; returns its offset */
+static size_t
+stage_text (stage *s, const char *text)
+{
+	size_t len = strlen (text) + 1, at = s->textsize;
+	if (s->textsize + len > s->textspace)
+	{
+		size_t newspace = s->textspace ? s->textspace * 2 : 1024;
+		char *fresh;
+		while (newspace < s->textsize + len)
+			newspace *= 2;
+		fresh = vc_realloc (s->text, newspace);
+		if (!fresh)
+		{
+			s->failed = 1;
+			return 0;
+		}
+		s->text = fresh;
+		s->textspace = newspace;
+	}
+	memcpy (s->text + at, text, len);
+	s->textsize += len;
+	return at;
+}
+
+static staged *
+stage_op (stage *s, int kind, int line)
+{
+	staged *op;
+	if (grow ((void **)&s->ops, &s->opspace, s->opcount + 1, sizeof (staged)))
+	{
+		s->failed = 1;
+		return NULL;
+	}
+	op = &s->ops[s->opcount++];
+	op->kind = kind;
+	op->line = line;
+	op->first = op->count = 0;
+	op->window = 0;
+	op->text = 0;
+	return op;
+}
+
+static void
+stage_free (stage *s)
+{
+	vc_free (s->ops);
+	vc_free (s->specs);
+	vc_free (s->text);
+	memset (s, 0, sizeof (*s));
+}
+
+static int
+record_binding (void *data, int line, const VControl_BindingSpec *inputs, int count)
+{
+	stage *s = data;
+	staged *op = stage_op (s, STAGED_BINDING, line);
+	int i;
+	if (!op || grow ((void **)&s->specs, &s->specspace, s->speccount + count, sizeof (VControl_BindingSpec)))
+	{
+		s->failed = 1;
+		return 0;
+	}
+	op->first = s->speccount;
+	op->count = count;
+	op->text = stage_text (s, inputs[0].name ? inputs[0].name : "");
+	for (i = 0; i < count; i++)
+	{
+		s->specs[s->speccount] = inputs[i];
+		s->specs[s->speccount].name = NULL;
+		s->speccount++;
+	}
+	return 0;
+}
+
+static int
+record_combo (void *data, int line, const char *name, const char **steps, int length, Uint32 window)
+{
+	stage *s = data;
+	staged *op;
+	int i;
+	if (length > MAX_COMBO_LENGTH)
+	{
+		/* Too long to replay; the line is in error */
+		return 1;
+	}
+	op = stage_op (s, STAGED_COMBO, line);
+	if (!op)
+		return 0;
+	op->count = length;
+	op->window = window;
+	op->text = stage_text (s, name);
+	for (i = 0; i < length; i++)
+		stage_text (s, steps[i]);
+	return 0;
+}
+
+static int
+record_layer (void *data, int line, const char *name)
+{
+	stage *s = data;
+	staged *op = stage_op (s, STAGED_LAYER, line);
+	if (op)
+		op->text = stage_text (s, name);
+	return 0;
+}
+
+static void
+record_error (void *data, int line, const char *message)
+{
+	stage *s = data;
+	staged *op = stage_op (s, STAGED_ERROR, line);
+	if (op)
+		op->text = stage_text (s, message);
+}
+
+static const VControl_ParseCallbacks record_callbacks = {
+	record_binding, record_combo, record_layer, record_error
+};
+
+static int
+load (void *data)
+{
+	FILE *in = fopen (loadpath, "r");
+	int result = -1;
+	if (in)
+	{
+		VControl_ParseConfiguration (in, &record_callbacks, &loading);
+		fclose (in);
+		result = loading.failed ? -1 : 0;
+	}
+	SDL_LockMutex (done_lock);
+	status = result;
+	done = 1;
+	SDL_UnlockMutex (done_lock);
+	return 0;
+}
+
+static void
+finish (void)
+{
+	SDL_WaitThread (worker, NULL);
+	worker = NULL;
+	running = 0;
+	vc_free (loadpath);
+	loadpath = NULL;
+}
+
+int
+loader_start (const char *path)
+{
+	if (running)
+	{
+		fprintf (stderr, "VControl: A configuration is already loading\n");
+		return -1;
+	}
+	if (!done_lock)
+		done_lock = SDL_CreateMutex ();
+	loadpath = vc_malloc (strlen (path) + 1);
+	if (!done_lock || !loadpath)
+	{
+		fprintf (stderr, "VControl: Couldn't start loading '%s'\n", path);
+		vc_free (loadpath);
+		loadpath = NULL;
+		return -1;
+	}
+	strcpy (loadpath, path);
+	stage_free (&loading);
+	done = 0;
+#if SDL_MAJOR_VERSION > 1
+	worker = SDL_CreateThread (load, "VControl loader", NULL);
+#else
+	worker = SDL_CreateThread (load, NULL);
+#endif
+	if (!worker)
+	{
+		fprintf (stderr, "VControl: Couldn't start loading '%s'\n", path);
+		vc_free (loadpath);
+		loadpath = NULL;
+		return -1;
+	}
+	running = 1;
+	return 0;
+}
+
+/* 0 while nothing has finished loading, 1 once the record is ready
+ * to replay, or -1 if the file couldn't be loaded */
+int
+loader_poll (void)
+{
+	int finished;
+	if (!running)
+		return 0;
+	SDL_LockMutex (done_lock);
+	finished = done;
+	SDL_UnlockMutex (done_lock);
+	if (!finished)
+		return 0;
+	finish ();
+	if (status)
+	{
+		stage_free (&loading);
+		return -1;
+	}
+	return 1;
+}
+
+/* Pass the record of a finished load through the callbacks.  Returns
+ * the number of lines in error, counting those the callbacks reject. */
+static int
+walk (stage *s, const VControl_ParseCallbacks *cb, void *data)
+{
+	int i, j, errors = 0, errorline = 0;
+	for (i = 0; i < s->opcount; i++)
+	{
+		staged *op = &s->ops[i];
+		const char *text = s->text + op->text;
+		int failed = 0;
+		switch (op->kind)
+		{
+		case STAGED_BINDING:
+			for (j = 0; j < op->count; j++)
+				s->specs[op->first + j].name = text;
+			if (cb->binding)
+				failed = cb->binding (data, op->line, &s->specs[op->first], op->count);
+			break;
+		case STAGED_COMBO:
+		{
+			const char *steps[MAX_COMBO_LENGTH];
+			const char *step = text + strlen (text) + 1;
+			for (j = 0; j < op->count; j++)
+			{
+				steps[j] = step;
+				step += strlen (step) + 1;
+			}
+			if (cb->combo)
+				failed = cb->combo (data, op->line, text, steps, j, op->window);
+			break;
+		}
+		case STAGED_LAYER:
+			if (cb->layer)
+				failed = cb->layer (data, op->line, text);
+			break;
+		case STAGED_ERROR:
+			if (cb->error)
+				cb->error (data, op->line, text);
+			failed = 1;
+			break;
+		}
+		if (failed && op->line != errorline)
+		{
+			errors++;
+			errorline = op->line;
+		}
+	}
+	return errors;
+}
+
+/* Replay a finished load and discard it */
+int
+loader_replay (const VControl_ParseCallbacks *cb, void *data)
+{
+	int errors = walk (&loading, cb, data);
+	stage_free (&loading);
+	return errors;
+}
+
+/* Go through a finished load without discarding it, so that it can
+ * be checked before it is replayed */
+int
+loader_check (const VControl_ParseCallbacks *cb, void *data)
+{
+	return walk (&loading, cb, data);
+}
+
+void
+loader_discard (void)
+{
+	stage_free (&loading);
+}
+
+void
+loader_cancel (void)
+{
+	if (running)
+	{
+		finish ();
+		stage_free (&loading);
+	}
+	if (done_lock)
+	{
+		SDL_DestroyMutex (done_lock);
+		done_lock = NULL;
+	}
+}
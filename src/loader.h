@@ -0,0 +1,17 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef LOADER_H_
+#define LOADER_H_
+
+int  loader_start (const char *path);
+int  loader_poll (void);
+int  loader_replay (const VControl_ParseCallbacks *callbacks, void *data);
+int  loader_check (const VControl_ParseCallbacks *callbacks, void *data);
+void loader_discard (void);
+void loader_cancel (void);
+#endif
@@ -0,0 +1,175 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include "vcontrol.h"
+#include "publish.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define HAVE_SHM 1
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* The segment is written only by the thread handling input.  Each
+ * write is bracketed by two increments of the sequence counter, with
+ * release barriers so that a reader on another CPU never sees the new
+ * value without the counter having moved. */
+#if SDL_VERSION_ATLEAST(2, 0, 6)
+#define write_barrier() SDL_MemoryBarrierRelease ()
+#else
+#define write_barrier() __sync_synchronize ()
+#endif
+
+static VControl_SharedState *segment;
+static Sint32 *values;
+static Uint32 count;
+static size_t segsize;
+static char segname[256];
+
+#ifdef HAVE_SHM
+
+int
+publish_open (const char *name, VControl_NameBinding *table)
+{
+	size_t namesize = 0, valueoffset, size;
+	Uint32 n = 0, i;
+	char *names;
+	void *mem;
+	int fd;
+
+	publish_close ();
+	if (strlen (name) >= sizeof (segname))
+	{
+		fprintf (stderr, "VControl: Shared memory name '%s' is too long\n", name);
+		return -1;
+	}
+	while (table && table[n].target)
+	{
+		namesize += strlen (table[n].name) + 1;
+		n++;
+	}
+	valueoffset = (sizeof (VControl_SharedState) + namesize + 7) & ~(size_t)7;
+	size = valueoffset + sizeof (Sint32) * n;
+
+	fd = shm_open (name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		fprintf (stderr, "VControl: Couldn't create shared memory '%s': %s\n", name, strerror (errno));
+		return -1;
+	}
+	if (ftruncate (fd, size) < 0)
+	{
+		fprintf (stderr, "VControl: Couldn't size shared memory '%s': %s\n", name, strerror (errno));
+		close (fd);
+		shm_unlink (name);
+		return -1;
+	}
+	mem = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (mem == MAP_FAILED)
+	{
+		fprintf (stderr, "VControl: Couldn't map shared memory '%s': %s\n", name, strerror (errno));
+		shm_unlink (name);
+		return -1;
+	}
+
+	segment = mem;
+	segsize = size;
+	strcpy (segname, name);
+	count = n;
+	values = (Sint32 *)((char *)mem + valueoffset);
+
+	segment->version = VCONTROL_SHARED_VERSION;
+	segment->size = (Uint32)size;
+	segment->count = n;
+	segment->names = sizeof (VControl_SharedState);
+	segment->values = (Uint32)valueoffset;
+	segment->sequence = 0;
+	names = (char *)mem + segment->names;
+	for (i = 0; i < n; i++)
+	{
+		strcpy (names, table[i].name);
+		names += strlen (names) + 1;
+		values[i] = *(table[i].target);
+	}
+	write_barrier ();
+	segment->magic = VCONTROL_SHARED_MAGIC;
+	return 0;
+}
+
+void
+publish_close (void)
+{
+	if (segment)
+	{
+		/* Tell anyone still looking that this one is finished */
+		segment->magic = 0;
+		munmap (segment, segsize);
+		shm_unlink (segname);
+		segment = NULL;
+		values = NULL;
+		count = 0;
+	}
+}
+
+#else
+
+int
+publish_open (const char *name, VControl_NameBinding *table)
+{
+	fprintf (stderr, "VControl: State publication needs POSIX shared memory\n");
+	return -1;
+}
+
+void
+publish_close (void)
+{
+}
+
+#endif
+
+/* The name table changed; start over with the new one */
+int
+publish_reopen (VControl_NameBinding *table)
+{
+	char name[sizeof (segname)];
+	if (!segment)
+		return 0;
+	strcpy (name, segname);
+	return publish_open (name, table);
+}
+
+void
+publish_value (int action, int value)
+{
+	if (!segment || (Uint32)action >= count)
+		return;
+	segment->sequence++;
+	write_barrier ();
+	values[action] = value;
+	write_barrier ();
+	segment->sequence++;
+}
+
+void
+publish_all (VControl_NameBinding *table)
+{
+	Uint32 i;
+	if (!segment)
+		return;
+	segment->sequence++;
+	write_barrier ();
+	for (i = 0; i < count; i++)
+		values[i] = *(table[i].target);
+	write_barrier ();
+	segment->sequence++;
+}
@@ -0,0 +1,16 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef PUBLISH_H_
+#define PUBLISH_H_
+
+int  publish_open (const char *name, VControl_NameBinding *table);
+void publish_close (void);
+int  publish_reopen (VControl_NameBinding *table);
+void publish_value (int action, int value);
+void publish_all (VControl_NameBinding *table);
+#endif
@@ -0,0 +1,119 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include "rcu.h"
+
+/* Grace periods for the binding chains, which dispatch walks without
+ * a lock while another thread may be editing them.  Readers count
+ * themselves in one of two counters, chosen by the parity of the
+ * epoch.  Writers unlink what they remove and retire it; retired
+ * things wait in pending until the epoch is moved on, and then in
+ * waiting until the counter for the old parity drains, when no reader
+ * that could have seen them is left.  Nothing ever waits for readers:
+ * rcu_collect just frees what it can and leaves the rest for next
+ * time.  Writers must not run concurrently with each other.
+ *
+ * A reader checks that the epoch hasn't moved on while it counted
+ * itself, so that it is never counted under a parity the writer has
+ * already finished checking.  Without SDL 2 there are no threads to
+ * wait for, and everything is freed as soon as it is collected. */
+
+static rcu_head *pending, *waiting;
+
+#if SDL_MAJOR_VERSION > 1
+static SDL_atomic_t epoch;
+static SDL_atomic_t readers[2];
+
+int
+rcu_read_lock (void)
+{
+	for (;;)
+	{
+		int e = SDL_AtomicGet (&epoch);
+		SDL_AtomicAdd (&readers[e & 1], 1);
+		if (SDL_AtomicGet (&epoch) == e)
+			return e & 1;
+		SDL_AtomicAdd (&readers[e & 1], -1);
+	}
+}
+
+void
+rcu_read_unlock (int e)
+{
+	SDL_AtomicAdd (&readers[e], -1);
+}
+
+static int
+old_readers (void)
+{
+	return SDL_AtomicGet (&readers[(SDL_AtomicGet (&epoch) & 1) ^ 1]);
+}
+
+static void
+next_epoch (void)
+{
+	SDL_AtomicAdd (&epoch, 1);
+}
+#else
+int
+rcu_read_lock (void)
+{
+	return 0;
+}
+
+void
+rcu_read_unlock (int e)
+{
+}
+
+#define old_readers() 0
+#define next_epoch()
+#endif
+
+void
+rcu_retire (rcu_head *h)
+{
+	h->next = pending;
+	pending = h;
+}
+
+/* Hand whatever the readers are done with to reclaim.  A second pass lets
+ * something retired since the last epoch go at once when there are
+ * no readers about, which is the usual case. */
+void
+rcu_collect (void (*reclaim) (rcu_head *h))
+{
+	int pass;
+	for (pass = 0; pass < 2; pass++)
+	{
+		if (waiting)
+		{
+			if (old_readers ())
+				return;
+			while (waiting)
+			{
+				rcu_head *h = waiting;
+				waiting = h->next;
+				reclaim (h);
+			}
+		}
+		if (!pending)
+			return;
+		waiting = pending;
+		pending = NULL;
+		next_epoch ();
+	}
+}
+
+/* Drop everything retired without reclaiming it, when what it was
+ * embedded in is going away wholesale */
+void
+rcu_forget (void)
+{
+	pending = waiting = NULL;
+}
@@ -0,0 +1,34 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef RCU_H_
+#define RCU_H_
+
+/* Embedded in anything that is freed only after a grace period */
+typedef struct vcontrol_rcu_head_s {
+	struct vcontrol_rcu_head_s *next;
+} rcu_head;
+
+/* Loads of and stores to pointers that readers follow without a
+ * lock.  A store publishes everything written before it. */
+#if defined(__GNUC__) || defined(__clang__)
+#define rcu_deref(p) __atomic_load_n (&(p), __ATOMIC_CONSUME)
+#define rcu_assign(p, v) __atomic_store_n (&(p), (v), __ATOMIC_RELEASE)
+#elif SDL_MAJOR_VERSION > 1
+#define rcu_deref(p) ((void *)SDL_AtomicGetPtr ((void **)&(p)))
+#define rcu_assign(p, v) SDL_AtomicSetPtr ((void **)&(p), (v))
+#else
+#define rcu_deref(p) (p)
+#define rcu_assign(p, v) ((p) = (v))
+#endif
+
+int  rcu_read_lock (void);
+void rcu_read_unlock (int epoch);
+void rcu_retire (rcu_head *h);
+void rcu_collect (void (*reclaim) (rcu_head *h));
+void rcu_forget (void);
+#endif
@@ -0,0 +1,121 @@
+/*
+ * VControl allocation test.  This is Public Domain, but it's worth
+ * noting that VControl itself is provided under the terms of the zlib
+ * license and the SDL library is provided under the terms of the
+ * LGPL.
+ *
+ * Checks that editing bindings within the reserved capacity never
+ * calls the allocator, and that binding past the end of a small
+ * arena fails cleanly.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <SDL.h>
+#include "vcontrol.h"
+
+#define CAPACITY 300
+#define TARGETS 16
+#define ARENA_SIZE (32 * 1024)
+
+static int allocations;
+static int targets[TARGETS];
+static VControl_BindingSpec batch[CAPACITY];
+static char arena[ARENA_SIZE];
+
+static void *
+counting_alloc (void *data, size_t size)
+{
+	allocations++;
+	return malloc (size);
+}
+
+static void *
+counting_resize (void *data, void *block, size_t size)
+{
+	allocations++;
+	return realloc (block, size);
+}
+
+static void
+counting_release (void *data, void *block)
+{
+	free (block);
+}
+
+static int failures;
+
+static void
+check (int ok, const char *what)
+{
+	if (!ok)
+	{
+		printf ("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	VControl_Allocator allocator = { counting_alloc, counting_resize, counting_release, NULL };
+	int before, round, i;
+
+	if (SDL_Init (0) < 0)
+	{
+		fprintf (stderr, "Couldn't initialize SDL: %s\n", SDL_GetError ());
+		return 1;
+	}
+	check (VControl_InitWithAllocator (&allocator) == 0, "InitWithAllocator");
+	check (allocations > 0, "initial tables come from the allocator");
+	check (VControl_ReserveBindings (CAPACITY) == 0, "ReserveBindings");
+	for (i = 0; i < CAPACITY; i++)
+	{
+		batch[i].type = VCONTROL_SPEC_KEY;
+		batch[i].target = &targets[i % TARGETS];
+		batch[i].symbol = 2000 + i;
+	}
+
+	before = allocations;
+	for (round = 0; round < 4; round++)
+	{
+		for (i = 0; i < CAPACITY; i++)
+			check (VControl_AddKeyBinding (1000 + i, &targets[i % TARGETS]) == 0, "AddKeyBinding");
+		for (i = 0; i < CAPACITY; i += 2)
+			VControl_RemoveKeyBinding (1000 + i, &targets[i % TARGETS]);
+		for (i = 0; i < CAPACITY; i += 2)
+			check (VControl_AddKeyBinding (1000 + i, &targets[(i + 1) % TARGETS]) == 0, "AddKeyBinding");
+		for (i = 0; i < CAPACITY; i++)
+		{
+			VControl_ProcessKeyDown (1000 + i);
+			VControl_ProcessKeyUp (1000 + i);
+		}
+		VControl_RemoveAllBindings ();
+		check (VControl_ApplyBindings (batch, CAPACITY, NULL) == 0, "ApplyBindings");
+		VControl_RemoveAllBindings ();
+	}
+	check (allocations == before, "binding edits within capacity don't allocate");
+	if (allocations != before)
+		printf ("  %d allocations\n", allocations - before);
+
+	VControl_Uninit ();
+
+	check (VControl_InitWithArena (arena, sizeof (arena)) == 0, "InitWithArena");
+	for (i = 0; i < ARENA_SIZE; i++)
+	{
+		if (VControl_AddKeyBinding (1000 + i, &targets[i % TARGETS]))
+			break;
+	}
+	check (i > 0 && i < ARENA_SIZE, "binding past the end of the arena fails");
+	VControl_ProcessKeyDown (1000);
+	check (targets[0] == 1, "bindings made before the arena filled still work");
+	VControl_ProcessKeyUp (1000);
+	VControl_RemoveAllBindings ();
+	check (VControl_AddKeyBinding (1000, &targets[0]) == 0, "the arena's bindings can be used again");
+	VControl_Uninit ();
+	SDL_Quit ();
+	if (failures)
+		return 1;
+	printf ("alloc_test: OK\n");
+	return 0;
+}
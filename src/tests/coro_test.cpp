@@ -0,0 +1,107 @@
+/*
+ * VControl coroutine test.  This is Public Domain, but it's worth
+ * noting that VControl itself is provided under the terms of the zlib
+ * license and the SDL library is provided under the terms of the
+ * LGPL.
+ *
+ * Runs a flow through each kind of wait in vcontrol_coro.hpp, which
+ * needs C++20.
+ */
+
+#include <stdio.h>
+#include <SDL.h>
+#include "vcontrol.h"
+#include "vcontrol_coro.hpp"
+
+static int up, down, fire;
+
+static VControl_NameBinding table[] = {
+	{(char *)"Up", &up},
+	{(char *)"Down", &down},
+	{(char *)"Fire", &fire},
+	{0, 0}};
+
+static int step, chosen = -2, timed_out = -2;
+static VControl_BindingSpec raw;
+
+static vcontrol::flow
+script (vcontrol::input_events &vc)
+{
+	co_await vc.pressed ("Fire");
+	step = 1;
+	co_await vc.released ("Fire");
+	step = 2;
+	{
+		auto w = vc.any_of ({"Up", "Down"});
+		chosen = co_await w;
+	}
+	step = 3;
+	{
+		auto w = vc.any_of ({"Up", "Down"}, 100);
+		timed_out = co_await w;
+	}
+	step = 4;
+	raw = co_await vc.next_raw_input ();
+	step = 5;
+}
+
+static int failures;
+
+static void
+check (bool ok, const char *what)
+{
+	if (!ok)
+	{
+		printf ("FAIL: %s\n", what);
+		failures++;
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	if (SDL_Init (0) < 0)
+	{
+		fprintf (stderr, "Couldn't initialize SDL: %s\n", SDL_GetError ());
+		return 1;
+	}
+	VControl_Init ();
+	VControl_RegisterNameTable (table);
+	VControl_AddKeyBinding (SDLK_UP, &up);
+	VControl_AddKeyBinding (SDLK_DOWN, &down);
+	VControl_AddKeyBinding (SDLK_RETURN, &fire);
+	{
+		vcontrol::input_events vc (table);
+		script (vc);
+		vc.run (SDL_GetTicks ());
+		check (step == 0, "flow waits for its first press");
+
+		VControl_ProcessKeyDown (SDLK_RETURN);
+		check (step == 0, "flow isn't resumed from dispatch");
+		vc.run (SDL_GetTicks ());
+		check (step == 1, "pressed");
+		VControl_ProcessKeyUp (SDLK_RETURN);
+		vc.run (SDL_GetTicks ());
+		check (step == 2, "released");
+
+		VControl_ProcessKeyDown (SDLK_DOWN);
+		VControl_ProcessKeyUp (SDLK_DOWN);
+		vc.run (SDL_GetTicks ());
+		check (step == 3 && chosen == 1, "any_of gives the position pressed");
+
+		vc.run (SDL_GetTicks () + 1000);
+		check (step == 4 && timed_out == -1, "any_of times out");
+
+		VControl_ProcessKeyDown (SDLK_SPACE);
+		VControl_ProcessKeyUp (SDLK_SPACE);
+		vc.run (SDL_GetTicks ());
+		check (step == 5 && raw.type == VCONTROL_SPEC_KEY && raw.symbol == SDLK_SPACE,
+		       "next_raw_input gives an unbound key");
+	}
+	VControl_Uninit ();
+	SDL_Quit ();
+	if (failures)
+		return 1;
+	printf ("coro_test: OK\n");
+	return 0;
+}
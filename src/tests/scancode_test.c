@@ -0,0 +1,94 @@
+/*
+ * VControl scancode test.  This is Public Domain, but it's worth
+ * noting that VControl itself is provided under the terms of the zlib
+ * license and the SDL library is provided under the terms of the
+ * LGPL.
+ *
+ * Binds every scancode to a control of its own, dumps the bindings,
+ * reads the dump back, and checks that each scancode still reaches
+ * its own control.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <SDL.h>
+#include "vcontrol.h"
+
+/* Matches SCANCODE_INPUTS in vcontrol.c */
+#define SCANCODES 512
+
+static int targets[SCANCODES];
+static char names[SCANCODES][8];
+static VControl_NameBinding table[SCANCODES + 1];
+
+int
+main (int argc, char **argv)
+{
+	FILE *dump;
+	int i, errors, failures = 0;
+
+	if (SDL_Init (0) < 0)
+	{
+		fprintf (stderr, "Couldn't initialize SDL: %s\n", SDL_GetError ());
+		return 1;
+	}
+	VControl_Init ();
+	for (i = 1; i < SCANCODES; i++)
+	{
+		snprintf (names[i], sizeof (names[i]), "S%d", i);
+		table[i - 1].name = names[i];
+		table[i - 1].target = &targets[i];
+	}
+	table[SCANCODES - 1].name = NULL;
+	table[SCANCODES - 1].target = NULL;
+	VControl_RegisterNameTable (table);
+
+	for (i = 1; i < SCANCODES; i++)
+	{
+		if (VControl_AddScancodeBinding (i, &targets[i]))
+		{
+			printf ("FAIL: couldn't bind scancode %d\n", i);
+			failures++;
+		}
+	}
+	dump = tmpfile ();
+	if (!dump)
+	{
+		fprintf (stderr, "Couldn't create a temporary file\n");
+		return 1;
+	}
+	VControl_Dump (dump);
+	rewind (dump);
+	VControl_RemoveAllBindings ();
+	errors = VControl_ReadConfiguration (dump);
+	fclose (dump);
+	if (errors)
+	{
+		printf ("FAIL: %d errors reading the dump back\n", errors);
+		failures++;
+	}
+
+	for (i = 1; i < SCANCODES; i++)
+	{
+		int j, wrong = 0;
+		VControl_ProcessScancodeDown (i);
+		for (j = 1; j < SCANCODES; j++)
+		{
+			if (targets[j] != (j == i))
+				wrong = j;
+		}
+		VControl_ProcessScancodeUp (i);
+		if (wrong)
+		{
+			printf ("FAIL: scancode %d reaches %s after a round trip\n", i, (wrong == i) ? "nothing" : names[wrong]);
+			failures++;
+		}
+	}
+
+	VControl_Uninit ();
+	SDL_Quit ();
+	if (failures)
+		return 1;
+	printf ("scancode_test: OK\n");
+	return 0;
+}
@@ -0,0 +1,382 @@
+/*
+ * vcontrol-bench: measures VControl end to end, from an input reaching
+ * SDL to its control changing.  This is Public Domain, but it's worth
+ * noting that VControl itself is provided under the terms of the zlib
+ * license and the SDL library is provided under the terms of the LGPL.
+ *
+ * usage: vcontrol-bench [-j STICKS] [-n EVENTS] [-r RATE] [-b BATCH]
+ *                       [-k PERCENT] [-i]
+ *
+ * SDL runs on its dummy video driver unless SDL_VIDEODRIVER says
+ * otherwise, and STICKS (1 to 64, default 4) virtual joysticks are
+ * attached, so no display or devices are needed.  Each joystick has
+ * two axes, four buttons and a hat, and every input, along with the
+ * keys a to z, is bound to a control of its own.
+ *
+ * EVENTS inputs (default 100000) are then changed in a fixed
+ * pseudo-random order, PERCENT of them keys (default 50): keys by
+ * SDL_PushEvent, joysticks through the virtual joystick calls.  Each
+ * change flips exactly one control, so the changes are matched to the
+ * controls in order.  The time from a change to its control flipping
+ * includes SDL's queue, SDL_PollEvent and VControl_HandleEvent, or the
+ * event watch with -i, which runs in immediate mode.
+ *
+ * Without -r, changes are made BATCH at a time (default 64) as fast as
+ * they can be handled, giving the throughput; a batch ends early if it
+ * would change an input twice.  With -r, they are made one at a time,
+ * RATE a second, and the run reports whether that rate was kept up.
+ * Latencies are reported as percentiles in microseconds.  A change
+ * whose control never flips is counted as lost, and the exit status is
+ * 1 if any were.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+#include "vcontrol.h"
+
+#if SDL_VERSION_ATLEAST(2, 0, 14)
+
+#define MAX_STICKS 64
+#define STICK_AXES 2
+#define STICK_BUTTONS 4
+#define STICK_HATS 1
+#define STICK_INPUTS (STICK_AXES + STICK_BUTTONS + STICK_HATS)
+#define KEY_INPUTS 26
+#define MAX_BATCH 4096
+
+enum { INPUT_KEY, INPUT_AXIS, INPUT_BUTTON, INPUT_HAT };
+
+typedef struct _bench_input {
+	int kind;
+	SDL_Joystick *stick;
+	int index;
+	int held, pending;
+	int target;
+} Input;
+
+/* A change waiting for its control to flip */
+typedef struct _bench_change {
+	Input *input;
+	int expect;
+	Uint64 start;
+} Change;
+
+static Input inputs[KEY_INPUTS + MAX_STICKS * STICK_INPUTS];
+static int inputcount, keycount;
+
+static Change *changes;
+static int head, tail;
+static Uint64 *latencies;
+static int measured, lost;
+
+static Uint32 seed = 12345;
+
+static Uint32
+next_random (void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 8;
+}
+
+static int
+attach_sticks (int count)
+{
+	int i;
+	SDL_SetHint (SDL_HINT_JOYSTICK_ALLOW_BACKGROUND_EVENTS, "1");
+	for (i = 0; i < count; i++)
+	{
+		int device = SDL_JoystickAttachVirtual (SDL_JOYSTICK_TYPE_GAMECONTROLLER, STICK_AXES, STICK_BUTTONS, STICK_HATS);
+		SDL_Joystick *stick;
+		int j;
+		if (device < 0 || !(stick = SDL_JoystickOpen (device)))
+		{
+			fprintf (stderr, "vcontrol-bench: Couldn't attach virtual joystick: %s\n", SDL_GetError ());
+			return -1;
+		}
+		/* HandleEvent takes the instance ID as the port */
+		if (SDL_JoystickInstanceID (stick) != device)
+		{
+			fprintf (stderr, "vcontrol-bench: Joystick %d has instance ID %d; unplug other joysticks\n",
+				 device, (int)SDL_JoystickInstanceID (stick));
+			return -1;
+		}
+		for (j = 0; j < STICK_INPUTS; j++)
+		{
+			Input *x = &inputs[inputcount++];
+			x->stick = stick;
+			if (j < STICK_AXES)
+			{
+				x->kind = INPUT_AXIS;
+				x->index = j;
+			}
+			else if (j < STICK_AXES + STICK_BUTTONS)
+			{
+				x->kind = INPUT_BUTTON;
+				x->index = j - STICK_AXES;
+			}
+			else
+			{
+				x->kind = INPUT_HAT;
+				x->index = j - STICK_AXES - STICK_BUTTONS;
+			}
+		}
+	}
+	return 0;
+}
+
+static int
+bind_inputs (void)
+{
+	int i, errors = 0;
+	for (i = 0; i < inputcount; i++)
+	{
+		Input *x = &inputs[i];
+		int port = x->stick ? (int)SDL_JoystickInstanceID (x->stick) : 0;
+		switch (x->kind)
+		{
+		case INPUT_KEY:
+			errors += VControl_AddKeyBinding (SDLK_a + x->index, &x->target) != 0;
+			break;
+		case INPUT_AXIS:
+			errors += VControl_AddJoyAxisBinding (port, x->index, 1, &x->target) != 0;
+			break;
+		case INPUT_BUTTON:
+			errors += VControl_AddJoyButtonBinding (port, x->index, &x->target) != 0;
+			break;
+		case INPUT_HAT:
+			errors += VControl_AddJoyHatBinding (port, x->index, SDL_HAT_UP, &x->target) != 0;
+			break;
+		}
+	}
+	return errors;
+}
+
+/* Flip one input and note when */
+static void
+change (Input *x)
+{
+	Change *c = &changes[tail++];
+	x->held = !x->held;
+	x->pending = 1;
+	c->input = x;
+	c->expect = x->held;
+	c->start = SDL_GetPerformanceCounter ();
+	switch (x->kind)
+	{
+	case INPUT_KEY:
+	{
+		SDL_Event e;
+		memset (&e, 0, sizeof (e));
+		e.type = x->held ? SDL_KEYDOWN : SDL_KEYUP;
+		e.key.state = x->held ? SDL_PRESSED : SDL_RELEASED;
+		e.key.keysym.sym = SDLK_a + x->index;
+		e.key.keysym.scancode = (SDL_Scancode)(SDL_SCANCODE_A + x->index);
+		SDL_PushEvent (&e);
+		break;
+	}
+	case INPUT_AXIS:
+		SDL_JoystickSetVirtualAxis (x->stick, x->index, x->held ? 32767 : 0);
+		break;
+	case INPUT_BUTTON:
+		SDL_JoystickSetVirtualButton (x->stick, x->index, x->held ? SDL_PRESSED : SDL_RELEASED);
+		break;
+	case INPUT_HAT:
+		SDL_JoystickSetVirtualHat (x->stick, x->index, x->held ? SDL_HAT_UP : SDL_HAT_CENTERED);
+		break;
+	}
+}
+
+/* Record every change at the front whose control has flipped */
+static void
+settle (void)
+{
+	Uint64 now = SDL_GetPerformanceCounter ();
+	while (head < tail && (changes[head].input->target != 0) == changes[head].expect)
+	{
+		latencies[measured++] = now - changes[head].start;
+		changes[head].input->pending = 0;
+		head++;
+	}
+}
+
+/* Handle everything SDL has queued.  What is still waiting then was
+ * lost. */
+static void
+drain (void)
+{
+	SDL_Event e;
+	settle ();
+	while (SDL_PollEvent (&e))
+	{
+		VControl_HandleEvent (&e);
+		settle ();
+	}
+	while (head < tail)
+	{
+		Input *x = changes[head++].input;
+		lost++;
+		x->pending = 0;
+		/* Let the model follow the control, so later changes flip it */
+		x->held = (x->target != 0);
+	}
+	head = tail = 0;
+}
+
+static int
+compare_latencies (const void *a, const void *b)
+{
+	Uint64 x = *(const Uint64 *)a, y = *(const Uint64 *)b;
+	return (x < y) ? -1 : (x > y);
+}
+
+static double
+percentile (double p, double scale)
+{
+	int i = (int)(p / 100.0 * (measured - 1) + 0.5);
+	return latencies[i] * scale;
+}
+
+static void
+usage (void)
+{
+	fprintf (stderr, "usage: vcontrol-bench [-j STICKS] [-n EVENTS] [-r RATE] [-b BATCH] [-k PERCENT] [-i]\n");
+	exit (2);
+}
+
+int
+main (int argc, char **argv)
+{
+	int sticks = 4, events = 100000, rate = 0, batch = 64, keypercent = 50, immediate = 0;
+	int i, sent;
+	Uint64 freq, start, elapsed;
+	double us;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!strcmp (argv[i], "-j") && i + 1 < argc)
+			sticks = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-n") && i + 1 < argc)
+			events = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-r") && i + 1 < argc)
+			rate = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-b") && i + 1 < argc)
+			batch = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-k") && i + 1 < argc)
+			keypercent = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-i"))
+			immediate = 1;
+		else
+			usage ();
+	}
+	if (sticks < 1 || sticks > MAX_STICKS || events < 1 || rate < 0 ||
+	    batch < 1 || batch > MAX_BATCH || keypercent < 0 || keypercent > 100)
+		usage ();
+	if (rate)
+		batch = 1;
+
+	SDL_setenv ("SDL_VIDEODRIVER", "dummy", 0);
+	if (SDL_Init (SDL_INIT_VIDEO | SDL_INIT_JOYSTICK) < 0)
+	{
+		fprintf (stderr, "vcontrol-bench: Couldn't initialize SDL: %s\n", SDL_GetError ());
+		return 2;
+	}
+	atexit (SDL_Quit);
+	SDL_JoystickEventState (SDL_ENABLE);
+
+	for (i = 0; i < KEY_INPUTS; i++)
+	{
+		inputs[inputcount].kind = INPUT_KEY;
+		inputs[inputcount].index = i;
+		inputcount++;
+	}
+	keycount = inputcount;
+	/* VControl counts the joysticks when it starts */
+	if (attach_sticks (sticks))
+		return 2;
+	VControl_Init ();
+	if (bind_inputs ())
+	{
+		fprintf (stderr, "vcontrol-bench: Couldn't bind every input\n");
+		return 2;
+	}
+	if (immediate && VControl_SetImmediateMode (1, 1))
+	{
+		fprintf (stderr, "vcontrol-bench: Couldn't enter immediate mode\n");
+		return 2;
+	}
+
+	changes = malloc (sizeof (Change) * batch);
+	latencies = malloc (sizeof (Uint64) * events);
+	if (!changes || !latencies)
+	{
+		fprintf (stderr, "vcontrol-bench: Out of memory\n");
+		return 2;
+	}
+
+	freq = SDL_GetPerformanceFrequency ();
+	start = SDL_GetPerformanceCounter ();
+	for (sent = 0; sent < events; )
+	{
+		if (rate)
+		{
+			Uint64 due = start + (Uint64)((double)sent * freq / rate);
+			while (SDL_GetPerformanceCounter () < due)
+				;
+		}
+		for (i = 0; i < batch && sent < events; i++, sent++)
+		{
+			Input *x;
+			if ((int)(next_random () % 100) < keypercent)
+				x = &inputs[next_random () % keycount];
+			else
+				x = &inputs[keycount + next_random () % (inputcount - keycount)];
+			/* A virtual joystick only reports where it is when SDL
+			 * next looks, so an input changed twice before then
+			 * would seem not to have moved */
+			if (x->pending)
+				drain ();
+			change (x);
+			if (immediate)
+				settle ();
+		}
+		drain ();
+	}
+	elapsed = SDL_GetPerformanceCounter () - start;
+
+	printf ("%d joysticks, %d events, %d%% keys, %s mode, ", sticks, events, keypercent,
+		immediate ? "immediate" : "queued");
+	if (rate)
+		printf ("%d events/s requested\n", rate);
+	else
+		printf ("batches of %d\n", batch);
+	printf ("throughput: %.0f events/s", (double)events * freq / elapsed);
+	if (rate)
+		printf (" (%s)", ((double)events * freq / elapsed >= rate * 0.99) ? "sustained" : "NOT sustained");
+	printf ("\n");
+	if (measured)
+	{
+		us = 1000000.0 / freq;
+		qsort (latencies, measured, sizeof (Uint64), compare_latencies);
+		printf ("latency (us): p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+			percentile (50, us), percentile (90, us), percentile (99, us), percentile (99.9, us),
+			latencies[measured - 1] * us);
+	}
+	printf ("lost: %d\n", lost);
+
+	VControl_Uninit ();
+	free (changes);
+	free (latencies);
+	return lost ? 1 : 0;
+}
+
+#else
+
+int
+main (int argc, char **argv)
+{
+	fprintf (stderr, "vcontrol-bench: Virtual joysticks need SDL 2.0.14 or later\n");
+	return 2;
+}
+
+#endif
@@ -0,0 +1,478 @@
+/*
+ * vcontrol-lint: checks VControl configuration files and rewrites them
+ * in a normal form.  This is Public Domain, but it's worth noting that
+ * VControl itself is provided under the terms of the zlib license and
+ * the SDL library is provided under the terms of the LGPL.
+ *
+ * usage: vcontrol-lint [-j THREADS] [-n NAME,NAME,...] FILE...
+ *
+ * Files are parsed with VControl_ParseConfiguration, spread across one
+ * thread per CPU.  SDL is never initialized, so no devices are needed.
+ * For each file, one line of JSON is written to standard output:
+ *
+ *   {"file": "...", "errors": N,
+ *    "diagnostics": [{"line": N, "message": "..."}, ...],
+ *    "normalized": "..."}
+ *
+ * The normalized text is the file as VControl_Dump would write it back:
+ * base layer first, then each layer after a layer line, with lines
+ * sorted, duplicates dropped and chord inputs in a fixed order.  With
+ * -n, control names missing from the list are errors.  Files come out
+ * in the order they finish.  Exits with 1 if any file had errors.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "vcontrol.h"
+
+#define MAX_LAYERS 32
+#define LAYER_NAME_SIZE 32
+
+typedef struct _lint_buffer {
+	char *text;
+	size_t length, space;
+} Buffer;
+
+typedef struct _lint_line {
+	int layer;
+	char *text;
+} Line;
+
+/* Everything one thread needs to check one file */
+typedef struct _lint_state {
+	char layers[MAX_LAYERS][LAYER_NAME_SIZE];
+	int layercount, layer;
+	Line *lines;
+	int linecount, linespace;
+	Buffer diagnostics;
+	int errors;
+} LintState;
+
+static char **files;
+static int filecount, nextfile;
+static char **names;
+static int namecount;
+static int failures;
+static SDL_mutex *worklock, *outputlock;
+
+static void
+append (Buffer *b, const char *text, size_t length)
+{
+	if (b->length + length + 1 > b->space)
+	{
+		size_t space = b->space ? b->space : 256;
+		while (b->length + length + 1 > space)
+			space *= 2;
+		b->text = realloc (b->text, space);
+		if (!b->text)
+		{
+			fprintf (stderr, "vcontrol-lint: Out of memory\n");
+			exit (2);
+		}
+		b->space = space;
+	}
+	memcpy (b->text + b->length, text, length);
+	b->length += length;
+	b->text[b->length] = '\0';
+}
+
+static void
+append_string (Buffer *b, const char *text)
+{
+	append (b, text, strlen (text));
+}
+
+static void
+append_json (Buffer *b, const char *text)
+{
+	append (b, "\"", 1);
+	for (; *text; text++)
+	{
+		unsigned char c = (unsigned char)*text;
+		if (c == '"' || c == '\\')
+		{
+			append (b, "\\", 1);
+			append (b, text, 1);
+		}
+		else if (c == '\n')
+		{
+			append (b, "\\n", 2);
+		}
+		else if (c < 0x20)
+		{
+			char escape[8];
+			sprintf (escape, "\\u%04x", c);
+			append_string (b, escape);
+		}
+		else
+		{
+			append (b, text, 1);
+		}
+	}
+	append (b, "\"", 1);
+}
+
+static void
+add_diagnostic (LintState *st, int line, const char *message)
+{
+	char number[32];
+	if (st->diagnostics.length)
+		append (&st->diagnostics, ", ", 2);
+	sprintf (number, "{\"line\": %d, \"message\": ", line);
+	append_string (&st->diagnostics, number);
+	append_json (&st->diagnostics, message);
+	append (&st->diagnostics, "}", 1);
+}
+
+static void
+add_line (LintState *st, const char *text)
+{
+	if (st->linecount == st->linespace)
+	{
+		st->linespace = st->linespace ? st->linespace * 2 : 64;
+		st->lines = realloc (st->lines, sizeof (Line) * st->linespace);
+		if (!st->lines)
+		{
+			fprintf (stderr, "vcontrol-lint: Out of memory\n");
+			exit (2);
+		}
+	}
+	st->lines[st->linecount].layer = st->layer;
+	st->lines[st->linecount].text = strdup (text);
+	st->linecount++;
+}
+
+/* The spelling of a control name to use, or NULL if it isn't allowed */
+static const char *
+control_name (LintState *st, int line, const char *name)
+{
+	int i;
+	if (!names)
+		return name;
+	for (i = 0; i < namecount; i++)
+	{
+		if (!strcasecmp (name, names[i]))
+			return names[i];
+	}
+	{
+		char message[128];
+		snprintf (message, sizeof (message), "Illegal command type '%s'", name);
+		add_diagnostic (st, line, message);
+	}
+	return NULL;
+}
+
+static int
+compare_strings (const void *a, const void *b)
+{
+	return strcmp (*(const char **)a, *(const char **)b);
+}
+
+static int
+compare_lines (const void *a, const void *b)
+{
+	const Line *x = a, *y = b;
+	if (x->layer != y->layer)
+		return x->layer - y->layer;
+	return strcmp (x->text, y->text);
+}
+
+static int
+lint_binding (void *data, int line, const VControl_BindingSpec *inputs, int count)
+{
+	LintState *st = data;
+	char inputtext[8][64], *sorted[8];
+	char text[640];
+	const char *name;
+	int i;
+	if (inputs[0].type == VCONTROL_SPEC_JOYTHRESHOLD || inputs[0].type == VCONTROL_SPEC_JOYAXISTHRESHOLD ||
+	    inputs[0].type == VCONTROL_SPEC_JOYDEADZONE || inputs[0].type == VCONTROL_SPEC_JOYDEBOUNCE)
+	{
+		/* Joystick settings apply to every layer; Dump puts them in
+		 * the base */
+		int layer = st->layer;
+		VControl_FormatInput (text, sizeof (text), &inputs[0]);
+		st->layer = 0;
+		add_line (st, text);
+		st->layer = layer;
+		return 0;
+	}
+	name = control_name (st, line, inputs[0].name);
+	if (!name)
+		return -1;
+	for (i = 0; i < count && i < 8; i++)
+	{
+		VControl_FormatInput (inputtext[i], sizeof (inputtext[i]), &inputs[i]);
+		sorted[i] = inputtext[i];
+	}
+	qsort (sorted, i, sizeof (char *), compare_strings);
+	snprintf (text, sizeof (text), "%s:", name);
+	for (i = 0; i < count && i < 8; i++)
+	{
+		size_t used = strlen (text);
+		snprintf (text + used, sizeof (text) - used, "%s %s", i ? " +" : "", sorted[i]);
+	}
+	add_line (st, text);
+	return 0;
+}
+
+static int
+lint_combo (void *data, int line, const char *name, const char **steps, int length, Uint32 window)
+{
+	LintState *st = data;
+	Buffer text = { NULL, 0, 0 };
+	char within[32];
+	int i, result = 0;
+	name = control_name (st, line, name);
+	if (!name)
+		return -1;
+	append_string (&text, name);
+	append_string (&text, ": combo");
+	for (i = 0; i < length; i++)
+	{
+		const char *step = control_name (st, line, steps[i]);
+		if (!step)
+		{
+			result = -1;
+			step = steps[i];
+		}
+		append (&text, " ", 1);
+		append_string (&text, step);
+	}
+	sprintf (within, " within %u", (unsigned int)window);
+	append_string (&text, within);
+	if (!result)
+		add_line (st, text.text);
+	free (text.text);
+	return result;
+}
+
+static int
+lint_layer (void *data, int line, const char *name)
+{
+	LintState *st = data;
+	int i;
+	for (i = 0; i < st->layercount; i++)
+	{
+		if (!strcasecmp (name, st->layers[i]))
+		{
+			st->layer = i;
+			return 0;
+		}
+	}
+	if (strlen (name) >= LAYER_NAME_SIZE)
+	{
+		add_diagnostic (st, line, "Layer name is too long");
+		return -1;
+	}
+	if (st->layercount == MAX_LAYERS)
+	{
+		add_diagnostic (st, line, "Too many layers");
+		return -1;
+	}
+	strcpy (st->layers[st->layercount], name);
+	st->layer = st->layercount++;
+	return 0;
+}
+
+static void
+lint_error (void *data, int line, const char *message)
+{
+	add_diagnostic ((LintState *)data, line, message);
+}
+
+static const VControl_ParseCallbacks lint_callbacks = {
+	lint_binding, lint_combo, lint_layer, lint_error
+};
+
+/* Check one file and write its JSON line */
+static void
+lint_file (LintState *st, const char *path)
+{
+	Buffer out = { NULL, 0, 0 };
+	char number[32];
+	FILE *in;
+	int i;
+
+	strcpy (st->layers[0], "base");
+	st->layercount = 1;
+	st->layer = 0;
+	st->linecount = 0;
+	st->diagnostics.length = 0;
+	st->errors = 0;
+
+	in = fopen (path, "r");
+	if (in)
+	{
+		st->errors = VControl_ParseConfiguration (in, &lint_callbacks, st);
+		fclose (in);
+	}
+	else
+	{
+		add_diagnostic (st, 0, strerror (errno));
+		st->errors = 1;
+	}
+
+	append_string (&out, "{\"file\": ");
+	append_json (&out, path);
+	sprintf (number, ", \"errors\": %d", st->errors);
+	append_string (&out, number);
+	append_string (&out, ", \"diagnostics\": [");
+	if (st->diagnostics.length)
+		append (&out, st->diagnostics.text, st->diagnostics.length);
+	append_string (&out, "], \"normalized\": ");
+	if (in)
+	{
+		Buffer normal = { NULL, 0, 0 };
+		int layer = 0;
+		qsort (st->lines, st->linecount, sizeof (Line), compare_lines);
+		append_string (&normal, "");
+		for (i = 0; i < st->linecount; i++)
+		{
+			if (i > 0 && !compare_lines (&st->lines[i - 1], &st->lines[i]))
+				continue;
+			while (layer < st->lines[i].layer)
+			{
+				layer++;
+				append_string (&normal, "layer ");
+				append_string (&normal, st->layers[layer]);
+				append (&normal, "\n", 1);
+			}
+			append_string (&normal, st->lines[i].text);
+			append (&normal, "\n", 1);
+		}
+		/* Keep empty layers, so they still exist when read back */
+		while (layer + 1 < st->layercount)
+		{
+			layer++;
+			append_string (&normal, "layer ");
+			append_string (&normal, st->layers[layer]);
+			append (&normal, "\n", 1);
+		}
+		append_json (&out, normal.text);
+		free (normal.text);
+	}
+	else
+	{
+		append_string (&out, "null");
+	}
+	append (&out, "}\n", 2);
+	for (i = 0; i < st->linecount; i++)
+		free (st->lines[i].text);
+
+	SDL_LockMutex (outputlock);
+	fwrite (out.text, 1, out.length, stdout);
+	if (st->errors)
+		failures++;
+	SDL_UnlockMutex (outputlock);
+	free (out.text);
+}
+
+static int SDLCALL
+worker (void *data)
+{
+	LintState *st = calloc (1, sizeof (LintState));
+	if (!st)
+	{
+		fprintf (stderr, "vcontrol-lint: Out of memory\n");
+		exit (2);
+	}
+	while (1)
+	{
+		int n;
+		SDL_LockMutex (worklock);
+		n = nextfile++;
+		SDL_UnlockMutex (worklock);
+		if (n >= filecount)
+			break;
+		lint_file (st, files[n]);
+	}
+	free (st->lines);
+	free (st->diagnostics.text);
+	free (st);
+	return 0;
+}
+
+static void
+split_names (char *list)
+{
+	char *name;
+	namecount = 0;
+	names = malloc (sizeof (char *) * (strlen (list) + 1));
+	if (!names)
+		exit (2);
+	for (name = strtok (list, ","); name; name = strtok (NULL, ","))
+		names[namecount++] = name;
+}
+
+static void
+usage (void)
+{
+	fprintf (stderr, "usage: vcontrol-lint [-j THREADS] [-n NAME,NAME,...] FILE...\n");
+	exit (2);
+}
+
+int
+main (int argc, char **argv)
+{
+	SDL_Thread **threads;
+	int i, threadcount = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp (argv[i], "-j") && i + 1 < argc)
+			threadcount = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-n") && i + 1 < argc)
+			split_names (argv[++i]);
+		else
+			usage ();
+	}
+	files = argv + i;
+	filecount = argc - i;
+	if (!filecount)
+		usage ();
+
+	if (threadcount < 1)
+	{
+#if SDL_MAJOR_VERSION == 1
+		threadcount = 4;
+#else
+		threadcount = SDL_GetCPUCount ();
+#endif
+	}
+	if (threadcount > filecount)
+		threadcount = filecount;
+
+	worklock = SDL_CreateMutex ();
+	outputlock = SDL_CreateMutex ();
+	threads = malloc (sizeof (SDL_Thread *) * threadcount);
+	if (!worklock || !outputlock || !threads)
+	{
+		fprintf (stderr, "vcontrol-lint: Couldn't set up threads\n");
+		return 2;
+	}
+	for (i = 0; i < threadcount; i++)
+	{
+#if SDL_MAJOR_VERSION == 1
+		threads[i] = SDL_CreateThread (worker, NULL);
+#else
+		threads[i] = SDL_CreateThread (worker, "vcontrol-lint worker", NULL);
+#endif
+		if (!threads[i])
+		{
+			fprintf (stderr, "vcontrol-lint: Couldn't create thread: %s\n", SDL_GetError ());
+			return 2;
+		}
+	}
+	for (i = 0; i < threadcount; i++)
+		SDL_WaitThread (threads[i], NULL);
+
+	free (threads);
+	free (names);
+	SDL_DestroyMutex (worklock);
+	SDL_DestroyMutex (outputlock);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "vcontrol.h"
+#include "trace.h"
+#include "alloc.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/* Recording stops by itself after this many events */
+#define MAX_TRACE_EVENTS (1 << 20)
+
+typedef struct vcontrol_trace_record_s {
+	const char *name;
+	const char *arg1, *arg2;
+	int value1, value2;
+	double time;
+	unsigned long thread;
+	char phase;
+} trace_record;
+
+volatile int trace_recording;
+
+/* Events may come from the event thread, from SDL's in immediate mode,
+ * and from the application's frame marks, so the buffer is locked. */
+static SDL_mutex *trace_lock;
+static trace_record *records;
+static int recordcount, recordspace;
+static int frames_left, frame;
+static char *tracepath;
+
+/* Microseconds on the clock perf and most tracers use */
+static double
+now_us (void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#elif SDL_MAJOR_VERSION > 1
+	return (double)SDL_GetPerformanceCounter () * 1e6 / (double)SDL_GetPerformanceFrequency ();
+#else
+	return SDL_GetTicks () * 1e3;
+#endif
+}
+
+static void
+record (const char *name, char phase, const char *arg1, int value1, const char *arg2, int value2)
+{
+	trace_record *r;
+	if (recordcount == recordspace)
+	{
+		int newspace = recordspace ? recordspace * 2 : 4096;
+		trace_record *newrecords;
+		if (newspace > MAX_TRACE_EVENTS)
+			return;
+		newrecords = vc_realloc (records, sizeof (trace_record) * newspace);
+		if (!newrecords)
+			return;
+		records = newrecords;
+		recordspace = newspace;
+	}
+	r = &records[recordcount++];
+	r->name = name;
+	r->phase = phase;
+	r->arg1 = arg1;
+	r->value1 = value1;
+	r->arg2 = arg2;
+	r->value2 = value2;
+	r->time = now_us ();
+	r->thread = (unsigned long)SDL_ThreadID ();
+}
+
+void
+trace_event (const char *name, char phase, const char *arg1, int value1, const char *arg2, int value2)
+{
+	SDL_LockMutex (trace_lock);
+	if (trace_recording)
+		record (name, phase, arg1, value1, arg2, value2);
+	SDL_UnlockMutex (trace_lock);
+}
+
+static void
+write_trace (void)
+{
+	FILE *out = fopen (tracepath, "w");
+	int i, pid = 0;
+	if (!out)
+	{
+		fprintf (stderr, "VControl: Couldn't write trace to '%s'\n", tracepath);
+		return;
+	}
+#if defined(__unix__) || defined(__APPLE__)
+	pid = (int)getpid ();
+#endif
+	fprintf (out, "{\"traceEvents\": [\n");
+	for (i = 0; i < recordcount; i++)
+	{
+		trace_record *r = &records[i];
+		fprintf (out, "{\"name\": \"%s\", \"cat\": \"vcontrol\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %lu",
+			 r->name, r->phase, r->time, pid, r->thread);
+		if (r->phase == 'i')
+			fprintf (out, ", \"s\": \"t\"");
+		if (r->arg1)
+		{
+			fprintf (out, ", \"args\": {\"%s\": %d", r->arg1, r->value1);
+			if (r->arg2)
+				fprintf (out, ", \"%s\": %d", r->arg2, r->value2);
+			fprintf (out, "}");
+		}
+		fprintf (out, "}%s\n", (i + 1 < recordcount) ? "," : "");
+	}
+	fprintf (out, "], \"displayTimeUnit\": \"ms\"}\n");
+	fclose (out);
+}
+
+int
+trace_start (const char *path, int frames)
+{
+	trace_stop ();
+	/* The lock outlives each trace, since another thread may be about
+	 * to take it just as recording stops. */
+	if (!trace_lock)
+		trace_lock = SDL_CreateMutex ();
+	tracepath = vc_malloc (strlen (path) + 1);
+	if (!trace_lock || !tracepath)
+	{
+		fprintf (stderr, "VControl: Couldn't start trace\n");
+		vc_free (tracepath);
+		tracepath = NULL;
+		return -1;
+	}
+	strcpy (tracepath, path);
+	SDL_LockMutex (trace_lock);
+	recordcount = 0;
+	frames_left = frames;
+	frame = 0;
+	record ("frame", 'B', "frame", frame, NULL, 0);
+	trace_recording = 1;
+	SDL_UnlockMutex (trace_lock);
+	return 0;
+}
+
+void
+trace_frame (void)
+{
+	int done;
+	if (!trace_recording)
+		return;
+	SDL_LockMutex (trace_lock);
+	record ("frame", 'E', "frame", frame, NULL, 0);
+	frame++;
+	done = (--frames_left <= 0);
+	if (!done)
+		record ("frame", 'B', "frame", frame, NULL, 0);
+	else
+		trace_recording = 0;
+	SDL_UnlockMutex (trace_lock);
+	if (done)
+		trace_stop ();
+}
+
+void
+trace_stop (void)
+{
+	if (!tracepath)
+		return;
+	SDL_LockMutex (trace_lock);
+	if (trace_recording)
+	{
+		record ("frame", 'E', "frame", frame, NULL, 0);
+		trace_recording = 0;
+	}
+	SDL_UnlockMutex (trace_lock);
+	write_trace ();
+	vc_free (records);
+	records = NULL;
+	recordcount = recordspace = 0;
+	vc_free (tracepath);
+	tracepath = NULL;
+}
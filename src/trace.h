@@ -0,0 +1,71 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+/* Tracepoints.  Built with VCONTROL_USDT defined, each one is also a
+ * USDT probe in provider "vcontrol", which costs a NOP until a tracer
+ * attaches; otherwise the probe part compiles to nothing.  While a
+ * trace is being recorded, each one also adds a trace event.
+ *
+ *   handle_event_entry / handle_event_return (event type)
+ *   transition (target, new value, name table index)
+ *   joystick_open (index, axes, buttons, hats)
+ *   parse_start / parse_done (lines, errors)
+ */
+
+#ifdef VCONTROL_USDT
+#include <sys/sdt.h>
+#define PROBE1(name, a) DTRACE_PROBE1 (vcontrol, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2 (vcontrol, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3 (vcontrol, name, a, b, c)
+#define PROBE4(name, a, b, c, d) DTRACE_PROBE4 (vcontrol, name, a, b, c, d)
+#else
+#define PROBE1(name, a) ((void)0)
+#define PROBE2(name, a, b) ((void)0)
+#define PROBE3(name, a, b, c) ((void)0)
+#define PROBE4(name, a, b, c, d) ((void)0)
+#endif
+
+extern volatile int trace_recording;
+void trace_event (const char *name, char phase, const char *arg1, int value1, const char *arg2, int value2);
+
+#define TRACE_HANDLE_EVENT_ENTRY(type) do { \
+	PROBE1 (handle_event_entry, type); \
+	if (trace_recording) trace_event ("HandleEvent", 'B', "type", (int)(type), NULL, 0); \
+} while (0)
+
+#define TRACE_HANDLE_EVENT_RETURN(type) do { \
+	PROBE1 (handle_event_return, type); \
+	if (trace_recording) trace_event ("HandleEvent", 'E', "type", (int)(type), NULL, 0); \
+} while (0)
+
+#define TRACE_TRANSITION(target, value, action) do { \
+	PROBE3 (transition, target, value, action); \
+	if (trace_recording) trace_event ("transition", 'i', "action", action, "value", value); \
+} while (0)
+
+#define TRACE_JOYSTICK_OPEN(index, axes, buttons, hats) do { \
+	PROBE4 (joystick_open, index, axes, buttons, hats); \
+	if (trace_recording) trace_event ("joystick open", 'i', "index", index, NULL, 0); \
+} while (0)
+
+#define TRACE_PARSE_START() do { \
+	PROBE1 (parse_start, 0); \
+	if (trace_recording) trace_event ("ParseConfiguration", 'B', NULL, 0, NULL, 0); \
+} while (0)
+
+#define TRACE_PARSE_DONE(lines, errors) do { \
+	PROBE2 (parse_done, lines, errors); \
+	if (trace_recording) trace_event ("ParseConfiguration", 'E', "lines", lines, "errors", errors); \
+} while (0)
+
+int  trace_start (const char *path, int frames);
+void trace_frame (void);
+void trace_stop (void);
+#endif
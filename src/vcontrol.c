@@ -6,11 +6,26 @@
  */
 
 #include <SDL.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdarg.h>
 #include "vcontrol.h"
 #include "keynames.h"
+#include "combo.h"
+#include "publish.h"
+#include "inject.h"
+#include "trace.h"
+#include "wheel.h"
+#include "rcu.h"
+#include "alloc.h"
+#include "loader.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VCONTROL_SSE2
+#endif
 
 /* If we're in Windows, we don't have strcasecmp */
 #ifdef WIN32
@@ -26,11 +41,67 @@
  * entry per key. */
 #define KEYBOARD_INPUT_BUCKETS 512
 
+/* Scancodes, unlike key symbols, are small and dense, so scancode
+ * bindings live in a table with a chain per scancode.  SDL2 has 512
+ * scancodes; SDL1 has 256. */
+#define SCANCODE_INPUTS 512
+#define SCANCODE_WORDS (SCANCODE_INPUTS / 32)
+
+/* Chords are matched against a bitmask of the physical inputs that
+ * take part in any chord.  MAX_CHORD_INPUTS bounds the number of such
+ * distinct inputs; MAX_CHORD_LENGTH bounds the inputs in one chord. */
+#define MAX_CHORD_INPUTS 128
+#define CHORD_WORDS (MAX_CHORD_INPUTS / 32)
+#define MAX_CHORD_LENGTH 8
+
+/* Every binding belongs to one layer, and the live layers are kept as
+ * a bitmask, so switching is a matter of changing the mask.  Layer 0
+ * is the base layer and can't be removed from the stack. */
+#define MAX_LAYERS 32
+#define LAYER_NAME_SIZE 32
+#define LAYER_BIT(n) ((Uint32)1 << (n))
+
+/* Keys held down at once that are carried over to a new layer */
+#define MAX_HELD_KEYS 32
+
+/* Words of button bits in a polled joystick snapshot */
+#define POLLED_BUTTON_WORDS(buttons) (((buttons) + 31) / 32)
+
+/* Every physical input has a 32-bit source ID.  The top four bits
+ * give its class.  For a key the rest is its key code, with SDL2's
+ * scancode bit folded down into bit 27, and for a scancode it is the
+ * scancode.  For a joystick input they
+ * are the port, the index of the axis, button or hat, and a single
+ * direction bit: 1 for a button, 1 or 2 for the negative or positive
+ * side of an axis, and the SDL_HAT_* bit for a hat. */
+#define SOURCE_KEY    0x10000000u
+#define SOURCE_AXIS   0x20000000u
+#define SOURCE_BUTTON 0x30000000u
+#define SOURCE_HAT    0x40000000u
+#define SOURCE_SCANCODE 0x50000000u
+#define SOURCE_CLASS(s) ((s) & 0xf0000000u)
+#define SOURCE_PORT(s)  (((s) >> 20) & 0xff)
+#define SOURCE_INDEX(s) (((s) >> 4) & 0xffff)
+#define SOURCE_DIR(s)   ((s) & 0xf)
+#define JOY_SOURCE(class, port, index, dir) \
+	((class) | ((Uint32)(port) << 20) | ((Uint32)(index) << 4) | (Uint32)(dir))
+#define MAX_SOURCE_PORT  0xff
+#define MAX_SOURCE_INDEX 0xffff
+
+#define AXIS_NEGATIVE 1
+#define AXIS_POSITIVE 2
+
 typedef struct vcontrol_keybinding_s {
 	int *target;
-	sdl_key_t keycode;
+	Uint32 source;
+	int chord;  /* If nonzero, this feeds chord input (chord - 1) */
+	int timed;  /* If nonzero, this drives timed binding (timed - 1) */
+	int action; /* Index of target in the name table, or -1 */
+	int layer;
 	struct vcontrol_keypool_s *parent;
 	struct vcontrol_keybinding_s *next;
+	struct vcontrol_keybinding_s *tnext;  /* Next with the same target */
+	rcu_head rcu;  /* For freeing once removed */
 } keybinding;
 
 typedef struct vcontrol_keypool_s {
@@ -39,36 +110,209 @@ typedef struct vcontrol_keypool_s {
 	struct vcontrol_keypool_s *next;
 } keypool;
 
-typedef struct vcontrol_joystick_axis_s {
-	keybinding *neg, *pos;
-	int polarity;
-} axis;
+/* How one axis reads as pressed.  press and release are the levels
+ * at which it engages and lets go again, or -1 to use the joystick's
+ * threshold.  An axis paired with partner as one stick reads as centred
+ * while the two lie within deadzone of the middle.  value is the last
+ * position seen. */
+typedef struct vcontrol_joyaxis_s {
+	int press, release;
+	int partner;
+	int deadzone;
+	int value;
+} joyaxis;
 
-typedef struct vcontrol_joystick_hat_s {
-	keybinding *left, *right, *up, *down;
-	Uint8 last;
-} hat;
+/* A button being debounced.  While timer is pending, changes are only
+ * recorded in down; the button's state catches up when it goes off.
+ * timer must come first, since expiry hands back a pointer to it. */
+typedef struct vcontrol_bounce_s {
+	wheel_timer timer;
+	int port, button;
+	Uint8 down;
+} bounce;
 
+/* A joystick's axes, buttons and hats are numbered in that order as
+ * its inputs.  Each input has four chains, one per direction bit, and
+ * a state byte holding the direction bits now held, so every kind of
+ * input is dispatched by the same table lookup (see dispatch). */
 typedef struct vcontrol_joystick_s {
 	SDL_Joystick *stick;
 	int numaxes, numbuttons, numhats;
 	int threshold;
-	axis *axes;
-	keybinding **buttons;
-	hat *hats;
+	Uint32 debounce;
+	keybinding **chains;
+	Uint8 *state;
+	joyaxis *axes;
+	bounce *bounces;
+	/* The input as VControl_PollInput last read it.  Axes and hats
+	 * have the fresh reading in the first half and the previous one
+	 * in the second; buttons are one bit each. */
+	Sint16 *polled_axes;
+	Uint32 *polled_buttons;
+	Uint8 *polled_hats;
 } joystick;
 
+/* A physical input that is part of at least one chord.  Its binding
+ * in the ordinary tables targets count; refs is the number of chords
+ * using it, and a slot with no refs is free. */
+typedef struct vcontrol_chord_input_s {
+	VControl_BindingSpec input;
+	int count;
+	int refs;
+} chord_input;
+
+typedef struct vcontrol_chord_s {
+	Uint32 mask[CHORD_WORDS];
+	int *target;
+	int action;
+	int layer;
+	int active;
+} chord;
+
+/* A binding with a hold, tap or turbo modifier.  Like a chord input,
+ * its binding in the ordinary tables targets count; the modifier and
+ * the wheel timer decide when target itself is signalled.  timer must
+ * come first, since expiry hands back a pointer to it. */
+typedef struct vcontrol_timed_s {
+	wheel_timer timer;
+	VControl_BindingSpec input;
+	int count;
+	int *target;
+	int action;
+	int layer;
+	int on;
+	Uint32 pressed_at;
+} timed;
+
+/* Every binding except a chord input is also on a list of those with
+ * the same target, so the bindings of one control can be found without
+ * searching every chain.  A timed binding is listed under the target
+ * of its timed entry.  The lists are found through an open addressing
+ * hash table keyed on the target, with a slot per target in use. */
+typedef struct vcontrol_target_list_s {
+	int *target;
+	keybinding *head;
+} target_list;
+
+/* The layer stack, bottom first.  live has a bit for each layer on the
+ * stack; consume has one for each that hides lower layers. */
+typedef struct vcontrol_layer_stack_s {
+	int layer[MAX_LAYERS];
+	int depth;
+	Uint32 live, consume;
+} layer_stack;
+
 static keybinding *bindings[KEYBOARD_INPUT_BUCKETS];
+static keybinding *scanbindings[SCANCODE_INPUTS];
+static Uint32 scanheld[SCANCODE_WORDS];
 static joystick *joysticks;
 static int joycount;
 
+static chord_input chord_inputs[MAX_CHORD_INPUTS];
+static int chord_input_top;	/* Slots ever used since the last clear */
+static Uint32 chord_held[CHORD_WORDS];
+static chord *chords;
+static int chordcount, chordspace;
+
+/* Removed timed bindings leave NULL holes, since keybindings hold
+ * their indices.  Spares are entries allocated ahead of time by
+ * reserve_timed. */
+static timed **timeds;
+static int timedcount, timedspace;
+static timed **spares;
+static int sparecount, sparespace;
+
+static target_list *targets;
+static int targetcount, targetmask;
+
+/* One spec of a batch being applied, once checked.  ApplyBindings
+ * keeps them, and the hash table it checks them with, in scratch
+ * space sized by ReserveBindings or the largest batch so far. */
+typedef struct vcontrol_pending_s {
+	int status;
+	Uint32 source;
+	int *target;
+} pending;
+
+static pending *scratch;
+static size_t *scratchtable;
+static size_t scratchspace;
+
+static char layernames[MAX_LAYERS][LAYER_NAME_SIZE];
+static int layercount;
+static int edit_layer;
+static layer_stack stack;
+
+static sdl_key_t heldkeys[MAX_HELD_KEYS];
+static int heldkeycount;
+
 static keypool *pool;
 static VControl_NameBinding *nametable;
 
+/* Key hash figures for GetMemoryStats, recounted once the chains have
+ * changed */
+static int chain_stats_valid;
+static int buckets_used, longest_chain;
+
+/* Transition times for each control in the name table, indexed by its
+ * position there.  event_time is the timestamp of the event being
+ * handled, if HandleEvent has one. */
+static Uint32 *press_time, *release_time, *press_count;
+static int timecount;
+static Uint32 event_time;
+static int have_event_time;
+
+/* Polling mode, and the keyboard state as PollInput last read it */
+static int polling;
+static Uint8 polled_keys[SCANCODE_INPUTS];
+
+/* Hooks for watching transitions and raw input */
+static VControl_TransitionHook transition_hook;
+static void *transition_data;
+static VControl_InputHook input_hook;
+static void *input_data;
+
+#if SDL_MAJOR_VERSION > 1
+/* Immediate mode.  Input events are handled from an event watch, or
+ * from an event filter chained in front of the application's if they
+ * are also to be dropped.  SDL runs these on whichever thread queues
+ * the event, so dispatch_lock keeps them from overlapping. */
+static int immediate;
+static int immediate_consume;
+static SDL_mutex *dispatch_lock;
+static SDL_EventFilter saved_filter;
+static void *saved_filter_data;
+
+/* The joystick sampler, which dispatches from its own thread under
+ * the same lock */
+static SDL_Thread *sampler;
+static SDL_atomic_t sampling;
+static Uint32 sample_hz;
+#endif
+
+/* Take and give back the listener's lock, when there is one */
+static void
+lock_dispatch (void)
+{
+#if SDL_MAJOR_VERSION > 1
+	if (dispatch_lock)
+		SDL_LockMutex (dispatch_lock);
+#endif
+}
+
+static void
+unlock_dispatch (void)
+{
+#if SDL_MAJOR_VERSION > 1
+	if (dispatch_lock)
+		SDL_UnlockMutex (dispatch_lock);
+#endif
+}
+
 static keypool *
 allocate_key_chunk (void)
 {
-	keypool *x = malloc (sizeof (keypool));
+	keypool *x = vc_malloc (sizeof (keypool));
 	if (x)
 	{
 		int i;
@@ -77,8 +321,13 @@ allocate_key_chunk (void)
 		for (i = 0; i < POOL_CHUNK_SIZE; i++)
 		{
 			x->pool[i].target = NULL;
-			x->pool[i].keycode = SDLK_UNKNOWN;
+			x->pool[i].source = 0;
+			x->pool[i].chord = 0;
+			x->pool[i].timed = 0;
+			x->pool[i].action = -1;
+			x->pool[i].layer = 0;
 			x->pool[i].next = NULL;
+			x->pool[i].tnext = NULL;
 			x->pool[i].parent = x;
 		}
 	}
@@ -91,7 +340,39 @@ free_key_pool (keypool *x)
 	if (x)
 	{
 		free_key_pool (x->next);
-		free (x);
+		vc_free (x);
+	}
+}
+
+static void
+destroy_joystick (int index)
+{
+	SDL_Joystick *stick = joysticks[index].stick;
+	if (stick)
+	{
+		int i;
+		SDL_JoystickClose (stick);
+		joysticks[index].stick = NULL;
+		if (joysticks[index].bounces)
+		{
+			for (i = 0; i < joysticks[index].numbuttons; i++)
+				wheel_cancel (&joysticks[index].bounces[i].timer);
+		}
+		vc_free (joysticks[index].chains);
+		vc_free (joysticks[index].state);
+		vc_free (joysticks[index].axes);
+		vc_free (joysticks[index].bounces);
+		vc_free (joysticks[index].polled_axes);
+		vc_free (joysticks[index].polled_buttons);
+		vc_free (joysticks[index].polled_hats);
+		joysticks[index].numaxes = joysticks[index].numbuttons = joysticks[index].numhats = 0;
+		joysticks[index].chains = NULL;
+		joysticks[index].state = NULL;
+		joysticks[index].axes = NULL;
+		joysticks[index].bounces = NULL;
+		joysticks[index].polled_axes = NULL;
+		joysticks[index].polled_buttons = NULL;
+		joysticks[index].polled_hats = NULL;
 	}
 }
 
@@ -114,7 +395,7 @@ create_joystick (int index)
 	if (stick)
 	{
 		joystick *x = &joysticks[index];
-		int j;
+		int j, inputs;
 #if SDL_MAJOR_VERSION == 1
 		fprintf (stderr, "VControl opened joystick: %s\n", SDL_JoystickName (index));
 #else
@@ -127,24 +408,47 @@ create_joystick (int index)
 		x->numaxes = axes;
 		x->numbuttons = buttons;
 		x->numhats = hats;
-		x->axes = malloc (sizeof (axis) * axes);
-		x->buttons = malloc (sizeof (keybinding *) * buttons);
-		x->hats = malloc (sizeof (hat) * hats);
-		for (j = 0; j < axes; j++)
+		inputs = axes + buttons + hats;
+		x->chains = vc_malloc (sizeof (keybinding *) * 4 * (inputs + 1));
+		x->state = vc_malloc (sizeof (Uint8) * (inputs + 1));
+		x->axes = vc_malloc (sizeof (joyaxis) * (axes + 1));
+		x->bounces = vc_malloc (sizeof (bounce) * (buttons + 1));
+		x->polled_axes = vc_malloc (sizeof (Sint16) * (2 * axes + 1));
+		x->polled_buttons = vc_malloc (sizeof (Uint32) * (POLLED_BUTTON_WORDS (buttons) + 1));
+		x->polled_hats = vc_malloc (sizeof (Uint8) * (2 * hats + 1));
+		if (!x->chains || !x->state || !x->axes || !x->bounces ||
+		    !x->polled_axes || !x->polled_buttons || !x->polled_hats)
 		{
-			x->axes[j].neg = x->axes[j].pos = NULL;
+			fprintf (stderr, "VControl: Out of memory for joystick #%d\n", index);
+			x->stick = stick;
+			destroy_joystick (index);
+			return;
 		}
-		for (j = 0; j < hats; j++)
+		for (j = 0; j < 4 * inputs; j++)
+			x->chains[j] = NULL;
+		for (j = 0; j < inputs; j++)
+			x->state[j] = 0;
+		for (j = 0; j < axes; j++)
 		{
-			x->hats[j].left = x->hats[j].right = NULL;
-			x->hats[j].up = x->hats[j].down = NULL;
-			x->hats[j].last = SDL_HAT_CENTERED;
+			x->axes[j].press = x->axes[j].release = -1;
+			x->axes[j].partner = -1;
+			x->axes[j].deadzone = 0;
+			x->axes[j].value = 0;
 		}
+		memset (x->bounces, 0, sizeof (bounce) * buttons);
+		memset (x->polled_axes, 0, sizeof (Sint16) * 2 * axes);
+		memset (x->polled_buttons, 0, sizeof (Uint32) * POLLED_BUTTON_WORDS (buttons));
+		memset (x->polled_hats, 0, sizeof (Uint8) * 2 * hats);
 		for (j = 0; j < buttons; j++)
 		{
-			x->buttons[j] = NULL;
+			x->bounces[j].port = index;
+			x->bounces[j].button = j;
 		}
-		x->stick = stick;
+		/* Publish the tables with the stick, for a reader on
+		 * another thread; the dispatch paths load it with
+		 * rcu_deref */
+		rcu_assign (x->stick, stick);
+		TRACE_JOYSTICK_OPEN (index, axes, buttons, hats);
 	}
 	else
 	{
@@ -152,23 +456,6 @@ create_joystick (int index)
 	}
 }
 			
-static void
-destroy_joystick (int index)
-{
-	SDL_Joystick *stick = joysticks[index].stick;
-	if (stick)
-	{
-		SDL_JoystickClose (stick);
-		joysticks[index].stick = NULL;
-		free (joysticks[index].axes);
-		free (joysticks[index].buttons);
-		free (joysticks[index].hats);
-		joysticks[index].numaxes = joysticks[index].numbuttons = 0;
-		joysticks[index].axes = NULL;
-		joysticks[index].buttons = NULL;
-		joysticks[index].hats = NULL;
-	}
-}
 
 static void
 key_init (void)
@@ -177,19 +464,55 @@ key_init (void)
 	pool = allocate_key_chunk ();
 	for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
 		bindings[i] = NULL;
+	for (i = 0; i < SCANCODE_INPUTS; i++)
+		scanbindings[i] = NULL;
+	for (i = 0; i < SCANCODE_WORDS; i++)
+		scanheld[i] = 0;
+	chain_stats_valid = 0;
+	for (i = 0; i < MAX_CHORD_INPUTS; i++)
+	{
+		chord_inputs[i].count = 0;
+		chord_inputs[i].refs = 0;
+	}
+	chord_input_top = 0;
+	for (i = 0; i < CHORD_WORDS; i++)
+		chord_held[i] = 0;
+	chords = NULL;
+	chordcount = chordspace = 0;
+	timeds = NULL;
+	timedcount = timedspace = 0;
+	spares = NULL;
+	sparecount = sparespace = 0;
+	targets = NULL;
+	targetcount = targetmask = 0;
+	heldkeycount = 0;
 	/* Prepare for possible joystick controls.  We don't actually
 	   GRAB joysticks unless we're asked to make a joystick
 	   binding, though. */
 	joycount = SDL_NumJoysticks ();
+	if (joycount > MAX_SOURCE_PORT + 1)
+		joycount = MAX_SOURCE_PORT + 1;
 	if (joycount)
 	{
-		joysticks = malloc (sizeof (joystick) * joycount);
+		joysticks = vc_malloc (sizeof (joystick) * joycount);
+		if (!joysticks)
+		{
+			fprintf (stderr, "VControl: Out of memory for joysticks\n");
+			joycount = 0;
+		}
 		for (i = 0; i < joycount; i++)
 		{
 			joysticks[i].stick = NULL;	
-			joysticks[i].numaxes = joysticks[i].numbuttons = 0;
+			joysticks[i].numaxes = joysticks[i].numbuttons = joysticks[i].numhats = 0;
+			joysticks[i].threshold = 0;
+			joysticks[i].debounce = 0;
+			joysticks[i].chains = NULL;
+			joysticks[i].state = NULL;
 			joysticks[i].axes = NULL;
-			joysticks[i].buttons = NULL;
+			joysticks[i].bounces = NULL;
+			joysticks[i].polled_axes = NULL;
+			joysticks[i].polled_buttons = NULL;
+			joysticks[i].polled_hats = NULL;
 		}
 	}
 	else
@@ -202,39 +525,138 @@ static void
 key_uninit (void)
 {
 	int i;
+	rcu_forget ();
 	free_key_pool (pool);
 	for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
 		bindings[i] = NULL;
+	for (i = 0; i < SCANCODE_INPUTS; i++)
+		scanbindings[i] = NULL;
 	pool = NULL;
 	for (i = 0; i < joycount; i++)
 		destroy_joystick (i);
-	free (joysticks);
+	vc_free (joysticks);
+	vc_free (chords);
+	chords = NULL;
+	chordcount = chordspace = 0;
+	wheel_clear ();
+	for (i = 0; i < timedcount; i++)
+		vc_free (timeds[i]);
+	vc_free (timeds);
+	timeds = NULL;
+	timedcount = timedspace = 0;
+	for (i = 0; i < sparecount; i++)
+		vc_free (spares[i]);
+	vc_free (spares);
+	spares = NULL;
+	sparecount = sparespace = 0;
+	vc_free (targets);
+	targets = NULL;
+	targetcount = targetmask = 0;
+	vc_free (scratch);
+	vc_free (scratchtable);
+	scratch = NULL;
+	scratchtable = NULL;
+	scratchspace = 0;
+	combo_clear ();
+}
+
+static void
+layer_init (void)
+{
+	strcpy (layernames[0], "base");
+	layercount = 1;
+	edit_layer = 0;
+	stack.layer[0] = 0;
+	stack.depth = 1;
+	stack.live = LAYER_BIT (0);
+	stack.consume = 0;
 }
 
 static void
 name_init (void)
 {
 	nametable = NULL;
+	press_time = release_time = press_count = NULL;
+	timecount = 0;
 }
 
 static void
 name_uninit (void)
 {
 	nametable = NULL;
+	vc_free (press_time);
+	vc_free (release_time);
+	vc_free (press_count);
+	press_time = release_time = press_count = NULL;
+	timecount = 0;
 }
 
 void
 VControl_Init (void)
 {
+#if SDL_MAJOR_VERSION > 1
+	/* The listener's lock lives as long as the library, since the
+	 * Process routines and the rebinding thread may be about to take
+	 * it whenever immediate mode or sampling is switched. */
+	if (!dispatch_lock)
+		dispatch_lock = SDL_CreateMutex ();
+	if (!dispatch_lock)
+		fprintf (stderr, "VControl: Couldn't create the listener's lock: %s\n", SDL_GetError ());
+#endif
 	key_init ();
+	layer_init ();
 	name_init ();
 }
 
+int
+VControl_InitWithAllocator (const VControl_Allocator *allocator)
+{
+	alloc_set (allocator);
+	VControl_Init ();
+	if (!pool)
+	{
+		fprintf (stderr, "VControl: Out of memory initializing\n");
+		VControl_Uninit ();
+		return -1;
+	}
+	return 0;
+}
+
+int
+VControl_InitWithArena (void *memory, size_t size)
+{
+	if (alloc_arena (memory, size))
+	{
+		fprintf (stderr, "VControl: Arena of %lu bytes is too small\n", (unsigned long)size);
+		return -1;
+	}
+	VControl_Init ();
+	if (!pool)
+	{
+		fprintf (stderr, "VControl: Arena of %lu bytes is too small\n", (unsigned long)size);
+		VControl_Uninit ();
+		return -1;
+	}
+	return 0;
+}
+
 void
 VControl_Uninit (void)
 {
+	VControl_StopJoySampling ();
+	VControl_SetImmediateMode (0, 0);
+	inject_stop ();
+	loader_cancel ();
+	publish_close ();
+	trace_stop ();
 	key_uninit ();
 	name_uninit ();
+	alloc_set (NULL);
+#if SDL_MAJOR_VERSION > 1
+	if (dispatch_lock)
+		SDL_DestroyMutex (dispatch_lock);
+	dispatch_lock = NULL;
+#endif
 }
 
 int
@@ -252,1073 +674,4778 @@ VControl_SetJoyThreshold (int port, int threshold)
 	return 0;
 }
 
-
-static void
-add_binding (keybinding **newptr, int *target, sdl_key_t keycode)
+/* Whether a spec type configures a joystick rather than binding an
+ * input to a control */
+static int
+joystick_setting (int type)
 {
-	keybinding *newbinding;
-	keypool *searchbase;
-	int i;
+	return type == VCONTROL_SPEC_JOYTHRESHOLD || type == VCONTROL_SPEC_JOYAXISTHRESHOLD ||
+		type == VCONTROL_SPEC_JOYDEADZONE || type == VCONTROL_SPEC_JOYDEBOUNCE;
+}
 
-	/* Acquire a pointer to the keybinding * that we'll be
-	 * overwriting.  Along the way, ensure we haven't already
-	 * bound this symbol to this target.  If we have, return.*/
-	while (*newptr != NULL)
+/* Check a joystick setting, opening the joystick if it names its axes.
+ * Returns a VControl_BindStatus. */
+static int
+check_setting (const VControl_BindingSpec *s)
+{
+	joystick *j;
+	if (s->port < 0 || s->port >= joycount)
+		return VCONTROL_BIND_BADPORT;
+	j = &joysticks[s->port];
+	switch (s->type)
 	{
-		if (((*newptr)->target == target) && ((*newptr)->keycode == keycode))
-		{
-			return;
-		}
-		newptr = &((*newptr)->next);
+	case VCONTROL_SPEC_JOYTHRESHOLD:
+		return VCONTROL_BIND_OK;
+	case VCONTROL_SPEC_JOYDEBOUNCE:
+		return (s->value >= 0) ? VCONTROL_BIND_OK : VCONTROL_BIND_BADINPUT;
+	case VCONTROL_SPEC_JOYAXISTHRESHOLD:
+		if (!(j->stick))
+			create_joystick (s->port);
+		if (s->index < 0 || s->index >= j->numaxes)
+			return VCONTROL_BIND_BADINPUT;
+		/* A negative press level goes back to the joystick threshold */
+		if (s->value >= 0 && (s->extra < 0 || s->extra > s->value))
+			return VCONTROL_BIND_BADINPUT;
+		return VCONTROL_BIND_OK;
+	case VCONTROL_SPEC_JOYDEADZONE:
+		if (!(j->stick))
+			create_joystick (s->port);
+		if (s->index < 0 || s->index >= j->numaxes || s->extra < 0 || s->extra >= j->numaxes ||
+		    s->index == s->extra || s->value < 0 || s->value > 32767)
+			return VCONTROL_BIND_BADINPUT;
+		return VCONTROL_BIND_OK;
 	}
+	return VCONTROL_BIND_BADTYPE;
+}
 
-	/* Now hunt through the binding pool for a free binding. */
-
-	/* First, find a chunk with free spots in it */
-
-	searchbase = pool;
-	while (searchbase->remaining == 0)
+static void
+unpair_axis (joystick *j, int n)
+{
+	joyaxis *a = &j->axes[n];
+	if (a->partner >= 0)
 	{
-		/* If we're completely full, allocate a new chunk */
-		if (searchbase->next == NULL)
-		{
-			searchbase->next = allocate_key_chunk ();
-		}
-		searchbase = searchbase->next;
+		j->axes[a->partner].partner = -1;
+		j->axes[a->partner].deadzone = 0;
 	}
+	a->partner = -1;
+	a->deadzone = 0;
+}
 
-	/* Now find a free binding within it */
-
-	newbinding = NULL;
-	for (i = 0; i < POOL_CHUNK_SIZE; i++)
+/* Make a setting that check_setting has passed */
+static void
+apply_setting (const VControl_BindingSpec *s)
+{
+	joystick *j = &joysticks[s->port];
+	int i;
+	switch (s->type)
 	{
-		if (searchbase->pool[i].target == NULL)
+	case VCONTROL_SPEC_JOYTHRESHOLD:
+		j->threshold = s->value;
+		break;
+	case VCONTROL_SPEC_JOYAXISTHRESHOLD:
+		j->axes[s->index].press = (s->value < 0) ? -1 : s->value;
+		j->axes[s->index].release = (s->value < 0) ? -1 : s->extra;
+		break;
+	case VCONTROL_SPEC_JOYDEADZONE:
+		unpair_axis (j, s->index);
+		unpair_axis (j, s->extra);
+		if (s->value)
 		{
-			newbinding = &searchbase->pool[i];
-			break;
+			j->axes[s->index].partner = s->extra;
+			j->axes[s->extra].partner = s->index;
+			j->axes[s->index].deadzone = j->axes[s->extra].deadzone = s->value;
+		}
+		break;
+	case VCONTROL_SPEC_JOYDEBOUNCE:
+		j->debounce = (Uint32)s->value;
+		/* Buttons locked out now are left where they were dispatched */
+		if (!j->debounce && j->bounces)
+		{
+			for (i = 0; i < j->numbuttons; i++)
+				wheel_cancel (&j->bounces[i].timer);
 		}
+		break;
 	}
+}
 
-	/* Sanity check. */
-	if (!newbinding)
+static int
+set_joystick (const VControl_BindingSpec *s)
+{
+	int status = check_setting (s);
+	if (status != VCONTROL_BIND_OK)
 	{
-		fprintf (stderr, "VControl_AddKeyBinding failed to find a free binding slot!\n");
-		return;
+		char buf[64];
+		VControl_FormatInput (buf, sizeof (buf), s);
+		if (status == VCONTROL_BIND_BADPORT)
+			fprintf (stderr, "VControl: Attempted to configure illegal port %d\n", s->port);
+		else
+			fprintf (stderr, "VControl: Illegal joystick setting '%s'\n", buf);
+		return -1;
 	}
+	apply_setting (s);
+	return 0;
+}
 
-	newbinding->target = target;
-	newbinding->keycode = keycode;
-	newbinding->next = NULL;
-	*newptr = newbinding;
-	searchbase->remaining--;
+int
+VControl_SetJoyAxisThreshold (int port, int axis, int press, int release)
+{
+	VControl_BindingSpec s;
+	memset (&s, 0, sizeof (s));
+	s.type = VCONTROL_SPEC_JOYAXISTHRESHOLD;
+	s.port = port;
+	s.index = axis;
+	s.value = press;
+	s.extra = release;
+	return set_joystick (&s);
 }
 
-static void
-remove_binding (keybinding **ptr, int *target, sdl_key_t keycode)
+int
+VControl_SetJoyStickDeadzone (int port, int xaxis, int yaxis, int radius)
 {
-	if (!(*ptr))
-	{
-		/* Nothing bound to symbol; return. */
-		return;
-	}
-	else if (((*ptr)->target == target) && ((*ptr)->keycode == keycode))
-	{
-		keybinding *todel = *ptr;
-		*ptr = todel->next;
-		todel->target = NULL;
-		todel->keycode = SDLK_UNKNOWN;
-		todel->next = NULL;
-		todel->parent->remaining++;
-	}
-	else
-	{
-		keybinding *prev = *ptr;
-		while (prev->next != NULL)
-		{
-			if (prev->next->target == target)
-			{
-				keybinding *todel = prev->next;
-				prev->next = todel->next;
-				todel->target = NULL;
-				todel->keycode = SDLK_UNKNOWN;
-				todel->next = NULL;
-				todel->parent->remaining++;
-			}
-		}
-	}
+	VControl_BindingSpec s;
+	memset (&s, 0, sizeof (s));
+	s.type = VCONTROL_SPEC_JOYDEADZONE;
+	s.port = port;
+	s.index = xaxis;
+	s.extra = yaxis;
+	s.value = radius;
+	return set_joystick (&s);
 }
 
-static void
-activate (keybinding *i, sdl_key_t keycode)
+int
+VControl_SetJoyDebounce (int port, int ms)
 {
-	while (i != NULL)
-	{
-		if (i->keycode == keycode) {
-			*(i->target) = *(i->target)+1;
-		}
-		i = i->next;
-	}
+	VControl_BindingSpec s;
+	memset (&s, 0, sizeof (s));
+	s.type = VCONTROL_SPEC_JOYDEBOUNCE;
+	s.port = port;
+	s.value = ms;
+	return set_joystick (&s);
 }
 
-static void
-deactivate (keybinding *i, sdl_key_t keycode)
+
+/* Fold a key code into its source ID, and back */
+static Uint32
+key_source (sdl_key_t symbol)
 {
-	while (i != NULL)
-	{
-		if ((i->keycode == keycode) && (*(i->target) > 0))
-		{
-			*(i->target) = *(i->target)-1;
-		}
-		i = i->next;
-	}
+	Uint32 code = (Uint32)symbol;
+	return SOURCE_KEY | (code & 0x07ffffffu) | ((code >> 3) & 0x08000000u);
 }
 
-int
-VControl_AddBinding (SDL_Event *e, int *target)
+static sdl_key_t
+source_key (Uint32 source)
 {
-	int result;
-	switch (e->type)
-	{
-	case SDL_KEYDOWN:
-		result = VControl_AddKeyBinding (e->key.keysym.sym, target);
-		break;
-	case SDL_JOYAXISMOTION:
-		result = VControl_AddJoyAxisBinding (e->jaxis.which, e->jaxis.axis, (e->jaxis.value < 0) ? -1 : 1, target);
-		break;
-	case SDL_JOYHATMOTION:
-		result = VControl_AddJoyHatBinding (e->jhat.which, e->jhat.hat, e->jhat.value, target);
-		break;
-	case SDL_JOYBUTTONDOWN:
-		result = VControl_AddJoyButtonBinding (e->jbutton.which, e->jbutton.button, target);
-		break;
-	default:
-		fprintf (stderr, "VControl_AddBinding didn't understand argument event\n");
-		result = -1;
-		break;
-	}
-	return result;
+	return (sdl_key_t)((source & 0x07ffffffu) | ((source & 0x08000000u) << 3));
 }
 
-void
-VControl_RemoveBinding (SDL_Event *e, int *target)
+/* The input number of a joystick source, and the source (with no
+ * direction bit) of input n */
+static int
+source_input (const joystick *j, Uint32 source)
 {
-	switch (e->type)
+	int n = (int)SOURCE_INDEX (source);
+	if (SOURCE_CLASS (source) == SOURCE_BUTTON)
+		return j->numaxes + n;
+	if (SOURCE_CLASS (source) == SOURCE_HAT)
+		return j->numaxes + j->numbuttons + n;
+	return n;
+}
+
+static Uint32
+joystick_source (const joystick *j, int port, int n)
+{
+	if (n < j->numaxes)
+		return JOY_SOURCE (SOURCE_AXIS, port, n, 0);
+	n -= j->numaxes;
+	if (n < j->numbuttons)
+		return JOY_SOURCE (SOURCE_BUTTON, port, n, 0);
+	return JOY_SOURCE (SOURCE_HAT, port, n - j->numbuttons, 0);
+}
+
+/* The physical input named by a source ID */
+static void
+source_spec (Uint32 source, VControl_BindingSpec *s)
+{
+	memset (s, 0, sizeof (*s));
+	switch (SOURCE_CLASS (source))
 	{
-	case SDL_KEYDOWN:
-		VControl_RemoveKeyBinding (e->key.keysym.sym, target);
-		break;
-	case SDL_JOYAXISMOTION:
-		VControl_RemoveJoyAxisBinding (e->jaxis.which, e->jaxis.axis, (e->jaxis.value < 0) ? -1 : 1, target);
-		break;
-	case SDL_JOYHATMOTION:
-		VControl_RemoveJoyHatBinding (e->jhat.which, e->jhat.hat, e->jhat.value, target);
+	case SOURCE_KEY:
+		s->type = VCONTROL_SPEC_KEY;
+		s->symbol = source_key (source);
+		return;
+	case SOURCE_SCANCODE:
+		s->type = VCONTROL_SPEC_SCANCODE;
+		s->index = source & 0xffff;
+		return;
+	case SOURCE_AXIS:
+		s->type = VCONTROL_SPEC_JOYAXIS;
+		s->value = (SOURCE_DIR (source) == AXIS_NEGATIVE) ? -1 : 1;
 		break;
-	case SDL_JOYBUTTONDOWN:
-		VControl_RemoveJoyButtonBinding (e->jbutton.which, e->jbutton.button, target);
+	case SOURCE_BUTTON:
+		s->type = VCONTROL_SPEC_JOYBUTTON;
 		break;
-	default:
-		fprintf (stderr, "VControl_RemoveBinding didn't understand argument event\n");
+	case SOURCE_HAT:
+		s->type = VCONTROL_SPEC_JOYHAT;
+		s->value = SOURCE_DIR (source);
 		break;
 	}
+	s->port = SOURCE_PORT (source);
+	s->index = SOURCE_INDEX (source);
 }
 
-int
-VControl_AddKeyBinding (sdl_key_t symbol, int *target)
+/* Which of an input's four chains a direction bit uses */
+static const Uint8 dir_slot[16] = { 0, 0, 1, 0, 2, 0, 0, 0, 3 };
+
+/* The chain of bindings for a valid source */
+static keybinding **
+source_chain (Uint32 source)
 {
-	add_binding(&bindings[symbol % KEYBOARD_INPUT_BUCKETS], target, symbol);
-	return 0;
+	joystick *j;
+	if (SOURCE_CLASS (source) == SOURCE_KEY)
+		return &bindings[source_key (source) % KEYBOARD_INPUT_BUCKETS];
+	if (SOURCE_CLASS (source) == SOURCE_SCANCODE)
+		return &scanbindings[source & 0xffff];
+	j = &joysticks[SOURCE_PORT (source)];
+	return &j->chains[source_input (j, source) * 4 + dir_slot[SOURCE_DIR (source)]];
 }
 
-void
-VControl_RemoveKeyBinding (sdl_key_t symbol, int *target)
+/* Bindings are added to and removed from the edit layer.  Chord
+ * inputs have targets of their own and serve every layer. */
+static int
+same_binding (keybinding *b, int *target, Uint32 source)
 {
-	remove_binding (&bindings[symbol % KEYBOARD_INPUT_BUCKETS], target, symbol);
+	return (b->target == target) && (b->source == source) && (b->chord || b->layer == edit_layer);
 }
 
-int
-VControl_AddJoyAxisBinding (int port, int axis, int polarity, int *target)
+static Uint32
+target_hash (int *target)
 {
-	if (port >= 0 && port < joycount)
+	Uint32 h = (Uint32)((size_t)target >> 2) * 2654435761u;
+	return h ^ (h >> 16);
+}
+
+static target_list *
+find_targets (int *target)
+{
+	Uint32 i;
+	if (!targets)
+		return NULL;
+	for (i = target_hash (target) & targetmask; targets[i].target; i = (i + 1) & targetmask)
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((axis >= 0) && (axis < j->numaxes))
-		{
-			if (polarity < 0)
-			{
-				add_binding(&joysticks[port].axes[axis].neg, target, SDLK_UNKNOWN);
-			}
-			else if (polarity > 0)
-			{
-				add_binding(&joysticks[port].axes[axis].pos, target, SDLK_UNKNOWN);
-			}
-			else
-			{
-				fprintf (stderr, "VControl: Attempted to bind to polarity zero\n");
-				return -1;
-			}
-		}
-		else
-		{
-			fprintf (stderr, "VControl: Attempted to bind to illegal axis %d\n", axis);
-			return -1;
-		}
-	}
-	else
-	{
-		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
-		return -1;
+		if (targets[i].target == target)
+			return &targets[i];
 	}
-	return 0;
+	return NULL;
 }
 
-void
-VControl_RemoveJoyAxisBinding (int port, int axis, int polarity, int *target)
+/* Make sure n more targets can be listed without the table growing
+ * past half full, so that listing a binding never allocates.  Returns
+ * 0 on success. */
+static int
+reserve_targets (int n)
 {
-	if (port >= 0 && port < joycount)
+	target_list *old = targets, *fresh;
+	int oldsize = old ? targetmask + 1 : 0;
+	int size = oldsize ? oldsize : 64, i;
+	while ((targetcount + n) * 2 > size)
+		size *= 2;
+	if (size == oldsize)
+		return 0;
+	fresh = vc_calloc (size, sizeof (target_list));
+	if (!fresh)
+		return -1;
+	for (i = 0; i < oldsize; i++)
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((axis >= 0) && (axis < j->numaxes))
-		{
-			if (polarity < 0)
-			{
-				remove_binding(&joysticks[port].axes[axis].neg, target, SDLK_UNKNOWN);
-			}
-			else if (polarity > 0)
-			{
-				remove_binding(&joysticks[port].axes[axis].pos, target, SDLK_UNKNOWN);
-			}
-			else
-			{
-				fprintf (stderr, "VControl: Attempted to unbind from polarity zero\n");
-			}
-		}
-		else
+		if (old[i].target)
 		{
-			fprintf (stderr, "VControl: Attempted to unbind from illegal axis %d\n", axis);
+			Uint32 j = target_hash (old[i].target) & (size - 1);
+			while (fresh[j].target)
+				j = (j + 1) & (size - 1);
+			fresh[j] = old[i];
 		}
 	}
-	else
+	/* SaveState and RestoreState read the table under the listener's
+	 * lock, maybe on another thread */
+	lock_dispatch ();
+	targets = fresh;
+	targetmask = size - 1;
+	unlock_dispatch ();
+	vc_free (old);
+	return 0;
+}
+
+/* The size of the hash table ApplyBindings checks n specs with */
+static size_t
+pending_table_size (size_t n)
+{
+	size_t size = 16;
+	while (size < n * 2)
+		size *= 2;
+	return size;
+}
+
+/* Make room for a batch of n specs in ApplyBindings' scratch space */
+static int
+reserve_scratch (size_t n)
+{
+	pending *p;
+	size_t *table;
+	if (n <= scratchspace)
+		return 0;
+	p = vc_malloc (sizeof (pending) * n);
+	table = vc_malloc (sizeof (size_t) * pending_table_size (n));
+	if (!p || !table)
 	{
-		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+		vc_free (p);
+		vc_free (table);
+		return -1;
 	}
+	vc_free (scratch);
+	vc_free (scratchtable);
+	scratch = p;
+	scratchtable = table;
+	scratchspace = n;
+	return 0;
 }
 
-int
-VControl_AddJoyButtonBinding (int port, int button, int *target)
+/* Make sure the pool has at least needed free slots.  The new chunks
+ * are only added once all of them have been allocated. */
+static int
+reserve_slots (size_t needed)
 {
-	if (port >= 0 && port < joycount)
+	keypool *last = pool, *fresh = NULL, **tail = &fresh;
+	size_t free_slots = last->remaining;
+	while (last->next != NULL)
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((button >= 0) && (button < j->numbuttons))
-		{
-			add_binding(&joysticks[port].buttons[button], target, SDLK_UNKNOWN);
-		}
-		else
+		last = last->next;
+		free_slots += last->remaining;
+	}
+	while (free_slots < needed)
+	{
+		*tail = allocate_key_chunk ();
+		if (!*tail)
 		{
-			fprintf (stderr, "VControl: Attempted to bind to illegal button %d\n", button);
+			free_key_pool (fresh);
 			return -1;
 		}
+		free_slots += POOL_CHUNK_SIZE;
+		tail = &((*tail)->next);
 	}
-	else
-	{
-		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
+	last->next = fresh;
+	return 0;
+}
+
+/* Make room for count chords in all */
+static int
+reserve_chords (int count)
+{
+	int newspace = chordspace ? chordspace : 16;
+	chord *newchords;
+	if (count <= chordspace)
+		return 0;
+	while (newspace < count)
+		newspace *= 2;
+	newchords = vc_realloc (chords, sizeof (chord) * newspace);
+	if (!newchords)
 		return -1;
-	}
+	chords = newchords;
+	chordspace = newspace;
 	return 0;
 }
 
-void
-VControl_RemoveJoyButtonBinding (int port, int button, int *target)
+/* Make room for count timed bindings in all, with the entries for
+ * them allocated as spares */
+static int
+reserve_timed (int count)
 {
-	if (port >= 0 && port < joycount)
+	if (count > timedspace)
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((button >= 0) && (button < j->numbuttons))
-		{
-			remove_binding (&joysticks[port].buttons[button], target, SDLK_UNKNOWN);
-		}
-		else
-		{
-			fprintf (stderr, "VControl: Attempted to unbind from illegal button %d\n", button);
-		}
+		int newspace = timedspace ? timedspace : 16;
+		timed **newtimeds;
+		while (newspace < count)
+			newspace *= 2;
+		newtimeds = vc_realloc (timeds, sizeof (timed *) * newspace);
+		if (!newtimeds)
+			return -1;
+		timeds = newtimeds;
+		timedspace = newspace;
 	}
-	else
+	if (count > sparespace)
 	{
-		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+		timed **newspares = vc_realloc (spares, sizeof (timed *) * count);
+		if (!newspares)
+			return -1;
+		spares = newspares;
+		sparespace = count;
 	}
-}
-
-int
-VControl_AddJoyHatBinding (int port, int which, Uint8 dir, int *target)
-{
-	if (port >= 0 && port < joycount)
+	while (sparecount < count)
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((which >= 0) && (which < j->numhats))
-		{
-			if (dir == SDL_HAT_LEFT)
-			{
-				add_binding(&joysticks[port].hats[which].left, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_RIGHT)
-			{
-				add_binding(&joysticks[port].hats[which].right, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_UP)
-			{
-				add_binding(&joysticks[port].hats[which].up, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_DOWN)
-			{
-				add_binding(&joysticks[port].hats[which].down, target, SDLK_UNKNOWN);
-			}
-			else
-			{
-				fprintf (stderr, "VControl: Attempted to bind to illegal direction\n");
-				return -1;
-			}
-		}
-		else
-		{
-			fprintf (stderr, "VControl: Attempted to bind to illegal hat %d\n", which);
+		spares[sparecount] = vc_malloc (sizeof (timed));
+		if (!spares[sparecount])
 			return -1;
-		}
+		sparecount++;
 	}
+	return 0;
+}
+
+/* Put a timed entry that is done with back among the spares, or free
+ * it if there is no room for it there */
+static void
+spare_timed (timed *t)
+{
+	if (sparecount < sparespace)
+		spares[sparecount++] = t;
 	else
+		vc_free (t);
+}
+
+/* The target b is listed under, or NULL if it isn't listed */
+static int *
+index_key (keybinding *b)
+{
+	if (b->chord)
+		return NULL;
+	return b->timed ? timeds[b->timed - 1]->target : b->target;
+}
+
+/* Add b to the end of its target's list.  reserve_targets must have
+ * made room for a new target. */
+static void
+index_add (keybinding *b)
+{
+	int *key = index_key (b);
+	target_list *list;
+	keybinding **tail;
+	if (!key)
+		return;
+	list = find_targets (key);
+	if (!list)
 	{
-		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
-		return -1;
+		Uint32 i = target_hash (key) & targetmask;
+		while (targets[i].target)
+			i = (i + 1) & targetmask;
+		list = &targets[i];
+		list->target = key;
+		list->head = NULL;
+		targetcount++;
 	}
-	return 0;
+	for (tail = &list->head; *tail != NULL; tail = &((*tail)->tnext))
+		;
+	b->tnext = NULL;
+	*tail = b;
 }
 
-void
-VControl_RemoveJoyHatBinding (int port, int which, Uint8 dir, int *target)
+static void
+index_remove (keybinding *b)
 {
-	if (port >= 0 && port < joycount)
+	target_list *list = find_targets (index_key (b));
+	keybinding **ptr;
+	Uint32 i, j;
+	if (!list)
+		return;
+	for (ptr = &list->head; *ptr != NULL; ptr = &((*ptr)->tnext))
 	{
-		joystick *j = &joysticks[port];
-		if (!(j->stick))
-			create_joystick (port);
-		if ((which >= 0) && (which < j->numhats))
-		{
-			if (dir == SDL_HAT_LEFT)
-			{
-				remove_binding(&joysticks[port].hats[which].left, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_RIGHT)
-			{
-				remove_binding(&joysticks[port].hats[which].right, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_UP)
-			{
-				remove_binding(&joysticks[port].hats[which].up, target, SDLK_UNKNOWN);
-			}
-			else if (dir == SDL_HAT_DOWN)
-			{
-				remove_binding(&joysticks[port].hats[which].down, target, SDLK_UNKNOWN);
-			}
-			else
-			{
-				fprintf (stderr, "VControl: Attempted to unbind from illegal direction\n");
-			}
-		}
-		else
+		if (*ptr == b)
 		{
-			fprintf (stderr, "VControl: Attempted to unbind from illegal hat %d\n", which);
+			*ptr = b->tnext;
+			b->tnext = NULL;
+			break;
 		}
 	}
-	else
+	if (list->head)
+		return;
+
+	/* The target has no bindings left; delete its slot, moving back
+	 * any later entry of the probe run that could no longer be found */
+	i = (Uint32)(list - targets);
+	targets[i].target = NULL;
+	targetcount--;
+	for (j = (i + 1) & targetmask; targets[j].target; j = (j + 1) & targetmask)
 	{
-		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+		Uint32 k = target_hash (targets[j].target) & targetmask;
+		if ((j > i) ? (k <= i || k > j) : (k <= i && k > j))
+		{
+			targets[i] = targets[j];
+			targets[j].target = NULL;
+			targets[j].head = NULL;
+			i = j;
+		}
 	}
 }
 
-void
-VControl_RemoveAllBindings ()
+/* The index is edited under the listener's lock, since bindings may
+ * be changed from the rebinding thread while SaveState or
+ * RestoreState reads it */
+static void
+index_binding (keybinding *b)
 {
-	key_uninit ();
-	key_init ();
+	lock_dispatch ();
+	index_add (b);
+	unlock_dispatch ();
 }
 
-void
-VControl_ProcessKeyDown (sdl_key_t symbol)
+static void
+unindex_binding (keybinding *b)
 {
-	activate (bindings[symbol % KEYBOARD_INPUT_BUCKETS], symbol);
+	lock_dispatch ();
+	index_remove (b);
+	unlock_dispatch ();
 }
 
-void
-VControl_ProcessKeyUp (sdl_key_t symbol)
+/* Fill in the free slot b and store it at the end of a chain, in
+ * *tail. */
+static void
+link_binding (keybinding **tail, keybinding *b, int *target, Uint32 source)
 {
-	deactivate (bindings[symbol % KEYBOARD_INPUT_BUCKETS], symbol);
+	b->target = target;
+	b->source = source;
+	b->chord = 0;
+	b->timed = 0;
+	b->action = VControl_target2action (target);
+	b->layer = edit_layer;
+	b->next = NULL;
+	rcu_assign (*tail, b);
+	chain_stats_valid = 0;
+	index_binding (b);
+	b->parent->remaining--;
 }
 
-void
-VControl_ProcessJoyButtonDown (int port, int button)
+/* A removed binding's slot goes back to the pool once no reader can
+ * still be looking at it */
+static void
+free_binding (rcu_head *h)
 {
-	if (!joysticks[port].stick)
-		return;
-	activate (joysticks[port].buttons[button], SDLK_UNKNOWN);
+	keybinding *b = (keybinding *)((char *)h - offsetof (keybinding, rcu));
+	b->target = NULL;
+	b->source = 0;
+	b->chord = 0;
+	b->timed = 0;
+	b->next = NULL;
+	b->parent->remaining++;
 }
 
-void
-VControl_ProcessJoyButtonUp (int port, int button)
+static keybinding *
+add_binding (Uint32 source, int *target)
 {
-	if (!joysticks[port].stick)
-		return;
-	deactivate (joysticks[port].buttons[button], SDLK_UNKNOWN);
-}
+	keybinding **newptr = source_chain (source);
+	keybinding *newbinding;
+	keypool *searchbase;
+	int i;
 
-void
-VControl_ProcessJoyAxis (int port, int axis, int value)
-{
-	int t;
-	if (!joysticks[port].stick)
-		return;
-	t = joysticks[port].threshold;
-	if (value > t)
+	/* Acquire a pointer to the keybinding * that we'll be
+	 * overwriting.  Along the way, ensure we haven't already
+	 * bound this symbol to this target.  If we have, return.*/
+	while (*newptr != NULL)
 	{
-		if (joysticks[port].axes[axis].polarity != 1)
+		if (same_binding (*newptr, target, source))
 		{
-			if (joysticks[port].axes[axis].polarity == -1)
-			{
-				deactivate (joysticks[port].axes[axis].neg, SDLK_UNKNOWN);
-			}
-			joysticks[port].axes[axis].polarity = 1;
-			activate (joysticks[port].axes[axis].pos, SDLK_UNKNOWN);
+			return *newptr;
 		}
+		newptr = &((*newptr)->next);
 	}
-	else if (value < -t)
+
+	/* Now hunt through the binding pool for a free binding,
+	 * after taking back any that readers are done with. */
+	rcu_collect (free_binding);
+
+	/* First, find a chunk with free spots in it */
+
+	searchbase = pool;
+	while (searchbase->remaining == 0)
 	{
-		if (joysticks[port].axes[axis].polarity != -1)
+		/* If we're completely full, allocate a new chunk */
+		if (searchbase->next == NULL)
 		{
-			if (joysticks[port].axes[axis].polarity == 1)
+			keypool *chunk = allocate_key_chunk ();
+			if (!chunk)
 			{
-				deactivate (joysticks[port].axes[axis].pos, SDLK_UNKNOWN);
+				fprintf (stderr, "VControl: Out of memory adding binding\n");
+				return NULL;
 			}
-			joysticks[port].axes[axis].polarity = -1;
-			activate (joysticks[port].axes[axis].neg, SDLK_UNKNOWN);
+			searchbase->next = chunk;
 		}
+		searchbase = searchbase->next;
 	}
-	else
+
+	/* Now find a free binding within it */
+
+	newbinding = NULL;
+	for (i = 0; i < POOL_CHUNK_SIZE; i++)
 	{
-		if (joysticks[port].axes[axis].polarity == -1)
+		if (searchbase->pool[i].target == NULL)
 		{
-			deactivate (joysticks[port].axes[axis].neg, SDLK_UNKNOWN);
+			newbinding = &searchbase->pool[i];
+			break;
 		}
-		else if (joysticks[port].axes[axis].polarity == 1)
+	}
+
+	/* Sanity check. */
+	if (!newbinding)
+	{
+		fprintf (stderr, "VControl_AddKeyBinding failed to find a free binding slot!\n");
+		return NULL;
+	}
+
+	if (reserve_targets (1))
+	{
+		fprintf (stderr, "VControl: Out of memory adding binding\n");
+		return NULL;
+	}
+	link_binding (newptr, newbinding, target, source);
+	return newbinding;
+}
+
+/* Chains are read without a lock, so a binding is unlinked with one
+ * store and otherwise left alone: a reader standing on it still finds
+ * the rest of the chain through its next. */
+static void
+remove_binding (Uint32 source, int *target)
+{
+	keybinding **ptr = source_chain (source);
+	chain_stats_valid = 0;
+	for (; *ptr != NULL; ptr = &((*ptr)->next))
+	{
+		if (same_binding (*ptr, target, source))
 		{
-			deactivate (joysticks[port].axes[axis].pos, SDLK_UNKNOWN);
+			keybinding *todel = *ptr;
+			rcu_assign (*ptr, todel->next);
+			unindex_binding (todel);
+			rcu_retire (&todel->rcu);
+			rcu_collect (free_binding);
+			return;
 		}
-		joysticks[port].axes[axis].polarity = 0;
 	}
 }
 
-void
-VControl_ProcessJoyHat (int port, int which, Uint8 value)
+static Uint32
+current_time (void)
 {
-	Uint8 old;
-	if (!joysticks[port].stick)
-		return;
-	old = joysticks[port].hats[which].last;
-	if (!(old & SDL_HAT_LEFT) && (value & SDL_HAT_LEFT))
-		activate (joysticks[port].hats[which].left, SDLK_UNKNOWN);
-	if (!(old & SDL_HAT_RIGHT) && (value & SDL_HAT_RIGHT))
-		activate (joysticks[port].hats[which].right, SDLK_UNKNOWN);
-	if (!(old & SDL_HAT_UP) && (value & SDL_HAT_UP))
-		activate (joysticks[port].hats[which].up, SDLK_UNKNOWN);
-	if (!(old & SDL_HAT_DOWN) && (value & SDL_HAT_DOWN))
-		activate (joysticks[port].hats[which].down, SDLK_UNKNOWN);
-	if ((old & SDL_HAT_LEFT) && !(value & SDL_HAT_LEFT))
-		deactivate (joysticks[port].hats[which].left, SDLK_UNKNOWN);
-	if ((old & SDL_HAT_RIGHT) && !(value & SDL_HAT_RIGHT))
-		deactivate (joysticks[port].hats[which].right, SDLK_UNKNOWN);
-	if ((old & SDL_HAT_UP) && !(value & SDL_HAT_UP))
-		deactivate (joysticks[port].hats[which].up, SDLK_UNKNOWN);
-	if ((old & SDL_HAT_DOWN) && !(value & SDL_HAT_DOWN))
-		deactivate (joysticks[port].hats[which].down, SDLK_UNKNOWN);
-	joysticks[port].hats[which].last = value;
+	return have_event_time ? event_time : SDL_GetTicks ();
 }
 
-void
-VControl_ResetInput ()
+/* Called when a named control goes from released to pressed */
+static void
+pressed (int action)
 {
-	/* Step through every valid entry in the binding pool and zero
-	 * them out.  This will probably zero entries multiple times;
-	 * oh well, no harm done. */
-
-	keypool *base = pool;
-	while (base != NULL)
+	Uint32 now = current_time ();
+	if (action < timecount)
 	{
-		int i;
-		for (i = 0; i < POOL_CHUNK_SIZE; i++)
-		{
-			if(base->pool[i].target)
-			{
-				*(base->pool[i].target) = 0;
-			}
-		}
-		base = base->next;
+		press_time[action] = now;
+		press_count[action]++;
 	}
+	combo_press (action, now);
+	if (transition_hook)
+		transition_hook (transition_data, action, 1);
 }
 
-void
-VControl_HandleEvent (SDL_Event *e)
+/* ... and from pressed to released */
+static void
+released (int action)
 {
-	switch (e->type)
+	if (action < timecount)
 	{
-		case SDL_KEYDOWN:
-#if SDL_MAJOR_VERSION > 1
-			if (!e->key.repeat)
-#endif
-			{
-				VControl_ProcessKeyDown (e->key.keysym.sym);
-			}
-			break;
-		case SDL_KEYUP:
-			VControl_ProcessKeyUp (e->key.keysym.sym);
-			break;
-		case SDL_JOYAXISMOTION:
-			VControl_ProcessJoyAxis (e->jaxis.which, e->jaxis.axis, e->jaxis.value);
-			break;
-		case SDL_JOYHATMOTION:
-			VControl_ProcessJoyHat (e->jhat.which, e->jhat.hat, e->jhat.value);
-			break;
-		case SDL_JOYBUTTONDOWN:
-			VControl_ProcessJoyButtonDown (e->jbutton.which, e->jbutton.button);
-			break;
-		case SDL_JOYBUTTONUP:
-			VControl_ProcessJoyButtonUp (e->jbutton.which, e->jbutton.button);
-			break;
-		default:
-			break;
+		release_time[action] = current_time ();
 	}
+	if (transition_hook)
+		transition_hook (transition_data, action, 0);
 }
 
-void
-VControl_RegisterNameTable (VControl_NameBinding *table)
+/* Report a newly pressed input to the input hook */
+static void
+report_input (Uint32 source)
 {
-	nametable = table;
+	VControl_BindingSpec s;
+	source_spec (source, &s);
+	input_hook (input_data, &s);
 }
 
-static char *
-target2name (int *target)
+/* Move a target that is driven by a chord or timed binding rather
+ * than directly by an input */
+static void
+signal_target (int *target, int action, int on)
 {
-	VControl_NameBinding *b = nametable;
-	while (b->target)
+	if (on)
 	{
-		if (target == b->target)
-		{
-			return b->name;
-		}
-		++b;
+		*target = *target+1;
+	}
+	else if (*target > 0)
+	{
+		*target = *target-1;
+	}
+	else
+	{
+		return;
+	}
+	TRACE_TRANSITION (target, *target, action);
+	if (action >= 0)
+	{
+		publish_value (action, *target);
+		if (on && *target == 1)
+			pressed (action);
+		else if (!on && *target == 0)
+			released (action);
 	}
-	return NULL;
 }
 
-static int *
-name2target (char *name)
+/* Re-evaluate every chord.  A chord matches when its layer is on
+ * the stack and none of the bits in its mask are missing from the
+ * held set, which takes CHORD_WORDS and/compare steps per chord. */
+static void
+update_chords (void)
 {
-	VControl_NameBinding *b = nametable;
-	while (b->target)
+	int i, w;
+	for (i = 0; i < chordcount; i++)
 	{
-		if (!strcasecmp (name, b->name))
+		chord *c = &chords[i];
+		Uint32 missing = 0;
+		for (w = 0; w < CHORD_WORDS; w++)
 		{
-			return b->target;
+			missing |= c->mask[w] & ~chord_held[w];
+		}
+		if (!(stack.live & LAYER_BIT (c->layer)))
+		{
+			missing = 1;
+		}
+		if (!missing && !c->active)
+		{
+			c->active = 1;
+			signal_target (c->target, c->action, 1);
+		}
+		else if (missing && c->active)
+		{
+			c->active = 0;
+			signal_target (c->target, c->action, 0);
 		}
-		++b;
 	}
-	return NULL;
 }
 
+/* Chord input n has changed */
 static void
-dump_keybindings (FILE *out, keybinding *kb, char *name)
+update_chord_input (int n)
 {
-	char namebuffer[64];
-	while (kb != NULL)
+	if (chord_inputs[n].count > 0)
+		chord_held[n / 32] |= (Uint32)1 << (n % 32);
+	else
+		chord_held[n / 32] &= ~((Uint32)1 << (n % 32));
+	update_chords ();
+}
+
+static void
+timed_signal (timed *t, int on)
+{
+	if (t->on != on)
 	{
-		char *targetname = target2name (kb->target);
-		if (kb->keycode == SDLK_UNKNOWN) {
-			fprintf (out, "%s: %s\n", targetname, name);
-		} else {
-			sprintf (namebuffer, "key %s", VControl_code2name (kb->keycode));
-			fprintf (out, "%s: %s\n", targetname, namebuffer);
-		}
-		kb = kb->next;
+		t->on = on;
+		signal_target (t->target, t->action, on);
 	}
 }
 
-void
-VControl_Dump (FILE *out)
+/* Half a turbo cycle, in milliseconds */
+static Uint32
+turbo_phase (const timed *t)
 {
-	int i;
-	char namebuffer[64];
+	Uint32 phase = 500 / t->input.period;
+	return phase ? phase : 1;
+}
 
-	/* Print out keyboard bindings */
-	for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
+/* The input of timed binding n has been pressed or released */
+static void
+timed_input (int n)
+{
+	timed *t = timeds[n];
+	Uint32 now = current_time ();
+	if (t->count > 0)
 	{
-		keybinding *kb = bindings[i];		
-		if (kb != NULL)
+		switch (t->input.modifier)
 		{
-			dump_keybindings (out, kb, "<Unknown key>");
+		case VCONTROL_MODIFIER_HOLD:
+			wheel_add (&t->timer, now + t->input.period, now);
+			break;
+		case VCONTROL_MODIFIER_TAP:
+			t->pressed_at = now;
+			break;
+		case VCONTROL_MODIFIER_TURBO:
+			timed_signal (t, 1);
+			wheel_add (&t->timer, now + turbo_phase (t), now);
+			break;
 		}
 	}
-
-	/* Print out joystick bindings */
-	for (i = 0; i < joycount; i++)
+	else if (t->input.modifier == VCONTROL_MODIFIER_TAP)
 	{
-		if (joysticks[i].stick)
+		/* A tap is signalled until the next tick */
+		if (!t->on && now - t->pressed_at <= (Uint32)t->input.period)
 		{
-			int j;
-
-			fprintf (out, "joystick %d threshold %d\n", i, joysticks[i].threshold);
-			for (j = 0; j < joysticks[i].numaxes; j++)
-			{
-				sprintf (namebuffer, "joystick %d axis %d negative", i, j);
-				dump_keybindings (out, joysticks[i].axes[j].neg, namebuffer);
-				sprintf (namebuffer, "joystick %d axis %d positive", i, j);
-				dump_keybindings (out, joysticks[i].axes[j].pos, namebuffer);
-			}
-			for (j = 0; j < joysticks[i].numbuttons; j++)
-			{
-				keybinding *kb = joysticks[i].buttons[j];
-				if (kb != NULL)
-				{
-					sprintf (namebuffer, "joystick %d button %d", i, j);
-					dump_keybindings (out, kb, namebuffer);
-				}
-			}
-			for (j = 0; j < joysticks[i].numhats; j++)
-			{
-				sprintf (namebuffer, "joystick %d hat %d left", i, j);
-				dump_keybindings (out, joysticks[i].hats[j].left, namebuffer);
-				sprintf (namebuffer, "joystick %d hat %d right", i, j);
-				dump_keybindings (out, joysticks[i].hats[j].right, namebuffer);
-				sprintf (namebuffer, "joystick %d hat %d up", i, j);
-				dump_keybindings (out, joysticks[i].hats[j].up, namebuffer);
-				sprintf (namebuffer, "joystick %d hat %d down", i, j);
-				dump_keybindings (out, joysticks[i].hats[j].down, namebuffer);
-			}
+			timed_signal (t, 1);
+			wheel_add (&t->timer, now, now);
 		}
 	}
+	else
+	{
+		wheel_cancel (&t->timer);
+		timed_signal (t, 0);
+	}
+}
 
-#ifdef VCONTROL_DEBUG
-	/* Print out allocation data */
+static void
+timed_expire (wheel_timer *w)
+{
+	timed *t = (timed *)w;
+	event_time = w->deadline;
+	switch (t->input.modifier)
 	{
-		keypool bp = pool;
-		i = 0;
-		while (bp != NULL)
+	case VCONTROL_MODIFIER_HOLD:
+		timed_signal (t, 1);
+		break;
+	case VCONTROL_MODIFIER_TAP:
+		timed_signal (t, 0);
+		break;
+	case VCONTROL_MODIFIER_TURBO:
+		timed_signal (t, !t->on);
+		wheel_add (&t->timer, w->deadline + turbo_phase (t), w->deadline);
+		break;
+	}
+}
+
+static void
+press_binding (keybinding *i)
+{
+	*(i->target) = *(i->target)+1;
+	if (i->chord)
+	{
+		update_chord_input (i->chord - 1);
+	}
+	else if (i->timed)
+	{
+		timed_input (i->timed - 1);
+	}
+	else
+	{
+		TRACE_TRANSITION (i->target, *(i->target), i->action);
+		if (i->action >= 0)
 		{
-			fprintf (out, "# Internal Debug: Chunk #%i: %d slots remaining.\n", i, bp->remaining);
-			i++;
-			bp = bp->next;
+			publish_value (i->action, *(i->target));
+			if (*(i->target) == 1)
+				pressed (i->action);
 		}
-		fprintf (out, "# Internal Debug: %d chunks allocated.\n", i);
 	}
-#endif
 }
 
-/* Configuration file grammar is as follows:  One command per line, 
- * hashes introduce comments that persist to end of line.  Blank lines
- * are ignored.
- *
- * Terminals are represented here as quoted strings, e.g. "foo" for 
- * the literal string foo.  These are matched case-insensitively.
- * Special terminals are:
- *
- * KEYNAME:  This names a key, as defined in keynames.c.
- * IDNAME:   This is an arbitrary string of alphanumerics, 
- *           case-insensitive, and ending with a colon.  This
- *           names an application-specific control value.
- * NUM:      This is an unsigned integer.
- * EOF:      End of file
- *
- * Nonterminals (the grammar itself) have the following productions:
- * 
- * configline <- IDNAME binding
- *             | "joystick" NUM "threshold" NUM
- *
- * binding    <- "key" KEYNAME
- *             | "joystick" NUM joybinding
- *
- * joybinding <- "axis" NUM polarity
- *             | "button" NUM
- *             | "hat" NUM direction
- *
- * polarity   <- "positive" | "negative"
- *
- * dir        <- "up" | "down" | "left" | "right"
- *
- * This grammar is amenable to simple recursive descent parsing;
- * in fact, it's fully LL(1). */
-
-/* Actual maximum line and token sizes are two less than this, since
- * we need space for the \n\0 at the end */
-#define LINE_SIZE 256
-#define TOKEN_SIZE 64
-
-typedef struct vcontrol_parse_state_s {
-	char line[LINE_SIZE];
-	char token[TOKEN_SIZE];
-	int index;
-	int error;
-	int linenum;
-} parse_state;
-
 static void
-next_token (parse_state *state)
+release_binding (keybinding *i)
 {
-	int index, base;
-
-	state->token[0] = 0;
-	/* skip preceding whitespace */
-	base = state->index;
-	while (state->line[base] && isspace (state->line[base]))
+	if (*(i->target) > 0)
 	{
-		base++;
+		*(i->target) = *(i->target)-1;
+		if (i->chord)
+		{
+			update_chord_input (i->chord - 1);
+		}
+		else if (i->timed)
+		{
+			timed_input (i->timed - 1);
+		}
+		else
+		{
+			TRACE_TRANSITION (i->target, *(i->target), i->action);
+			if (i->action >= 0)
+			{
+				publish_value (i->action, *(i->target));
+				if (*(i->target) == 0)
+					released (i->action);
+			}
+		}
 	}
+}
 
-	index = 0;
-	while (index < (TOKEN_SIZE-1) && state->line[base+index] && !isspace (state->line[base+index]))
+/* The layers whose bindings for source in chain see the input when
+ * the stack is s.  Unless a consuming layer has one of the bindings,
+ * that is every layer on the stack; otherwise it is the layers from
+ * the top down to the highest such. */
+static Uint32
+visible_layers (const layer_stack *s, keybinding *chain, Uint32 source)
+{
+	Uint32 present = 0, result = 0;
+	int d;
+	if (!s->consume)
+		return s->live;
+	for (; chain != NULL; chain = rcu_deref (chain->next))
 	{
-		state->token[index] = state->line[base+index];
-		index++;
+		if (chain->source == source && !chain->chord)
+			present |= LAYER_BIT (chain->layer);
 	}
-	state->token[index] = 0;
+	if (!(present & s->consume))
+		return s->live;
+	for (d = s->depth - 1; d >= 0; d--)
+	{
+		Uint32 bit = LAYER_BIT (s->layer[d]);
+		result |= bit;
+		if (present & s->consume & bit)
+			break;
+	}
+	return result;
+}
 
-	/* If the token was too long, skip ahead until we get to whitespace */
-	while (state->line[base+index] && !isspace (state->line[base+index]))
+/* Walking a chain is a read-side section, so that nothing unlinked
+ * from it meanwhile is reused until the walk is over */
+static void
+activate (keybinding **chain, Uint32 source)
+{
+	int epoch = rcu_read_lock ();
+	keybinding *i = rcu_deref (*chain);
+	Uint32 live = visible_layers (&stack, i, source);
+	while (i != NULL)
 	{
-		index++;
+		if ((i->source == source) && (i->chord || (live & LAYER_BIT (i->layer))))
+			press_binding (i);
+		i = rcu_deref (i->next);
 	}
+	rcu_read_unlock (epoch);
+}
 
-	state->index = base+index;
+static void
+deactivate (keybinding **chain, Uint32 source)
+{
+	int epoch = rcu_read_lock ();
+	keybinding *i = rcu_deref (*chain);
+	Uint32 live = visible_layers (&stack, i, source);
+	while (i != NULL)
+	{
+		if ((i->source == source) && (i->chord || (live & LAYER_BIT (i->layer))))
+			release_binding (i);
+		i = rcu_deref (i->next);
+	}
+	rcu_read_unlock (epoch);
 }
 
+/* The stack has changed from old while this input is held.  Bindings
+ * that have come into view are pressed before those that have gone
+ * are released, so a control bound in both layers stays held. */
 static void
-next_line (parse_state *state, FILE *in)
+carry_over (keybinding **head, Uint32 source, const layer_stack *old)
 {
-	int i, ch;
-	int comment = 0;
-	state->linenum++;
-	for (i = 0; i < LINE_SIZE-1; i++)
+	int epoch = rcu_read_lock ();
+	keybinding *chain = rcu_deref (*head), *i;
+	Uint32 before = visible_layers (old, chain, source);
+	Uint32 after = visible_layers (&stack, chain, source);
+	if (before != after)
 	{
-		if (feof (in))
+		for (i = chain; i != NULL; i = rcu_deref (i->next))
 		{
-			break;
+			if ((i->source == source) && !i->chord && (after & ~before & LAYER_BIT (i->layer)))
+				press_binding (i);
 		}
-		ch = fgetc (in);
-		if (ch == '#' || ch == '\n' || ch == -1)
+		for (i = chain; i != NULL; i = rcu_deref (i->next))
 		{
-			/* If this line is blank or all commented, include some
-			 * whitespace.  This lets us detect EOF as a completely
-			 * blank line. */
-			if (i==0) 
+			if ((i->source == source) && !i->chord && (before & ~after & LAYER_BIT (i->layer)))
+				release_binding (i);
+		}
+	}
+	rcu_read_unlock (epoch);
+}
+
+static void
+carry_over_all (const layer_stack *old)
+{
+	int i, n, d;
+	for (i = 0; i < heldkeycount; i++)
+	{
+		Uint32 source = key_source (heldkeys[i]);
+		carry_over (source_chain (source), source, old);
+	}
+	for (i = 0; i < SCANCODE_INPUTS; i++)
+	{
+		if (scanheld[i / 32] & ((Uint32)1 << (i % 32)))
+			carry_over (&scanbindings[i], SOURCE_SCANCODE | i, old);
+	}
+	for (i = 0; i < joycount; i++)
+	{
+		joystick *x = &joysticks[i];
+		int inputs = x->numaxes + x->numbuttons + x->numhats;
+		if (!x->stick)
+			continue;
+		for (n = 0; n < inputs; n++)
+		{
+			for (d = 0; d < 4; d++)
+			{
+				if (x->state[n] & (1 << d))
+					carry_over (&x->chains[n * 4 + d], joystick_source (x, i, n) | (1u << d), old);
+			}
+		}
+	}
+	update_chords ();
+}
+
+/* Edges between two sets of held direction bits: edges[old][now] has
+ * the bits pressed in its low four bits and the bits released in its
+ * high four.  Axes use the states 0, AXIS_NEGATIVE and AXIS_POSITIVE,
+ * buttons 0 and 1, and hats their SDL_HAT_* value, so the one table
+ * serves every joystick input. */
+#define EDGE(o, n) (((n) & ~(o)) | (((o) & ~(n)) << 4))
+#define EDGE_ROW(o) { \
+	EDGE (o, 0), EDGE (o, 1), EDGE (o, 2), EDGE (o, 3), \
+	EDGE (o, 4), EDGE (o, 5), EDGE (o, 6), EDGE (o, 7), \
+	EDGE (o, 8), EDGE (o, 9), EDGE (o, 10), EDGE (o, 11), \
+	EDGE (o, 12), EDGE (o, 13), EDGE (o, 14), EDGE (o, 15) }
+static const Uint8 edges[16][16] = {
+	EDGE_ROW (0), EDGE_ROW (1), EDGE_ROW (2), EDGE_ROW (3),
+	EDGE_ROW (4), EDGE_ROW (5), EDGE_ROW (6), EDGE_ROW (7),
+	EDGE_ROW (8), EDGE_ROW (9), EDGE_ROW (10), EDGE_ROW (11),
+	EDGE_ROW (12), EDGE_ROW (13), EDGE_ROW (14), EDGE_ROW (15)
+};
+#undef EDGE_ROW
+#undef EDGE
+
+/* The joystick input of source (whose direction bit is ignored) now
+ * holds the direction bits in now.  Presses are handled before
+ * releases, so a control bound to both the old and new direction
+ * stays held. */
+static void
+dispatch (Uint32 source, Uint8 now)
+{
+	joystick *j = &joysticks[SOURCE_PORT (source)];
+	int n = source_input (j, source), d;
+	Uint8 e;
+	keybinding **chain;
+	now &= 0xf;
+	e = edges[j->state[n]][now];
+	if (!e)
+		return;
+	j->state[n] = now;
+	chain = &j->chains[n * 4];
+	source &= ~0xfu;
+	for (d = 0; d < 4; d++)
+	{
+		if (e & (1 << d))
+		{
+			if (input_hook)
+				report_input (source | (1u << d));
+			activate (&chain[d], source | (1u << d));
+		}
+	}
+	for (d = 0; d < 4; d++)
+	{
+		if (e & (0x10 << d))
+			deactivate (&chain[d], source | (1u << d));
+	}
+}
+
+int
+VControl_AddBinding (SDL_Event *e, int *target)
+{
+	int result;
+	switch (e->type)
+	{
+	case SDL_KEYDOWN:
+		result = VControl_AddKeyBinding (e->key.keysym.sym, target);
+		break;
+	case SDL_JOYAXISMOTION:
+		result = VControl_AddJoyAxisBinding (e->jaxis.which, e->jaxis.axis, (e->jaxis.value < 0) ? -1 : 1, target);
+		break;
+	case SDL_JOYHATMOTION:
+		result = VControl_AddJoyHatBinding (e->jhat.which, e->jhat.hat, e->jhat.value, target);
+		break;
+	case SDL_JOYBUTTONDOWN:
+		result = VControl_AddJoyButtonBinding (e->jbutton.which, e->jbutton.button, target);
+		break;
+	default:
+		fprintf (stderr, "VControl_AddBinding didn't understand argument event\n");
+		result = -1;
+		break;
+	}
+	return result;
+}
+
+void
+VControl_RemoveBinding (SDL_Event *e, int *target)
+{
+	switch (e->type)
+	{
+	case SDL_KEYDOWN:
+		VControl_RemoveKeyBinding (e->key.keysym.sym, target);
+		break;
+	case SDL_JOYAXISMOTION:
+		VControl_RemoveJoyAxisBinding (e->jaxis.which, e->jaxis.axis, (e->jaxis.value < 0) ? -1 : 1, target);
+		break;
+	case SDL_JOYHATMOTION:
+		VControl_RemoveJoyHatBinding (e->jhat.which, e->jhat.hat, e->jhat.value, target);
+		break;
+	case SDL_JOYBUTTONDOWN:
+		VControl_RemoveJoyButtonBinding (e->jbutton.which, e->jbutton.button, target);
+		break;
+	default:
+		fprintf (stderr, "VControl_RemoveBinding didn't understand argument event\n");
+		break;
+	}
+}
+
+int
+VControl_AddKeyBinding (sdl_key_t symbol, int *target)
+{
+	if (!add_binding (key_source (symbol), target))
+		return -1;
+	return 0;
+}
+
+void
+VControl_RemoveKeyBinding (sdl_key_t symbol, int *target)
+{
+	remove_binding (key_source (symbol), target);
+}
+
+int
+VControl_AddScancodeBinding (int scancode, int *target)
+{
+	if (scancode <= 0 || scancode >= SCANCODE_INPUTS)
+	{
+		fprintf (stderr, "VControl: Attempted to bind to illegal scancode %d\n", scancode);
+		return -1;
+	}
+	if (!add_binding (SOURCE_SCANCODE | scancode, target))
+		return -1;
+	return 0;
+}
+
+void
+VControl_RemoveScancodeBinding (int scancode, int *target)
+{
+	if (scancode > 0 && scancode < SCANCODE_INPUTS)
+	{
+		remove_binding (SOURCE_SCANCODE | scancode, target);
+	}
+}
+
+int
+VControl_AddJoyAxisBinding (int port, int axis, int polarity, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((axis >= 0) && (axis < j->numaxes))
+		{
+			if (polarity < 0)
+			{
+				if (!add_binding (JOY_SOURCE (SOURCE_AXIS, port, axis, AXIS_NEGATIVE), target))
+					return -1;
+			}
+			else if (polarity > 0)
+			{
+				if (!add_binding (JOY_SOURCE (SOURCE_AXIS, port, axis, AXIS_POSITIVE), target))
+					return -1;
+			}
+			else
+			{
+				fprintf (stderr, "VControl: Attempted to bind to polarity zero\n");
+				return -1;
+			}
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to bind to illegal axis %d\n", axis);
+			return -1;
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
+		return -1;
+	}
+	return 0;
+}
+
+void
+VControl_RemoveJoyAxisBinding (int port, int axis, int polarity, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((axis >= 0) && (axis < j->numaxes))
+		{
+			if (polarity < 0)
+			{
+				remove_binding (JOY_SOURCE (SOURCE_AXIS, port, axis, AXIS_NEGATIVE), target);
+			}
+			else if (polarity > 0)
+			{
+				remove_binding (JOY_SOURCE (SOURCE_AXIS, port, axis, AXIS_POSITIVE), target);
+			}
+			else
+			{
+				fprintf (stderr, "VControl: Attempted to unbind from polarity zero\n");
+			}
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to unbind from illegal axis %d\n", axis);
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+	}
+}
+
+int
+VControl_AddJoyButtonBinding (int port, int button, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((button >= 0) && (button < j->numbuttons))
+		{
+			if (!add_binding (JOY_SOURCE (SOURCE_BUTTON, port, button, 1), target))
+				return -1;
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to bind to illegal button %d\n", button);
+			return -1;
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
+		return -1;
+	}
+	return 0;
+}
+
+void
+VControl_RemoveJoyButtonBinding (int port, int button, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((button >= 0) && (button < j->numbuttons))
+		{
+			remove_binding (JOY_SOURCE (SOURCE_BUTTON, port, button, 1), target);
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to unbind from illegal button %d\n", button);
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+	}
+}
+
+int
+VControl_AddJoyHatBinding (int port, int which, Uint8 dir, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((which >= 0) && (which < j->numhats))
+		{
+			if (dir == SDL_HAT_LEFT || dir == SDL_HAT_RIGHT || dir == SDL_HAT_UP || dir == SDL_HAT_DOWN)
+			{
+				if (!add_binding (JOY_SOURCE (SOURCE_HAT, port, which, dir), target))
+					return -1;
+			}
+			else
+			{
+				fprintf (stderr, "VControl: Attempted to bind to illegal direction\n");
+				return -1;
+			}
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to bind to illegal hat %d\n", which);
+			return -1;
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", port);
+		return -1;
+	}
+	return 0;
+}
+
+void
+VControl_RemoveJoyHatBinding (int port, int which, Uint8 dir, int *target)
+{
+	if (port >= 0 && port < joycount)
+	{
+		joystick *j = &joysticks[port];
+		if (!(j->stick))
+			create_joystick (port);
+		if ((which >= 0) && (which < j->numhats))
+		{
+			if (dir == SDL_HAT_LEFT || dir == SDL_HAT_RIGHT || dir == SDL_HAT_UP || dir == SDL_HAT_DOWN)
+			{
+				remove_binding (JOY_SOURCE (SOURCE_HAT, port, which, dir), target);
+			}
+			else
+			{
+				fprintf (stderr, "VControl: Attempted to unbind from illegal direction\n");
+			}
+		}
+		else
+		{
+			fprintf (stderr, "VControl: Attempted to unbind from illegal hat %d\n", which);
+		}
+	}
+	else
+	{
+		fprintf (stderr, "VControl: Attempted to unbind from illegal port %d\n", port);
+	}
+}
+
+/* Find the source ID of one physical input, opening its joystick if
+ * need be.  If there is no such input, returns 0 and sets *status to
+ * say why. */
+static Uint32
+find_source (const VControl_BindingSpec *s, int *status)
+{
+	joystick *j;
+	if (s->type == VCONTROL_SPEC_KEY)
+	{
+		return key_source (s->symbol);
+	}
+	if (s->type == VCONTROL_SPEC_SCANCODE)
+	{
+		if (s->index > 0 && s->index < SCANCODE_INPUTS)
+			return SOURCE_SCANCODE | s->index;
+		*status = VCONTROL_BIND_BADINPUT;
+		return 0;
+	}
+	if (s->type != VCONTROL_SPEC_JOYAXIS && s->type != VCONTROL_SPEC_JOYBUTTON && s->type != VCONTROL_SPEC_JOYHAT)
+	{
+		*status = VCONTROL_BIND_BADTYPE;
+		return 0;
+	}
+	if (s->port < 0 || s->port >= joycount)
+	{
+		*status = VCONTROL_BIND_BADPORT;
+		return 0;
+	}
+	j = &joysticks[s->port];
+	if (!(j->stick))
+		create_joystick (s->port);
+	switch (s->type)
+	{
+	case VCONTROL_SPEC_JOYAXIS:
+		if ((s->index >= 0) && (s->index < j->numaxes) && s->value)
+		{
+			return JOY_SOURCE (SOURCE_AXIS, s->port, s->index, (s->value < 0) ? AXIS_NEGATIVE : AXIS_POSITIVE);
+		}
+		break;
+	case VCONTROL_SPEC_JOYBUTTON:
+		if ((s->index >= 0) && (s->index < j->numbuttons))
+		{
+			return JOY_SOURCE (SOURCE_BUTTON, s->port, s->index, 1);
+		}
+		break;
+	case VCONTROL_SPEC_JOYHAT:
+		if ((s->index >= 0) && (s->index < j->numhats) &&
+		    (s->value == SDL_HAT_LEFT || s->value == SDL_HAT_RIGHT || s->value == SDL_HAT_UP || s->value == SDL_HAT_DOWN))
+		{
+			return JOY_SOURCE (SOURCE_HAT, s->port, s->index, s->value);
+		}
+		break;
+	}
+	*status = VCONTROL_BIND_BADINPUT;
+	return 0;
+}
+
+/* As find_source, but complains instead */
+static Uint32
+input_source (const VControl_BindingSpec *s)
+{
+	int status;
+	Uint32 source = find_source (s, &status);
+	if (!source)
+	{
+		if (status == VCONTROL_BIND_BADPORT)
+			fprintf (stderr, "VControl: Attempted to bind to illegal port %d\n", s->port);
+		else if (s->type == VCONTROL_SPEC_SCANCODE)
+			fprintf (stderr, "VControl: Attempted to bind to illegal scancode %d\n", s->index);
+		else
+			fprintf (stderr, "VControl: Attempted to bind to illegal joystick input\n");
+	}
+	return source;
+}
+
+static int
+same_input (const VControl_BindingSpec *a, const VControl_BindingSpec *b)
+{
+	if (a->type != b->type)
+		return 0;
+	if (a->type == VCONTROL_SPEC_KEY)
+		return a->symbol == b->symbol;
+	if (a->type == VCONTROL_SPEC_SCANCODE)
+		return a->index == b->index;
+	if (a->type == VCONTROL_SPEC_JOYAXIS)
+		return (a->port == b->port) && (a->index == b->index) && ((a->value < 0) == (b->value < 0));
+	return (a->port == b->port) && (a->index == b->index) && (a->value == b->value);
+}
+
+/* Take a reference to the chord input slot for s, binding a fresh
+ * slot if no chord uses s yet.  Returns the slot or -1. */
+static int
+acquire_chord_input (const VControl_BindingSpec *s)
+{
+	int i, n = -1;
+	Uint32 source;
+	keybinding *b;
+	for (i = 0; i < MAX_CHORD_INPUTS; i++)
+	{
+		if (chord_inputs[i].refs == 0)
+		{
+			if (n < 0)
+				n = i;
+		}
+		else if (same_input (&chord_inputs[i].input, s))
+		{
+			chord_inputs[i].refs++;
+			return i;
+		}
+	}
+	if (n < 0)
+	{
+		fprintf (stderr, "VControl: Too many distinct chord inputs (limit %d)\n", MAX_CHORD_INPUTS);
+		return -1;
+	}
+	source = input_source (s);
+	if (!source)
+		return -1;
+	b = add_binding (source, &chord_inputs[n].count);
+	if (!b)
+		return -1;
+	unindex_binding (b);
+	b->chord = n + 1;
+	chord_inputs[n].input = *s;
+	chord_inputs[n].input.name = NULL;
+	chord_inputs[n].input.target = NULL;
+	chord_inputs[n].count = 0;
+	chord_inputs[n].refs = 1;
+	if (n >= chord_input_top)
+		chord_input_top = n + 1;
+	return n;
+}
+
+static void
+release_chord_input (int n)
+{
+	chord_input *c = &chord_inputs[n];
+	if (--c->refs == 0)
+	{
+		Uint32 source = input_source (&c->input);
+		if (source)
+		{
+			remove_binding (source, &c->count);
+		}
+		c->count = 0;
+		chord_held[n / 32] &= ~((Uint32)1 << (n % 32));
+	}
+}
+
+static int
+find_chord (const Uint32 *mask, int *target)
+{
+	int i;
+	for (i = 0; i < chordcount; i++)
+	{
+		if ((chords[i].target == target) && (chords[i].layer == edit_layer) && !memcmp (chords[i].mask, mask, sizeof (chords[i].mask)))
+			return i;
+	}
+	return -1;
+}
+
+int
+VControl_AddChordBinding (const VControl_BindingSpec *inputs, int count, int *target)
+{
+	int slots[MAX_CHORD_LENGTH];
+	Uint32 mask[CHORD_WORDS];
+	int i;
+
+	if (count < 1 || count > MAX_CHORD_LENGTH)
+	{
+		fprintf (stderr, "VControl: Chords must have between 1 and %d inputs\n", MAX_CHORD_LENGTH);
+		return -1;
+	}
+	memset (mask, 0, sizeof (mask));
+	for (i = 0; i < count; i++)
+	{
+		slots[i] = acquire_chord_input (&inputs[i]);
+		if (slots[i] < 0)
+		{
+			while (i-- > 0)
+				release_chord_input (slots[i]);
+			return -1;
+		}
+		mask[slots[i] / 32] |= (Uint32)1 << (slots[i] % 32);
+	}
+
+	if (find_chord (mask, target) < 0)
+	{
+		if (chordcount == chordspace)
+		{
+			int newspace = chordspace ? chordspace * 2 : 16;
+			chord *newchords = vc_realloc (chords, sizeof (chord) * newspace);
+			if (!newchords)
+			{
+				for (i = 0; i < count; i++)
+					release_chord_input (slots[i]);
+				fprintf (stderr, "VControl: Out of memory adding chord\n");
+				return -1;
+			}
+			chords = newchords;
+			chordspace = newspace;
+		}
+		memcpy (chords[chordcount].mask, mask, sizeof (mask));
+		chords[chordcount].target = target;
+		chords[chordcount].action = VControl_target2action (target);
+		chords[chordcount].layer = edit_layer;
+		chords[chordcount].active = 0;
+		chordcount++;
+	}
+	else
+	{
+		/* Already bound; drop the extra references */
+		for (i = 0; i < count; i++)
+			release_chord_input (slots[i]);
+	}
+	return 0;
+}
+
+static void
+delete_chord (int c)
+{
+	Uint32 mask[CHORD_WORDS];
+	int n;
+	if (chords[c].active)
+	{
+		/* Let go the way a released chord does, so the mirror,
+		 * the release time and the hook all see it */
+		signal_target (chords[c].target, chords[c].action, 0);
+	}
+	memcpy (mask, chords[c].mask, sizeof (mask));
+	chords[c] = chords[--chordcount];
+	for (n = 0; n < MAX_CHORD_INPUTS; n++)
+	{
+		if (mask[n / 32] & ((Uint32)1 << (n % 32)))
+			release_chord_input (n);
+	}
+}
+
+void
+VControl_RemoveChordBinding (const VControl_BindingSpec *inputs, int count, int *target)
+{
+	int slots[MAX_CHORD_LENGTH];
+	Uint32 mask[CHORD_WORDS];
+	int i, j, c;
+
+	if (count < 1 || count > MAX_CHORD_LENGTH)
+		return;
+	memset (mask, 0, sizeof (mask));
+	for (i = 0; i < count; i++)
+	{
+		slots[i] = -1;
+		for (j = 0; j < MAX_CHORD_INPUTS; j++)
+		{
+			if (chord_inputs[j].refs && same_input (&chord_inputs[j].input, &inputs[i]))
+			{
+				slots[i] = j;
+				break;
+			}
+		}
+		if (slots[i] < 0)
+		{
+			/* Nothing bound to this chord; return. */
+			return;
+		}
+		mask[slots[i] / 32] |= (Uint32)1 << (slots[i] % 32);
+	}
+	c = find_chord (mask, target);
+	if (c >= 0)
+		delete_chord (c);
+}
+
+static int
+find_timed (const VControl_BindingSpec *input, int *target)
+{
+	int i;
+	for (i = 0; i < timedcount; i++)
+	{
+		timed *t = timeds[i];
+		if (t && (t->target == target) && (t->layer == edit_layer) &&
+		    (t->input.modifier == input->modifier) && same_input (&t->input, input))
+			return i;
+	}
+	return -1;
+}
+
+int
+VControl_AddTimedBinding (const VControl_BindingSpec *input, int *target)
+{
+	Uint32 source;
+	keybinding *b;
+	timed *t;
+	int n, i = find_timed (input, target);
+
+	if (input->modifier != VCONTROL_MODIFIER_HOLD && input->modifier != VCONTROL_MODIFIER_TAP &&
+	    input->modifier != VCONTROL_MODIFIER_TURBO)
+	{
+		fprintf (stderr, "VControl: Unknown binding modifier %d\n", input->modifier);
+		return -1;
+	}
+	if (input->period < 0 || (input->modifier == VCONTROL_MODIFIER_TURBO && input->period == 0))
+	{
+		fprintf (stderr, "VControl: Illegal modifier period %d\n", input->period);
+		return -1;
+	}
+	if (i >= 0)
+	{
+		timeds[i]->input.period = input->period;
+		return 0;
+	}
+	for (n = 0; n < timedcount && timeds[n]; n++)
+		;
+	if (n == timedspace)
+	{
+		int newspace = timedspace ? timedspace * 2 : 16;
+		timed **newtimeds = vc_realloc (timeds, sizeof (timed *) * newspace);
+		if (!newtimeds)
+		{
+			fprintf (stderr, "VControl: Out of memory adding timed binding\n");
+			return -1;
+		}
+		timeds = newtimeds;
+		timedspace = newspace;
+	}
+	source = input_source (input);
+	if (!source)
+		return -1;
+	if (reserve_targets (1))
+	{
+		fprintf (stderr, "VControl: Out of memory adding timed binding\n");
+		return -1;
+	}
+	t = sparecount ? spares[--sparecount] : vc_malloc (sizeof (timed));
+	if (!t)
+	{
+		fprintf (stderr, "VControl: Out of memory adding timed binding\n");
+		return -1;
+	}
+	b = add_binding (source, &t->count);
+	if (!b)
+	{
+		spare_timed (t);
+		return -1;
+	}
+	memset (t, 0, sizeof (timed));
+	t->timer.expire = timed_expire;
+	t->input = *input;
+	t->input.name = NULL;
+	t->input.target = NULL;
+	t->target = target;
+	t->action = VControl_target2action (target);
+	t->layer = edit_layer;
+	timeds[n] = t;
+	unindex_binding (b);
+	b->timed = n + 1;
+	index_binding (b);
+	if (n == timedcount)
+		timedcount++;
+	return 0;
+}
+
+void
+VControl_RemoveTimedBinding (const VControl_BindingSpec *input, int *target)
+{
+	Uint32 source;
+	timed *t;
+	int n = find_timed (input, target);
+	if (n < 0)
+		return;
+	t = timeds[n];
+	source = input_source (&t->input);
+	if (source)
+	{
+		remove_binding (source, &t->count);
+	}
+	wheel_cancel (&t->timer);
+	timed_signal (t, 0);
+	spare_timed (t);
+	timeds[n] = NULL;
+}
+
+/* Describe the input of b, a plain or timed binding */
+static void
+binding_input (keybinding *b, VControl_BindingSpec *s)
+{
+	if (b->timed)
+		*s = timeds[b->timed - 1]->input;
+	else
+		source_spec (b->source, s);
+}
+
+int
+VControl_EnumerateBindings (int *target, VControl_BindingCallback callback, void *data)
+{
+	VControl_BindingSpec inputs[MAX_CHORD_LENGTH];
+	target_list *list = find_targets (target);
+	int action = VControl_target2action (target);
+	const char *name = (action >= 0) ? nametable[action].name : NULL;
+	keybinding *b;
+	int i, n, count, visited = 0;
+
+	for (b = list ? list->head : NULL; b != NULL; b = b->tnext)
+	{
+		if (b->layer != edit_layer)
+			continue;
+		binding_input (b, &inputs[0]);
+		inputs[0].name = name;
+		inputs[0].target = target;
+		visited++;
+		if (callback (data, inputs, 1))
+			return visited;
+	}
+	for (i = 0; i < chordcount; i++)
+	{
+		if (chords[i].target != target || chords[i].layer != edit_layer)
+			continue;
+		count = 0;
+		for (n = 0; n < MAX_CHORD_INPUTS; n++)
+		{
+			if (chords[i].mask[n / 32] & ((Uint32)1 << (n % 32)))
+			{
+				inputs[count] = chord_inputs[n].input;
+				inputs[count].name = name;
+				inputs[count].target = target;
+				count++;
+			}
+		}
+		visited++;
+		if (callback (data, inputs, count))
+			return visited;
+	}
+	return visited;
+}
+
+void
+VControl_RemoveAllBindingsForTarget (int *target)
+{
+	target_list *list = find_targets (target);
+	keybinding *b = list ? list->head : NULL;
+	int i;
+
+	/* Removing a binding can move the list's slot, or delete it with
+	 * the last binding, so step along before each removal */
+	while (b != NULL)
+	{
+		keybinding *next = b->tnext;
+		if (b->layer != edit_layer)
+		{
+			/* Left alone */
+		}
+		else if (b->timed)
+		{
+			VControl_RemoveTimedBinding (&timeds[b->timed - 1]->input, target);
+		}
+		else
+		{
+			remove_binding (b->source, target);
+		}
+		b = next;
+	}
+	for (i = chordcount - 1; i >= 0; i--)
+	{
+		if (chords[i].target == target && chords[i].layer == edit_layer)
+			delete_chord (i);
+	}
+}
+
+void
+VControl_Tick (Uint32 now)
+{
+	lock_dispatch ();
+	have_event_time = 1;
+	wheel_advance (now);
+	have_event_time = 0;
+	unlock_dispatch ();
+}
+
+/* Add the binding described by s.  Returns 0 on success. */
+static int
+add_spec (const VControl_BindingSpec *s, int *target)
+{
+	if (s->modifier != VCONTROL_MODIFIER_NONE && !joystick_setting (s->type))
+	{
+		return VControl_AddTimedBinding (s, target);
+	}
+	switch (s->type)
+	{
+	case VCONTROL_SPEC_KEY:
+		return VControl_AddKeyBinding (s->symbol, target);
+	case VCONTROL_SPEC_SCANCODE:
+		return VControl_AddScancodeBinding (s->index, target);
+	case VCONTROL_SPEC_JOYAXIS:
+		return VControl_AddJoyAxisBinding (s->port, s->index, s->value, target);
+	case VCONTROL_SPEC_JOYBUTTON:
+		return VControl_AddJoyButtonBinding (s->port, s->index, target);
+	case VCONTROL_SPEC_JOYHAT:
+		return VControl_AddJoyHatBinding (s->port, s->index, (Uint8)s->value, target);
+	case VCONTROL_SPEC_JOYTHRESHOLD:
+		return VControl_SetJoyThreshold (s->port, s->value);
+	case VCONTROL_SPEC_JOYAXISTHRESHOLD:
+		return VControl_SetJoyAxisThreshold (s->port, s->index, s->value, s->extra);
+	case VCONTROL_SPEC_JOYDEADZONE:
+		return VControl_SetJoyStickDeadzone (s->port, s->index, s->extra, s->value);
+	case VCONTROL_SPEC_JOYDEBOUNCE:
+		return VControl_SetJoyDebounce (s->port, s->value);
+	default:
+		fprintf (stderr, "VControl: Unknown binding type %d\n", s->type);
+		return -1;
+	}
+}
+
+void
+VControl_RemoveAllBindings ()
+{
+	keypool *x;
+	int i, j;
+
+	/* Everything is emptied in place, keeping the pool chunks and
+	 * tables, so that binding again needs no more memory.  Slots are
+	 * reused at once, which is safe only because every dispatcher on
+	 * another thread holds the listener's lock. */
+	lock_dispatch ();
+	rcu_forget ();
+	for (x = pool; x != NULL; x = x->next)
+	{
+		x->remaining = POOL_CHUNK_SIZE;
+		for (i = 0; i < POOL_CHUNK_SIZE; i++)
+		{
+			x->pool[i].target = NULL;
+			x->pool[i].source = 0;
+			x->pool[i].chord = 0;
+			x->pool[i].timed = 0;
+			x->pool[i].action = -1;
+			x->pool[i].layer = 0;
+			x->pool[i].next = NULL;
+			x->pool[i].tnext = NULL;
+		}
+	}
+	for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
+		bindings[i] = NULL;
+	for (i = 0; i < SCANCODE_INPUTS; i++)
+		scanbindings[i] = NULL;
+	for (i = 0; i < SCANCODE_WORDS; i++)
+		scanheld[i] = 0;
+	chain_stats_valid = 0;
+	for (i = 0; i < joycount; i++)
+	{
+		joystick *js = &joysticks[i];
+		int inputs = js->numaxes + js->numbuttons + js->numhats;
+		if (!js->stick)
+			continue;
+		for (j = 0; j < 4 * inputs; j++)
+			js->chains[j] = NULL;
+		for (j = 0; j < inputs; j++)
+			js->state[j] = 0;
+	}
+	for (i = 0; i < MAX_CHORD_INPUTS; i++)
+	{
+		chord_inputs[i].count = 0;
+		chord_inputs[i].refs = 0;
+	}
+	chord_input_top = 0;
+	for (i = 0; i < CHORD_WORDS; i++)
+		chord_held[i] = 0;
+	chordcount = 0;
+	wheel_clear ();
+	for (i = 0; i < timedcount; i++)
+	{
+		if (timeds[i])
+			spare_timed (timeds[i]);
+		timeds[i] = NULL;
+	}
+	timedcount = 0;
+	if (targets)
+		memset (targets, 0, sizeof (target_list) * (targetmask + 1));
+	targetcount = 0;
+	heldkeycount = 0;
+	combo_remove_all ();
+	unlock_dispatch ();
+}
+
+static void
+key_down (sdl_key_t symbol)
+{
+	int i;
+	for (i = 0; i < heldkeycount; i++)
+	{
+		if (heldkeys[i] == symbol)
+			break;
+	}
+	if (i == heldkeycount)
+	{
+		if (heldkeycount < MAX_HELD_KEYS)
+			heldkeys[heldkeycount++] = symbol;
+		if (input_hook)
+			report_input (key_source (symbol));
+	}
+	activate (&bindings[symbol % KEYBOARD_INPUT_BUCKETS], key_source (symbol));
+}
+
+void
+VControl_ProcessKeyDown (sdl_key_t symbol)
+{
+	lock_dispatch ();
+	key_down (symbol);
+	unlock_dispatch ();
+}
+
+static void
+key_up (sdl_key_t symbol)
+{
+	int i;
+	for (i = 0; i < heldkeycount; i++)
+	{
+		if (heldkeys[i] == symbol)
+		{
+			heldkeys[i] = heldkeys[--heldkeycount];
+			break;
+		}
+	}
+	deactivate (&bindings[symbol % KEYBOARD_INPUT_BUCKETS], key_source (symbol));
+}
+
+void
+VControl_ProcessKeyUp (sdl_key_t symbol)
+{
+	lock_dispatch ();
+	key_up (symbol);
+	unlock_dispatch ();
+}
+
+/* Scancodes are tracked as held bits, so a key repeat or a stray
+ * release does nothing */
+static void
+scancode_down (int scancode)
+{
+	Uint32 bit = (Uint32)1 << (scancode % 32);
+	if (scancode <= 0 || scancode >= SCANCODE_INPUTS || (scanheld[scancode / 32] & bit))
+		return;
+	scanheld[scancode / 32] |= bit;
+	activate (&scanbindings[scancode], SOURCE_SCANCODE | scancode);
+}
+
+void
+VControl_ProcessScancodeDown (int scancode)
+{
+	lock_dispatch ();
+	scancode_down (scancode);
+	unlock_dispatch ();
+}
+
+static void
+scancode_up (int scancode)
+{
+	Uint32 bit = (Uint32)1 << (scancode % 32);
+	if (scancode <= 0 || scancode >= SCANCODE_INPUTS || !(scanheld[scancode / 32] & bit))
+		return;
+	scanheld[scancode / 32] &= ~bit;
+	deactivate (&scanbindings[scancode], SOURCE_SCANCODE | scancode);
+}
+
+void
+VControl_ProcessScancodeUp (int scancode)
+{
+	lock_dispatch ();
+	scancode_up (scancode);
+	unlock_dispatch ();
+}
+
+/* A debounced button's lockout has ended.  If it settled somewhere
+ * other than where it was last dispatched, that is dispatched now and
+ * starts another lockout. */
+static void
+bounce_expire (wheel_timer *w)
+{
+	bounce *b = (bounce *)w;
+	joystick *j = &joysticks[b->port];
+	if (j->state[j->numaxes + b->button] == b->down)
+		return;
+	event_time = w->deadline;
+	dispatch (JOY_SOURCE (SOURCE_BUTTON, b->port, b->button, 0), b->down);
+	if (j->debounce)
+		wheel_add (&b->timer, w->deadline + j->debounce, w->deadline);
+}
+
+/* The first change of a debounced button is dispatched at once and
+ * locks it for the debounce time; changes during that time are only
+ * recorded. */
+static void
+joy_button (int port, int button, Uint8 down)
+{
+	joystick *j = &joysticks[port];
+	if (!rcu_deref (j->stick))
+		return;
+	if (j->debounce && button >= 0 && button < j->numbuttons)
+	{
+		bounce *b = &j->bounces[button];
+		Uint32 now;
+		b->down = down;
+		if (b->timer.pprev)
+			return;
+		now = current_time ();
+		b->timer.expire = bounce_expire;
+		wheel_add (&b->timer, now + j->debounce, now);
+	}
+	dispatch (JOY_SOURCE (SOURCE_BUTTON, port, button, 0), down);
+}
+
+void
+VControl_ProcessJoyButtonDown (int port, int button)
+{
+	lock_dispatch ();
+	joy_button (port, button, 1);
+	unlock_dispatch ();
+}
+
+void
+VControl_ProcessJoyButtonUp (int port, int button)
+{
+	lock_dispatch ();
+	joy_button (port, button, 0);
+	unlock_dispatch ();
+}
+
+/* The direction bits axis n of j reads as at value.  A held direction
+ * is kept until the axis falls back to its release level, and a stick
+ * within its deadzone reads as centred on both axes.  The squares are
+ * at most 2^30 each, so their sum fits a Uint32. */
+static Uint8
+axis_direction (const joystick *j, int n, int value)
+{
+	const joyaxis *a = &j->axes[n];
+	Uint8 held = j->state[n];
+	int press = a->press, release = a->release;
+	if (press < 0)
+		press = release = j->threshold;
+	if (a->partner >= 0)
+	{
+		int other = j->axes[a->partner].value;
+		if ((Uint32)(value * value) + (Uint32)(other * other) < (Uint32)(a->deadzone * a->deadzone))
+			return 0;
+	}
+	if (held == AXIS_POSITIVE && value > release)
+		return AXIS_POSITIVE;
+	if (held == AXIS_NEGATIVE && value < -release)
+		return AXIS_NEGATIVE;
+	return (value > press) ? AXIS_POSITIVE : (value < -press) ? AXIS_NEGATIVE : 0;
+}
+
+static void
+joy_axis (int port, int axis, int value)
+{
+	joystick *j = &joysticks[port];
+	joyaxis *a;
+	if (!rcu_deref (j->stick) || axis < 0 || axis >= j->numaxes)
+		return;
+	a = &j->axes[axis];
+	a->value = (value < -32768) ? -32768 : (value > 32767) ? 32767 : value;
+	dispatch (JOY_SOURCE (SOURCE_AXIS, port, axis, 0), axis_direction (j, axis, a->value));
+	/* Moving one axis of a stick can carry the other in or out of
+	 * the deadzone */
+	if (a->partner >= 0)
+	{
+		dispatch (JOY_SOURCE (SOURCE_AXIS, port, a->partner, 0),
+			  axis_direction (j, a->partner, j->axes[a->partner].value));
+	}
+}
+
+void
+VControl_ProcessJoyAxis (int port, int axis, int value)
+{
+	lock_dispatch ();
+	joy_axis (port, axis, value);
+	unlock_dispatch ();
+}
+
+static void
+joy_hat (int port, int which, Uint8 value)
+{
+	if (!rcu_deref (joysticks[port].stick))
+		return;
+	dispatch (JOY_SOURCE (SOURCE_HAT, port, which, 0), value);
+}
+
+void
+VControl_ProcessJoyHat (int port, int which, Uint8 value)
+{
+	lock_dispatch ();
+	joy_hat (port, which, value);
+	unlock_dispatch ();
+}
+
+void
+VControl_SetTransitionHook (VControl_TransitionHook hook, void *data)
+{
+	transition_hook = hook;
+	transition_data = data;
+}
+
+void
+VControl_SetInputHook (VControl_InputHook hook, void *data)
+{
+	input_hook = hook;
+	input_data = data;
+}
+
+void
+VControl_ResetInput ()
+{
+	lock_dispatch ();
+	/* Anything held is released now */
+	if (nametable)
+	{
+		int i;
+		for (i = 0; i < timecount; i++)
+		{
+			if (*(nametable[i].target) > 0)
+				released (i);
+		}
+	}
+
+	/* Step through every valid entry in the binding pool and zero
+	 * them out.  This will probably zero entries multiple times;
+	 * oh well, no harm done. */
+
+	keypool *base = pool;
+	while (base != NULL)
+	{
+		int i;
+		for (i = 0; i < POOL_CHUNK_SIZE; i++)
+		{
+			if(base->pool[i].target)
+			{
+				*(base->pool[i].target) = 0;
+			}
+		}
+		base = base->next;
+	}
+
+	/* Chord targets need not appear in the pool at all */
+	{
+		int i;
+		for (i = 0; i < CHORD_WORDS; i++)
+			chord_held[i] = 0;
+		for (i = 0; i < chordcount; i++)
+		{
+			chords[i].active = 0;
+			*(chords[i].target) = 0;
+		}
+	}
+
+	/* As are timed targets, and nothing is waiting for a tick */
+	{
+		int i;
+		wheel_clear ();
+		for (i = 0; i < timedcount; i++)
+		{
+			if (timeds[i])
+			{
+				timeds[i]->on = 0;
+				*(timeds[i]->target) = 0;
+			}
+		}
+	}
+
+	/* Forget what is held, so switching layers doesn't revive it */
+	{
+		int i, j;
+		heldkeycount = 0;
+		for (i = 0; i < SCANCODE_WORDS; i++)
+			scanheld[i] = 0;
+		for (i = 0; i < joycount; i++)
+		{
+			joystick *x = &joysticks[i];
+			if (!x->stick)
+				continue;
+			for (j = 0; j < x->numaxes + x->numbuttons + x->numhats; j++)
+				x->state[j] = 0;
+			/* ... and pick it up again from the next poll or
+			 * sample */
+			memset (x->polled_axes + x->numaxes, 0, sizeof (Sint16) * x->numaxes);
+			memset (x->polled_buttons, 0, sizeof (Uint32) * POLLED_BUTTON_WORDS (x->numbuttons));
+			memset (x->polled_hats + x->numhats, 0, sizeof (Uint8) * x->numhats);
+		}
+		memset (polled_keys, 0, sizeof (polled_keys));
+	}
+	combo_reset ();
+	if (nametable)
+	{
+		publish_all (nametable);
+	}
+	unlock_dispatch ();
+}
+
+/* Rollback state is a run of 32-bit words.  A header gives the length
+ * of the whole and of the hashed part and the number of targets, to
+ * catch states saved under other bindings.  The hashed part holds
+ * every target's value, what is held, the progress of chords, timed
+ * bindings and combos and the layer stack.  Last come the times, which
+ * differ between machines seeing the same input. */
+#define STATE_HEADER 3
+
+static void
+state_words (size_t *logic, size_t *times)
+{
+	size_t l = 0, t = 1;
+	int i;
+	if (targets)
+		l += targetmask + 1;
+	l += SCANCODE_WORDS + 1 + MAX_HELD_KEYS;
+	l += CHORD_WORDS + chord_input_top + 2 * chordcount;
+	l += 4 * timedcount;
+	t += 2 * timedcount;
+	l += timecount;
+	t += 2 * timecount;
+	for (i = 0; i < joycount; i++)
+	{
+		joystick *j = &joysticks[i];
+		if (!j->stick)
+			continue;
+		l += j->numaxes + j->numbuttons + j->numhats + j->numaxes + j->numbuttons;
+		t += j->numbuttons;
+	}
+	l += MAX_LAYERS + 3;
+	combo_state_words (&l, &t);
+	*logic = l;
+	*times = t;
+}
+
+/* Copy a value to or from the next word at cursor */
+#define STATE_WORD(cursor, var) \
+	do { if (restore) (var) = *(cursor)++; else *(cursor)++ = (Uint32)(var); } while (0)
+
+/* Save the state to w and t, or restore it from them.  Restoring
+ * rebuilds the timer wheel from the pending timers. */
+static void
+transfer_state (Uint32 *w, Uint32 *t, int restore)
+{
+	Uint32 wheel_now;
+	int i, n;
+
+	/* Every pending timer belongs to a timed binding or a debounced
+	 * button, so with these cancelled the wheel is empty and adding
+	 * the first again sets it back to the saved time */
+	if (restore)
+	{
+		for (i = 0; i < timedcount; i++)
+		{
+			if (timeds[i])
+				wheel_cancel (&timeds[i]->timer);
+		}
+		for (i = 0; i < joycount; i++)
+		{
+			for (n = 0; joysticks[i].bounces && n < joysticks[i].numbuttons; n++)
+				wheel_cancel (&joysticks[i].bounces[n].timer);
+		}
+	}
+	wheel_now = wheel_current ();
+	STATE_WORD (t, wheel_now);
+
+	for (i = 0; targets && i <= targetmask; i++)
+	{
+		if (restore)
+		{
+			if (targets[i].target)
+				*(targets[i].target) = (int)*w;
+			w++;
+		}
+		else
+		{
+			*w++ = targets[i].target ? (Uint32)*(targets[i].target) : 0;
+		}
+	}
+
+	for (i = 0; i < SCANCODE_WORDS; i++)
+		STATE_WORD (w, scanheld[i]);
+	STATE_WORD (w, heldkeycount);
+	for (i = 0; i < MAX_HELD_KEYS; i++)
+	{
+		/* Keys no longer held are left out, so the hash ignores them */
+		if (restore)
+			heldkeys[i] = (sdl_key_t)*w++;
+		else
+			*w++ = (i < heldkeycount) ? (Uint32)heldkeys[i] : 0;
+	}
+
+	for (i = 0; i < CHORD_WORDS; i++)
+		STATE_WORD (w, chord_held[i]);
+	for (i = 0; i < chord_input_top; i++)
+		STATE_WORD (w, chord_inputs[i].count);
+	for (i = 0; i < chordcount; i++)
+	{
+		STATE_WORD (w, chords[i].active);
+		STATE_WORD (w, *(chords[i].target));
+	}
+
+	for (i = 0; i < timedcount; i++)
+	{
+		timed *x = timeds[i];
+		Uint32 pending = 0, deadline = 0;
+		if (!x)
+		{
+			w += 4;
+			t += 2;
+			continue;
+		}
+		if (!restore && x->timer.pprev)
+		{
+			pending = 1;
+			deadline = x->timer.deadline;
+		}
+		STATE_WORD (w, x->count);
+		STATE_WORD (w, x->on);
+		STATE_WORD (w, *(x->target));
+		STATE_WORD (w, pending);
+		STATE_WORD (t, x->pressed_at);
+		STATE_WORD (t, deadline);
+		if (restore && pending)
+			wheel_add (&x->timer, deadline, wheel_now);
+	}
+
+	for (i = 0; i < timecount; i++)
+	{
+		STATE_WORD (w, press_count[i]);
+		STATE_WORD (t, press_time[i]);
+		STATE_WORD (t, release_time[i]);
+	}
+
+	for (i = 0; i < joycount; i++)
+	{
+		joystick *j = &joysticks[i];
+		if (!j->stick)
+			continue;
+		for (n = 0; n < j->numaxes + j->numbuttons + j->numhats; n++)
+			STATE_WORD (w, j->state[n]);
+		for (n = 0; n < j->numaxes; n++)
+			STATE_WORD (w, j->axes[n].value);
+		for (n = 0; n < j->numbuttons; n++)
+		{
+			bounce *b = &j->bounces[n];
+			Uint32 flags = b->down | (b->timer.pprev ? 2 : 0);
+			Uint32 deadline = b->timer.pprev ? b->timer.deadline : 0;
+			STATE_WORD (w, flags);
+			STATE_WORD (t, deadline);
+			if (restore)
+			{
+				b->down = flags & 1;
+				if (flags & 2)
+				{
+					b->timer.expire = bounce_expire;
+					wheel_add (&b->timer, deadline, wheel_now);
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < MAX_LAYERS; i++)
+		STATE_WORD (w, stack.layer[i]);
+	STATE_WORD (w, stack.depth);
+	STATE_WORD (w, stack.live);
+	STATE_WORD (w, stack.consume);
+
+	combo_state (&w, &t, restore);
+}
+
+size_t
+VControl_StateSize (void)
+{
+	size_t logic, times;
+	state_words (&logic, &times);
+	return sizeof (Uint32) * (STATE_HEADER + logic + times);
+}
+
+int
+VControl_SaveState (void *state, size_t size)
+{
+	Uint32 *w = state;
+	size_t logic, times;
+	state_words (&logic, &times);
+	if (size < sizeof (Uint32) * (STATE_HEADER + logic + times))
+		return -1;
+	lock_dispatch ();
+	w[0] = (Uint32)(STATE_HEADER + logic + times);
+	w[1] = (Uint32)logic;
+	w[2] = (Uint32)targetcount;
+	transfer_state (w + STATE_HEADER, w + STATE_HEADER + logic, 0);
+	unlock_dispatch ();
+	return 0;
+}
+
+int
+VControl_RestoreState (const void *state, size_t size)
+{
+	Uint32 *w = (Uint32 *)state;
+	size_t logic, times;
+	state_words (&logic, &times);
+	if (size < sizeof (Uint32) * STATE_HEADER || w[0] != STATE_HEADER + logic + times || w[1] != logic ||
+	    w[2] != (Uint32)targetcount || size < sizeof (Uint32) * w[0])
+	{
+		return -1;
+	}
+	lock_dispatch ();
+	transfer_state (w + STATE_HEADER, w + STATE_HEADER + logic, 1);
+	unlock_dispatch ();
+	if (nametable)
+	{
+		publish_all (nametable);
+	}
+	return 0;
+}
+
+/* FNV-1a over pairs of words, in two lanes so that the multiplies
+ * overlap */
+Uint64
+VControl_HashState (const void *state)
+{
+	const Uint32 *w = (const Uint32 *)state + STATE_HEADER;
+	Uint64 a = 14695981039346656037ull, b = a ^ 0x9e3779b97f4a7c15ull;
+	Uint32 i, n = ((const Uint32 *)state)[1];
+	for (i = 0; i + 4 <= n; i += 4)
+	{
+		a = (a ^ (w[i] | (Uint64)w[i + 1] << 32)) * 1099511628211ull;
+		b = (b ^ (w[i + 2] | (Uint64)w[i + 3] << 32)) * 1099511628211ull;
+	}
+	for (; i < n; i++)
+		a = (a ^ w[i]) * 1099511628211ull;
+	a ^= b * 0x9e3779b97f4a7c15ull;
+	return a ^ (a >> 29);
+}
+
+static void
+handle_event (SDL_Event *e)
+{
+#if SDL_MAJOR_VERSION > 1
+	event_time = e->common.timestamp;
+#else
+	event_time = SDL_GetTicks ();
+#endif
+	have_event_time = 1;
+	TRACE_HANDLE_EVENT_ENTRY (e->type);
+	switch (e->type)
+	{
+		case SDL_KEYDOWN:
+#if SDL_MAJOR_VERSION > 1
+			if (!e->key.repeat)
+#endif
+			{
+				key_down (e->key.keysym.sym);
+				scancode_down (e->key.keysym.scancode);
+			}
+			break;
+		case SDL_KEYUP:
+			key_up (e->key.keysym.sym);
+			scancode_up (e->key.keysym.scancode);
+			break;
+		case SDL_JOYAXISMOTION:
+			joy_axis (e->jaxis.which, e->jaxis.axis, e->jaxis.value);
+			break;
+		case SDL_JOYHATMOTION:
+			joy_hat (e->jhat.which, e->jhat.hat, e->jhat.value);
+			break;
+		case SDL_JOYBUTTONDOWN:
+			joy_button (e->jbutton.which, e->jbutton.button, 1);
+			break;
+		case SDL_JOYBUTTONUP:
+			joy_button (e->jbutton.which, e->jbutton.button, 0);
+			break;
+		default:
+			break;
+	}
+	TRACE_HANDLE_EVENT_RETURN (e->type);
+	have_event_time = 0;
+}
+
+static int
+is_input_event (Uint32 type)
+{
+	switch (type)
+	{
+		case SDL_KEYDOWN:
+		case SDL_KEYUP:
+		case SDL_JOYAXISMOTION:
+		case SDL_JOYHATMOTION:
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+#if SDL_MAJOR_VERSION > 1
+static int
+is_joystick_event (Uint32 type)
+{
+	switch (type)
+	{
+		case SDL_JOYAXISMOTION:
+		case SDL_JOYHATMOTION:
+		case SDL_JOYBUTTONDOWN:
+		case SDL_JOYBUTTONUP:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/* Joystick events are left alone while the sampler reads the
+ * joysticks, whichever way they arrive */
+static int
+sampled_event (SDL_Event *e)
+{
+	return is_joystick_event (e->type) && SDL_AtomicGet (&sampling);
+}
+#endif
+
+void
+VControl_HandleEvent (SDL_Event *e)
+{
+	if (polling && is_input_event (e->type))
+	{
+		/* PollInput reads the state instead */
+		return;
+	}
+#if SDL_MAJOR_VERSION > 1
+	if (immediate && is_input_event (e->type))
+	{
+		/* Already seen by the event watch or filter */
+		return;
+	}
+	if (sampled_event (e))
+	{
+		/* The sampler reads the joysticks itself */
+		return;
+	}
+#endif
+	lock_dispatch ();
+	handle_event (e);
+	unlock_dispatch ();
+}
+
+#if SDL_MAJOR_VERSION > 1
+static int SDLCALL
+immediate_watch (void *data, SDL_Event *e)
+{
+	if (is_input_event (e->type) && !sampled_event (e))
+	{
+		lock_dispatch ();
+		handle_event (e);
+		unlock_dispatch ();
+	}
+	return 1;
+}
+
+static int SDLCALL
+immediate_filter (void *data, SDL_Event *e)
+{
+	if (saved_filter && !saved_filter (saved_filter_data, e))
+	{
+		/* The application didn't want it either */
+		return 0;
+	}
+	if (is_input_event (e->type))
+	{
+		if (!sampled_event (e))
+		{
+			lock_dispatch ();
+			handle_event (e);
+			unlock_dispatch ();
+		}
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+#if SDL_MAJOR_VERSION > 1
+/* Immediate mode and the joystick sampler dispatch from other threads,
+ * so they can't run without the listener's lock */
+static int
+need_dispatch_lock (const char *what)
+{
+	if (!dispatch_lock)
+	{
+		fprintf (stderr, "VControl: %s needs the listener's lock, which couldn't be created\n", what);
+		return -1;
+	}
+	return 0;
+}
+#endif
+
+int
+VControl_SetImmediateMode (int enable, int consume)
+{
+#if SDL_MAJOR_VERSION > 1
+	if (immediate)
+	{
+		if (immediate_consume)
+			SDL_SetEventFilter (saved_filter, saved_filter_data);
+		else
+			SDL_DelEventWatch (immediate_watch, NULL);
+		saved_filter = NULL;
+		saved_filter_data = NULL;
+		immediate = 0;
+	}
+	if (enable && polling)
+	{
+		fprintf (stderr, "VControl: Immediate mode can't be combined with polling mode\n");
+		return -1;
+	}
+	if (enable)
+	{
+		if (need_dispatch_lock ("Immediate mode"))
+			return -1;
+		immediate = 1;
+		immediate_consume = consume;
+		if (consume)
+		{
+			if (!SDL_GetEventFilter (&saved_filter, &saved_filter_data))
+			{
+				saved_filter = NULL;
+				saved_filter_data = NULL;
+			}
+			SDL_SetEventFilter (immediate_filter, NULL);
+		}
+		else
+		{
+			SDL_AddEventWatch (immediate_watch, NULL);
+		}
+	}
+	return 0;
+#else
+	if (enable)
+	{
+		fprintf (stderr, "VControl: Immediate mode requires SDL 2\n");
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/* The first offset from i on at which the n bytes at a and b differ,
+ * or n.  Blocks of sixteen bytes are compared at once with SSE2, or
+ * eight as one word without it, and only a block that differs is
+ * searched byte by byte. */
+static int
+next_difference (const Uint8 *a, const Uint8 *b, int i, int n)
+{
+#ifdef VCONTROL_SSE2
+	for (; i + 16 <= n; i += 16)
+	{
+		__m128i x = _mm_loadu_si128 ((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128 ((const __m128i *)(b + i));
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (x, y)) != 0xffff)
+			break;
+	}
+#else
+	for (; i + 8 <= n; i += 8)
+	{
+		Uint64 x, y;
+		memcpy (&x, a + i, 8);
+		memcpy (&y, b + i, 8);
+		if (x != y)
+			break;
+	}
+#endif
+	while (i < n && a[i] == b[i])
+		i++;
+	return i;
+}
+
+static void
+poll_keyboard (void)
+{
+	int n, i;
+#if SDL_MAJOR_VERSION > 1
+	const Uint8 *keys = SDL_GetKeyboardState (&n);
+#else
+	const Uint8 *keys = SDL_GetKeyState (&n);
+#endif
+	if (n > SCANCODE_INPUTS)
+		n = SCANCODE_INPUTS;
+	for (i = next_difference (keys, polled_keys, 0, n); i < n; i = next_difference (keys, polled_keys, i + 1, n))
+	{
+		polled_keys[i] = keys[i];
+#if SDL_MAJOR_VERSION > 1
+		if (keys[i])
+		{
+			key_down (SDL_GetKeyFromScancode ((SDL_Scancode)i));
+			scancode_down (i);
+		}
+		else
+		{
+			key_up (SDL_GetKeyFromScancode ((SDL_Scancode)i));
+			scancode_up (i);
+		}
+#else
+		if (keys[i])
+			key_down ((SDLKey)i);
+		else
+			key_up ((SDLKey)i);
+#endif
+	}
+}
+
+/* Axes are diffed as bytes, so a change to either byte of an axis
+ * brings it up */
+static void
+poll_joystick (int port)
+{
+	joystick *j = &joysticks[port];
+	Sint16 *axes = j->polled_axes;
+	Uint8 *hats = j->polled_hats;
+	int i, n;
+
+	for (i = 0; i < j->numaxes; i++)
+		axes[i] = SDL_JoystickGetAxis (j->stick, i);
+	n = 2 * j->numaxes;
+	for (i = next_difference ((Uint8 *)axes, (Uint8 *)(axes + j->numaxes), 0, n); i < n;
+	     i = next_difference ((Uint8 *)axes, (Uint8 *)(axes + j->numaxes), i + 1, n))
+	{
+		int axis = i / 2;
+		axes[j->numaxes + axis] = axes[axis];
+		joy_axis (port, axis, axes[axis]);
+	}
+
+	for (n = 0; n < j->numbuttons; n += 32)
+	{
+		Uint32 bits = 0, changed;
+		for (i = n; i < j->numbuttons && i < n + 32; i++)
+		{
+			if (SDL_JoystickGetButton (j->stick, i))
+				bits |= (Uint32)1 << (i - n);
+		}
+		changed = bits ^ j->polled_buttons[n / 32];
+		j->polled_buttons[n / 32] = bits;
+		for (i = n; changed; i++, changed >>= 1)
+		{
+			if (!(changed & 1))
+				continue;
+			if (bits & ((Uint32)1 << (i - n)))
+				joy_button (port, i, 1);
+			else
+				joy_button (port, i, 0);
+		}
+	}
+
+	for (i = 0; i < j->numhats; i++)
+		hats[i] = SDL_JoystickGetHat (j->stick, i);
+	for (i = next_difference (hats, hats + j->numhats, 0, j->numhats); i < j->numhats;
+	     i = next_difference (hats, hats + j->numhats, i + 1, j->numhats))
+	{
+		hats[j->numhats + i] = hats[i];
+		joy_hat (port, i, hats[i]);
+	}
+}
+
+int
+VControl_SetPollingMode (int enable)
+{
+#if SDL_MAJOR_VERSION > 1
+	if (enable && immediate)
+	{
+		fprintf (stderr, "VControl: Polling mode can't be combined with immediate mode\n");
+		return -1;
+	}
+#endif
+	if (enable && !polling)
+	{
+		/* Start from nothing held, so the first poll presses
+		 * whatever is down without counting it twice */
+		VControl_ResetInput ();
+	}
+	polling = enable;
+	return 0;
+}
+
+void
+VControl_PollInput (void)
+{
+	int i;
+	lock_dispatch ();
+	event_time = SDL_GetTicks ();
+	have_event_time = 1;
+	poll_keyboard ();
+#if SDL_MAJOR_VERSION > 1
+	if (sampler)
+	{
+		/* The sampler has the joysticks */
+	}
+	else
+#endif
+	if (joycount)
+	{
+		SDL_JoystickUpdate ();
+		for (i = 0; i < joycount; i++)
+		{
+			if (joysticks[i].stick)
+				poll_joystick (i);
+		}
+	}
+	have_event_time = 0;
+	unlock_dispatch ();
+}
+
+#if SDL_MAJOR_VERSION > 1
+/* Sample every open joystick sample_hz times a second.  Each sample
+ * is dispatched as one batch under the listener's lock, stamped with
+ * the time it was taken.  A sample that runs late moves the schedule
+ * along rather than being made up with a burst. */
+static int SDLCALL
+sample_joysticks (void *data)
+{
+	Uint64 freq = SDL_GetPerformanceFrequency ();
+	Uint64 period = freq / sample_hz, next = SDL_GetPerformanceCounter ();
+	SDL_SetThreadPriority (SDL_THREAD_PRIORITY_HIGH);
+	if (!period)
+		period = 1;
+	while (SDL_AtomicGet (&sampling))
+	{
+		Uint64 now;
+		int i;
+		SDL_JoystickUpdate ();
+		lock_dispatch ();
+		event_time = SDL_GetTicks ();
+		have_event_time = 1;
+		for (i = 0; i < joycount; i++)
+		{
+			if (rcu_deref (joysticks[i].stick))
+				poll_joystick (i);
+		}
+		have_event_time = 0;
+		unlock_dispatch ();
+		next += period;
+		now = SDL_GetPerformanceCounter ();
+		if (now >= next)
+			next = now;
+		else
+			SDL_Delay ((Uint32)(((next - now) * 1000 + freq - 1) / freq));
+	}
+	return 0;
+}
+#endif
+
+int
+VControl_StartJoySampling (int hz)
+{
+#if SDL_MAJOR_VERSION > 1
+	VControl_StopJoySampling ();
+	if (hz <= 0)
+	{
+		fprintf (stderr, "VControl: Joystick sampling rate must be positive\n");
+		return -1;
+	}
+	if (need_dispatch_lock ("Joystick sampling"))
+		return -1;
+	sample_hz = (Uint32)hz;
+	SDL_AtomicSet (&sampling, 1);
+	sampler = SDL_CreateThread (sample_joysticks, "VControl joysticks", NULL);
+	if (!sampler)
+	{
+		fprintf (stderr, "VControl: Couldn't start joystick sampling: %s\n", SDL_GetError ());
+		SDL_AtomicSet (&sampling, 0);
+		return -1;
+	}
+	return 0;
+#else
+	fprintf (stderr, "VControl: Joystick sampling requires SDL 2\n");
+	return -1;
+#endif
+}
+
+void
+VControl_StopJoySampling (void)
+{
+#if SDL_MAJOR_VERSION > 1
+	if (!sampler)
+		return;
+	SDL_AtomicSet (&sampling, 0);
+	SDL_WaitThread (sampler, NULL);
+	sampler = NULL;
+#endif
+}
+
+int
+VControl_StartTrace (const char *path, int frames)
+{
+	return trace_start (path, frames);
+}
+
+void
+VControl_TraceFrame (void)
+{
+	trace_frame ();
+}
+
+void
+VControl_StopTrace (void)
+{
+	trace_stop ();
+}
+
+int
+VControl_StartInjectionServer (const char *path)
+{
+	return inject_start (path);
+}
+
+void
+VControl_StopInjectionServer (void)
+{
+	inject_stop ();
+}
+
+/* Set a named control to value, as if its inputs had done it */
+static void
+inject_action (int action, int value)
+{
+	int *target, old;
+	if (!nametable || action < 0 || action >= timecount)
+		return;
+	target = nametable[action].target;
+	old = *target;
+	*target = value;
+	publish_value (action, value);
+	if (old <= 0 && value > 0)
+		pressed (action);
+	else if (old > 0 && value <= 0)
+		released (action);
+}
+
+/* Apply one injected record.  Unlike the Process routines, these come
+ * from outside the program, so every index is checked. */
+static void
+inject (const VControl_Injection *m)
+{
+	joystick *j = NULL;
+	if (m->type >= VCONTROL_INJECT_JOYBUTTONDOWN && m->type <= VCONTROL_INJECT_JOYHAT)
+	{
+		if (m->port < 0 || m->port >= joycount || !joysticks[m->port].stick)
+			return;
+		j = &joysticks[m->port];
+	}
+	if (m->type == VCONTROL_INJECT_KEYDOWN || m->type == VCONTROL_INJECT_KEYUP)
+	{
+		/* A negative key would hash to a negative bucket */
+		if (m->value < 0)
+			return;
+#if SDL_MAJOR_VERSION == 1
+		if (m->value >= SDLK_LAST)
+			return;
+#endif
+	}
+	switch (m->type)
+	{
+	case VCONTROL_INJECT_KEYDOWN:
+		key_down ((sdl_key_t)m->value);
+		break;
+	case VCONTROL_INJECT_KEYUP:
+		key_up ((sdl_key_t)m->value);
+		break;
+	case VCONTROL_INJECT_JOYBUTTONDOWN:
+		if (m->index >= 0 && m->index < j->numbuttons)
+			joy_button (m->port, m->index, 1);
+		break;
+	case VCONTROL_INJECT_JOYBUTTONUP:
+		if (m->index >= 0 && m->index < j->numbuttons)
+			joy_button (m->port, m->index, 0);
+		break;
+	case VCONTROL_INJECT_JOYAXIS:
+		if (m->index >= 0 && m->index < j->numaxes)
+			joy_axis (m->port, m->index, m->value);
+		break;
+	case VCONTROL_INJECT_JOYHAT:
+		if (m->index >= 0 && m->index < j->numhats)
+			joy_hat (m->port, m->index, (Uint8)m->value);
+		break;
+	case VCONTROL_INJECT_ACTION:
+		inject_action (m->index, m->value);
+		break;
+	default:
+		break;
+	}
+}
+
+int
+VControl_ProcessInjectedInput (void)
+{
+	VControl_Injection m;
+	int count = 0;
+	lock_dispatch ();
+	while (inject_next (&m))
+	{
+		inject (&m);
+		count++;
+	}
+	unlock_dispatch ();
+	return count;
+}
+
+int
+VControl_CreateLayer (const char *name)
+{
+	int layer = VControl_FindLayer (name);
+	if (layer >= 0)
+	{
+		return layer;
+	}
+	if (strlen (name) >= LAYER_NAME_SIZE)
+	{
+		fprintf (stderr, "VControl: Layer name '%s' is too long\n", name);
+		return -1;
+	}
+	if (layercount == MAX_LAYERS)
+	{
+		fprintf (stderr, "VControl: Too many layers (limit %d)\n", MAX_LAYERS);
+		return -1;
+	}
+	strcpy (layernames[layercount], name);
+	return layercount++;
+}
+
+int
+VControl_FindLayer (const char *name)
+{
+	int i;
+	for (i = 0; i < layercount; i++)
+	{
+		if (!strcasecmp (name, layernames[i]))
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+int
+VControl_SetEditLayer (int layer)
+{
+	int old = edit_layer;
+	if (layer < 0 || layer >= layercount)
+	{
+		fprintf (stderr, "VControl_SetEditLayer passed illegal layer %d\n", layer);
+		return -1;
+	}
+	edit_layer = layer;
+	return old;
+}
+
+/* Put a new stack into effect.  In immediate mode the listener may be
+ * running on another thread, so this happens under its lock. */
+static void
+set_stack (const layer_stack *s)
+{
+	layer_stack old;
+	lock_dispatch ();
+	old = stack;
+	stack = *s;
+	carry_over_all (&old);
+	unlock_dispatch ();
+}
+
+int
+VControl_PushLayer (int layer, int consume)
+{
+	layer_stack s = stack;
+	if (layer < 0 || layer >= layercount || (s.live & LAYER_BIT (layer)))
+	{
+		fprintf (stderr, "VControl_PushLayer passed illegal or stacked layer %d\n", layer);
+		return -1;
+	}
+	s.layer[s.depth++] = layer;
+	s.live |= LAYER_BIT (layer);
+	if (consume)
+		s.consume |= LAYER_BIT (layer);
+	set_stack (&s);
+	return 0;
+}
+
+int
+VControl_PopLayer (void)
+{
+	layer_stack s = stack;
+	int layer;
+	if (s.depth <= 1)
+	{
+		return -1;
+	}
+	layer = s.layer[--s.depth];
+	s.live &= ~LAYER_BIT (layer);
+	s.consume &= ~LAYER_BIT (layer);
+	set_stack (&s);
+	return layer;
+}
+
+int
+VControl_SwapLayer (int layer, int consume)
+{
+	layer_stack s = stack;
+	if (layer < 0 || layer >= layercount)
+	{
+		fprintf (stderr, "VControl_SwapLayer passed illegal layer %d\n", layer);
+		return -1;
+	}
+	if (s.depth > 1)
+	{
+		int top = s.layer[--s.depth];
+		s.live &= ~LAYER_BIT (top);
+		s.consume &= ~LAYER_BIT (top);
+	}
+	if (s.live & LAYER_BIT (layer))
+	{
+		fprintf (stderr, "VControl_SwapLayer passed stacked layer %d\n", layer);
+		return -1;
+	}
+	s.layer[s.depth++] = layer;
+	s.live |= LAYER_BIT (layer);
+	if (consume)
+		s.consume |= LAYER_BIT (layer);
+	set_stack (&s);
+	return 0;
+}
+
+void
+VControl_RegisterNameTable (VControl_NameBinding *table)
+{
+	keypool *base;
+	int i, count = 0;
+	nametable = table;
+
+	/* One timing slot per name */
+	while (table && table[count].target)
+	{
+		count++;
+	}
+	vc_free (press_time);
+	vc_free (release_time);
+	vc_free (press_count);
+	press_time = vc_calloc (count + 1, sizeof (Uint32));
+	release_time = vc_calloc (count + 1, sizeof (Uint32));
+	press_count = vc_calloc (count + 1, sizeof (Uint32));
+	timecount = (press_time && release_time && press_count) ? count : 0;
+
+	/* Name table indices are cached wherever a target is stored */
+	for (base = pool; base != NULL; base = base->next)
+	{
+		for (i = 0; i < POOL_CHUNK_SIZE; i++)
+		{
+			if (base->pool[i].target && !base->pool[i].chord)
+			{
+				base->pool[i].action = VControl_target2action (base->pool[i].target);
+			}
+		}
+	}
+	for (i = 0; i < chordcount; i++)
+	{
+		chords[i].action = VControl_target2action (chords[i].target);
+	}
+	for (i = 0; i < timedcount; i++)
+	{
+		if (timeds[i])
+			timeds[i]->action = VControl_target2action (timeds[i]->target);
+	}
+	combo_invalidate ();
+	publish_reopen (table);
+}
+
+int
+VControl_PublishState (const char *name)
+{
+	if (!name)
+	{
+		publish_close ();
+		return 0;
+	}
+	return publish_open (name, nametable);
+}
+
+int
+VControl_target2action (int *target)
+{
+	VControl_NameBinding *b = nametable;
+	int i;
+	if (!b)
+	{
+		return -1;
+	}
+	for (i = 0; b[i].target; i++)
+	{
+		if (target == b[i].target)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+Uint32
+VControl_HeldFor (int *target, Uint32 now)
+{
+	int action = VControl_target2action (target);
+	if (action < 0 || action >= timecount || *target <= 0)
+	{
+		return 0;
+	}
+	return now - press_time[action];
+}
+
+int
+VControl_PressedSince (int *target, Uint32 time)
+{
+	int action = VControl_target2action (target);
+	if (action < 0 || action >= timecount || !press_count[action])
+	{
+		return 0;
+	}
+	return (Sint32)(press_time[action] - time) >= 0;
+}
+
+Uint32
+VControl_GetPressTime (int *target)
+{
+	int action = VControl_target2action (target);
+	return (action < 0 || action >= timecount) ? 0 : press_time[action];
+}
+
+Uint32
+VControl_GetReleaseTime (int *target)
+{
+	int action = VControl_target2action (target);
+	return (action < 0 || action >= timecount) ? 0 : release_time[action];
+}
+
+static char *
+target2name (int *target)
+{
+	VControl_NameBinding *b = nametable;
+	while (b->target)
+	{
+		if (target == b->target)
+		{
+			return b->name;
+		}
+		++b;
+	}
+	return NULL;
+}
+
+static int *
+name2target (const char *name)
+{
+	VControl_NameBinding *b = nametable;
+	if (!b)
+	{
+		return NULL;
+	}
+	while (b->target)
+	{
+		if (!strcasecmp (name, b->name))
+		{
+			return b->target;
+		}
+		++b;
+	}
+	return NULL;
+}
+
+void
+VControl_FormatInput (char *buf, size_t size, const VControl_BindingSpec *s)
+{
+	char scanname[32];
+	switch (s->type)
+	{
+	case VCONTROL_SPEC_KEY:
+		snprintf (buf, size, "key %s", VControl_code2name (s->symbol));
+		break;
+	case VCONTROL_SPEC_SCANCODE:
+		VControl_scancode2name (s->index, scanname, sizeof (scanname));
+		snprintf (buf, size, "scancode %s", scanname);
+		break;
+	case VCONTROL_SPEC_JOYAXIS:
+		snprintf (buf, size, "joystick %d axis %d %s", s->port, s->index, (s->value < 0) ? "negative" : "positive");
+		break;
+	case VCONTROL_SPEC_JOYBUTTON:
+		snprintf (buf, size, "joystick %d button %d", s->port, s->index);
+		break;
+	case VCONTROL_SPEC_JOYHAT:
+		snprintf (buf, size, "joystick %d hat %d %s", s->port, s->index,
+			 (s->value == SDL_HAT_LEFT) ? "left" :
+			 (s->value == SDL_HAT_RIGHT) ? "right" :
+			 (s->value == SDL_HAT_UP) ? "up" : "down");
+		break;
+	case VCONTROL_SPEC_JOYTHRESHOLD:
+		snprintf (buf, size, "joystick %d threshold %d", s->port, s->value);
+		break;
+	case VCONTROL_SPEC_JOYAXISTHRESHOLD:
+		if (s->extra == s->value)
+			snprintf (buf, size, "joystick %d axis %d threshold %d", s->port, s->index, s->value);
+		else
+			snprintf (buf, size, "joystick %d axis %d threshold %d %d", s->port, s->index, s->value, s->extra);
+		break;
+	case VCONTROL_SPEC_JOYDEADZONE:
+		snprintf (buf, size, "joystick %d stick %d %d deadzone %d", s->port, s->index, s->extra, s->value);
+		break;
+	case VCONTROL_SPEC_JOYDEBOUNCE:
+		snprintf (buf, size, "joystick %d debounce %d", s->port, s->value);
+		break;
+	default:
+		snprintf (buf, size, "<Unknown input>");
+		break;
+	}
+	if (!joystick_setting (s->type) && s->modifier != VCONTROL_MODIFIER_NONE)
+	{
+		size_t len = strlen (buf);
+		if (s->modifier == VCONTROL_MODIFIER_HOLD)
+			snprintf (buf + len, size - len, " hold %d", s->period);
+		else if (s->modifier == VCONTROL_MODIFIER_TAP)
+			snprintf (buf + len, size - len, " tap %d", s->period);
+		else if (s->modifier == VCONTROL_MODIFIER_TURBO)
+			snprintf (buf + len, size - len, " turbo %dhz", s->period);
+	}
+}
+
+static void
+dump_keybindings (FILE *out, keybinding *kb, int layer)
+{
+	char namebuffer[64];
+	VControl_BindingSpec s;
+	while (kb != NULL)
+	{
+		/* Chords and other layers are dumped separately */
+		if (!kb->chord && kb->layer == layer)
+		{
+			binding_input (kb, &s);
+			VControl_FormatInput (namebuffer, sizeof (namebuffer), &s);
+			fprintf (out, "%s: %s\n", target2name (kb->timed ? timeds[kb->timed - 1]->target : kb->target), namebuffer);
+		}
+		kb = kb->next;
+	}
+}
+
+/* Print the settings of open joystick port */
+static void
+dump_settings (FILE *out, int port)
+{
+	joystick *j = &joysticks[port];
+	char namebuffer[64];
+	VControl_BindingSpec s;
+	int n;
+	memset (&s, 0, sizeof (s));
+	s.port = port;
+	s.type = VCONTROL_SPEC_JOYTHRESHOLD;
+	s.value = j->threshold;
+	VControl_FormatInput (namebuffer, sizeof (namebuffer), &s);
+	fprintf (out, "%s\n", namebuffer);
+	for (n = 0; n < j->numaxes; n++)
+	{
+		if (j->axes[n].press >= 0)
+		{
+			s.type = VCONTROL_SPEC_JOYAXISTHRESHOLD;
+			s.index = n;
+			s.value = j->axes[n].press;
+			s.extra = j->axes[n].release;
+			VControl_FormatInput (namebuffer, sizeof (namebuffer), &s);
+			fprintf (out, "%s\n", namebuffer);
+		}
+		if (j->axes[n].partner > n)
+		{
+			s.type = VCONTROL_SPEC_JOYDEADZONE;
+			s.index = n;
+			s.extra = j->axes[n].partner;
+			s.value = j->axes[n].deadzone;
+			VControl_FormatInput (namebuffer, sizeof (namebuffer), &s);
+			fprintf (out, "%s\n", namebuffer);
+		}
+	}
+	if (j->debounce)
+	{
+		s.type = VCONTROL_SPEC_JOYDEBOUNCE;
+		s.value = (int)j->debounce;
+		VControl_FormatInput (namebuffer, sizeof (namebuffer), &s);
+		fprintf (out, "%s\n", namebuffer);
+	}
+}
+
+static void
+dump_layer (FILE *out, int layer)
+{
+	int i;
+	char namebuffer[64];
+
+	/* Print out keyboard bindings */
+	for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
+	{
+		dump_keybindings (out, bindings[i], layer);
+	}
+	for (i = 0; i < SCANCODE_INPUTS; i++)
+	{
+		dump_keybindings (out, scanbindings[i], layer);
+	}
+
+	/* Print out joystick bindings */
+	for (i = 0; i < joycount; i++)
+	{
+		if (joysticks[i].stick)
+		{
+			int j, inputs = joysticks[i].numaxes + joysticks[i].numbuttons + joysticks[i].numhats;
+
+			if (layer == 0)
+			{
+				dump_settings (out, i);
+			}
+			for (j = 0; j < 4 * inputs; j++)
+			{
+				dump_keybindings (out, joysticks[i].chains[j], layer);
+			}
+		}
+	}
+
+	/* Print out chord bindings */
+	for (i = 0; i < chordcount; i++)
+	{
+		int n, first = 1;
+		if (chords[i].layer != layer)
+			continue;
+		fprintf (out, "%s:", target2name (chords[i].target));
+		for (n = 0; n < MAX_CHORD_INPUTS; n++)
+		{
+			if (chords[i].mask[n / 32] & ((Uint32)1 << (n % 32)))
+			{
+				VControl_FormatInput (namebuffer, sizeof (namebuffer), &chord_inputs[n].input);
+				fprintf (out, "%s %s", first ? "" : " +", namebuffer);
+				first = 0;
+			}
+		}
+		fprintf (out, "\n");
+	}
+}
+
+void
+VControl_Dump (FILE *out)
+{
+	int i;
+
+	dump_layer (out, 0);
+
+	/* Print out combos */
+	{
+		int **sequence, length, n;
+		Uint32 window;
+		int *target;
+		for (i = 0; combo_get (i, &sequence, &length, &window, &target); i++)
+		{
+			fprintf (out, "%s: combo", target2name (target));
+			for (n = 0; n < length; n++)
+			{
+				fprintf (out, " %s", target2name (sequence[n]));
+			}
+			fprintf (out, " within %u\n", (unsigned int)window);
+		}
+	}
+
+	/* Everything after a layer line goes into that layer */
+	for (i = 1; i < layercount; i++)
+	{
+		fprintf (out, "layer %s\n", layernames[i]);
+		dump_layer (out, i);
+	}
+
+#ifdef VCONTROL_DEBUG
+	/* Print out allocation data */
+	{
+		keypool *bp = pool;
+		i = 0;
+		while (bp != NULL)
+		{
+			fprintf (out, "# Internal Debug: Chunk #%i: %d slots remaining.\n", i, bp->remaining);
+			i++;
+			bp = bp->next;
+		}
+		fprintf (out, "# Internal Debug: %d chunks allocated.\n", i);
+	}
+#endif
+}
+
+static size_t
+joystick_memory (const joystick *j)
+{
+	int inputs = j->numaxes + j->numbuttons + j->numhats;
+	if (!j->stick)
+		return 0;
+	return (sizeof (keybinding *) * 4 + sizeof (Uint8)) * (inputs + 1) +
+		sizeof (joyaxis) * (j->numaxes + 1) + sizeof (bounce) * (j->numbuttons + 1) +
+		sizeof (Sint16) * (2 * j->numaxes + 1) +
+		sizeof (Uint32) * (POLLED_BUTTON_WORDS (j->numbuttons) + 1) +
+		sizeof (Uint8) * (2 * j->numhats + 1);
+}
+
+void
+VControl_GetMemoryStats (VControl_MemoryStats *stats)
+{
+	keypool *x;
+	int i;
+
+	memset (stats, 0, sizeof (*stats));
+	for (x = pool; x != NULL; x = x->next)
+	{
+		stats->chunks++;
+		stats->free_slots += x->remaining;
+	}
+	stats->live_slots = stats->chunks * POOL_CHUNK_SIZE - stats->free_slots;
+	stats->pool_bytes = sizeof (keypool) * stats->chunks;
+
+	stats->joystick_bytes = sizeof (joystick) * joycount;
+	for (i = 0; i < joycount; i++)
+	{
+		stats->joystick_bytes += joystick_memory (&joysticks[i]);
+		if (joysticks[i].stick)
+			stats->joysticks_open++;
+	}
+	if (press_time)
+		stats->name_bytes = sizeof (Uint32) * 3 * (timecount + 1);
+	if (targets)
+		stats->index_bytes = sizeof (target_list) * (targetmask + 1);
+	if (scratch)
+		stats->index_bytes += sizeof (pending) * scratchspace + sizeof (size_t) * pending_table_size (scratchspace);
+	stats->chord_bytes = sizeof (chord) * chordspace;
+	stats->timed_bytes = sizeof (timed *) * (timedspace + sparespace) + sizeof (timed) * sparecount;
+	for (i = 0; i < timedcount; i++)
+	{
+		if (timeds[i])
+			stats->timed_bytes += sizeof (timed);
+	}
+	stats->combo_bytes = combo_memory ();
+	stats->total_bytes = stats->pool_bytes + stats->joystick_bytes + stats->name_bytes +
+		stats->index_bytes + stats->chord_bytes + stats->timed_bytes + stats->combo_bytes;
+
+	if (!chain_stats_valid)
+	{
+		buckets_used = longest_chain = 0;
+		for (i = 0; i < KEYBOARD_INPUT_BUCKETS; i++)
+		{
+			keybinding *b;
+			int length = 0;
+			for (b = bindings[i]; b != NULL; b = b->next)
+				length++;
+			if (length)
+				buckets_used++;
+			if (length > longest_chain)
+				longest_chain = length;
+		}
+		chain_stats_valid = 1;
+	}
+	stats->key_buckets = KEYBOARD_INPUT_BUCKETS;
+	stats->buckets_used = buckets_used;
+	stats->longest_chain = longest_chain;
+}
+
+size_t
+VControl_GetJoystickMemory (int port)
+{
+	if (port < 0 || port >= joycount)
+		return 0;
+	return joystick_memory (&joysticks[port]);
+}
+
+/* Configuration file grammar is as follows:  One command per line, 
+ * hashes introduce comments that persist to end of line.  Blank lines
+ * are ignored.
+ *
+ * Terminals are represented here as quoted strings, e.g. "foo" for 
+ * the literal string foo.  These are matched case-insensitively.
+ * Special terminals are:
+ *
+ * KEYNAME:  This names a key, as defined in keynames.c.
+ * SCANNAME: This names a scancode: SDL's name for it without the
+ *           spaces, or its number in hexadecimal ("0x64").  A
+ *           plain decimal number that isn't a name is also read.
+ * IDNAME:   This is an arbitrary string of alphanumerics, 
+ *           case-insensitive, and ending with a colon.  This
+ *           names an application-specific control value.
+ * NAME:     A control name as in IDNAME, without the colon.
+ * NUM:      This is an unsigned integer.
+ * RATE:     An unsigned integer followed by "hz", as in 15hz.
+ * EOF:      End of file
+ *
+ * Nonterminals (the grammar itself) have the following productions:
+ * 
+ * configline <- IDNAME chord
+ *             | IDNAME binding modifier
+ *             | IDNAME "combo" sequence "within" NUM
+ *             | "joystick" NUM joysetting
+ *             | "layer" NAME
+ *
+ * sequence   <- NAME
+ *             | NAME sequence
+ *
+ * chord      <- binding
+ *             | binding "+" chord
+ *
+ * binding    <- "key" KEYNAME
+ *             | "scancode" SCANNAME
+ *             | "joystick" NUM joybinding
+ *
+ * joysetting <- "threshold" NUM
+ *             | "axis" NUM "threshold" NUM
+ *             | "axis" NUM "threshold" NUM NUM
+ *             | "stick" NUM NUM "deadzone" NUM
+ *             | "debounce" NUM
+ *
+ * joybinding <- "axis" NUM polarity
+ *             | "button" NUM
+ *             | "hat" NUM direction
+ *
+ * modifier   <- "hold" NUM
+ *             | "tap" NUM
+ *             | "turbo" RATE
+ *
+ * polarity   <- "positive" | "negative"
+ *
+ * dir        <- "up" | "down" | "left" | "right"
+ *
+ * Bindings and chords after a layer line go into the named layer,
+ * which is created if need be, until the next one or the end of the
+ * file.  The base layer is called "base".
+ *
+ * A combo's target is incremented each time its sequence is pressed
+ * with no more than NUM milliseconds from first press to last.
+ *
+ * A chord's target is signalled only while all its bindings are
+ * held.  "+" is also a KEYNAME, but it is never ambiguous: after
+ * "key", it names the key; after a complete binding, it joins another.
+ *
+ * A joystick's threshold is how far its axes must move from the
+ * middle to count as pressed.  An axis threshold overrides it for one
+ * axis; with a second NUM, the axis stays pressed until it falls back
+ * below that lower level.  A stick pairs two axes whose position reads
+ * as centred while within NUM of the middle, however the two are
+ * combined.  "debounce" holds back button changes for NUM
+ * milliseconds after each one it passes on, then passes on where the
+ * button has settled.
+ *
+ * A modifier makes the binding timed: "hold" signals the target once
+ * the input has been held NUM milliseconds, "tap" signals it briefly
+ * when the input is let go within NUM milliseconds, and "turbo" turns
+ * it on and off RATE times a second while the input is held.
+ *
+ * This grammar is amenable to simple recursive descent parsing;
+ * in fact, it's fully LL(1). */
+
+/* Actual maximum line and token sizes are two less than this, since
+ * we need space for the \n\0 at the end */
+#define LINE_SIZE 256
+#define TOKEN_SIZE 64
+
+typedef struct vcontrol_parse_state_s {
+	char line[LINE_SIZE];
+	char token[TOKEN_SIZE];
+	int index;
+	int error;
+	int linenum;
+	const VControl_ParseCallbacks *cb;
+	void *data;
+} parse_state;
+
+static void
+next_token (parse_state *state)
+{
+	int index, base;
+
+	state->token[0] = 0;
+	/* skip preceding whitespace */
+	base = state->index;
+	while (state->line[base] && isspace (state->line[base]))
+	{
+		base++;
+	}
+
+	index = 0;
+	while (index < (TOKEN_SIZE-1) && state->line[base+index] && !isspace (state->line[base+index]))
+	{
+		state->token[index] = state->line[base+index];
+		index++;
+	}
+	state->token[index] = 0;
+
+	/* If the token was too long, skip ahead until we get to whitespace */
+	while (state->line[base+index] && !isspace (state->line[base+index]))
+	{
+		index++;
+	}
+
+	state->index = base+index;
+}
+
+static void
+next_line (parse_state *state, FILE *in)
+{
+	int i, ch;
+	int comment = 0;
+	state->linenum++;
+	for (i = 0; i < LINE_SIZE-1; i++)
+	{
+		if (feof (in))
+		{
+			break;
+		}
+		ch = fgetc (in);
+		if (ch == '#' || ch == '\n' || ch == -1)
+		{
+			/* If this line is blank or all commented, include some
+			 * whitespace.  This lets us detect EOF as a completely
+			 * blank line. */
+			if (i==0) 
+			{
+				state->line[i] = '\n';
+				i++;
+			} 
+			break;
+		}
+		state->line[i] = ch;
+	}
+	state->line[i] = '\0';
+	/* Skip to end of line */
+	while (ch != '\n' && !feof (in))
+	{
+		ch = fgetc (in);
+	}
+	state->token[0] = 0;
+	state->index = 0;
+	state->error = 0;
+}
+
+static void
+parse_error (parse_state *state, const char *format, ...)
+{
+	char message[LINE_SIZE + 64];
+	va_list args;
+	va_start (args, format);
+	vsnprintf (message, sizeof (message), format, args);
+	va_end (args);
+	if (state->cb->error)
+	{
+		state->cb->error (state->data, state->linenum, message);
+	}
+	state->error = 1;
+}
+
+static void
+expected_error (parse_state *state, char *expected)
+{
+	parse_error (state, "Expected '%s'", expected);
+}
+
+static void
+consume (parse_state *state, char *expected)
+{
+	if (strcasecmp (expected, state->token))
+	{
+		expected_error (state, expected);
+	}
+	next_token (state);
+}
+
+static int
+consume_keyname (parse_state *state)
+{
+	int keysym = VControl_name2code (state->token);
+	if (!keysym)
+	{
+		parse_error (state, "Illegal key name '%s'", state->token);
+	}
+	next_token (state);
+	return keysym;
+}
+
+static int
+consume_scanname (parse_state *state)
+{
+	int scancode = VControl_name2scancode (state->token);
+	if (scancode <= 0 || scancode >= SCANCODE_INPUTS)
+	{
+		parse_error (state, "Illegal scancode '%s'", state->token);
+	}
+	next_token (state);
+	return scancode;
+}
+
+/* Copy the control name, without its colon, to name */
+static void
+consume_idname (parse_state *state, char *name)
+{
+	int index = 0;
+	while (state->token[index]) 
+	{
+		index++;
+	}
+
+	if (index == 0)
+	{
+		parse_error (state, "Can't happen: blank token to consume_idname");
+		return;
+	}
+
+	index--;
+	if (state->token[index] != ':')
+	{
+		expected_error (state, ":");
+		return;
+	}
+
+	state->token[index] = 0;  /* remove trailing colon */
+	strcpy (name, state->token);
+	next_token (state);
+}
+
+static int
+consume_num (parse_state *state)
+{
+	char *end;
+	int result = strtol (state->token, &end, 10);
+	if (*end != '\0')
+	{
+		parse_error (state, "Expected integer");
+	}
+	next_token (state);
+	return result;
+}
+
+static int
+consume_polarity (parse_state *state)
+{
+	int result = 0;
+	if (!strcasecmp (state->token, "positive"))
+	{
+		result = 1;
+	}
+	else if (!strcasecmp (state->token, "negative"))
+	{
+		result = -1;
+	}
+	else
+	{
+		expected_error (state, "positive' or 'negative");
+	}
+	next_token (state);
+	return result;
+}
+
+static Uint8
+consume_dir (parse_state *state)
+{
+	Uint8 result = 0;
+	if (!strcasecmp (state->token, "left"))
+	{
+		result = SDL_HAT_LEFT;
+	}
+	else if (!strcasecmp (state->token, "right"))
+	{
+		result = SDL_HAT_RIGHT;
+	}
+	else if (!strcasecmp (state->token, "up"))
+	{
+		result = SDL_HAT_UP;
+	}
+	else if (!strcasecmp (state->token, "down"))
+	{
+		result = SDL_HAT_DOWN;
+	}
+	else
+	{
+		expected_error (state, "left', 'right', 'up' or 'down");
+	}
+	next_token (state);
+	return result;
+}
+
+static int
+consume_rate (parse_state *state)
+{
+	size_t len = strlen (state->token);
+	int rate;
+	if (len < 3 || strcasecmp (state->token + len - 2, "hz"))
+	{
+		parse_error (state, "Expected rate such as '15hz'");
+		return 0;
+	}
+	state->token[len - 2] = '\0';
+	rate = consume_num (state);
+	if (!state->error && rate <= 0)
+	{
+		parse_error (state, "Rate must be at least 1hz");
+	}
+	return rate;
+}
+
+static int
+is_modifier (const char *token)
+{
+	return !strcasecmp (token, "hold") || !strcasecmp (token, "tap") || !strcasecmp (token, "turbo");
+}
+
+static void
+parse_modifier (parse_state *state, VControl_BindingSpec *spec)
+{
+	if (!strcasecmp (state->token, "hold"))
+	{
+		consume (state, "hold");
+		spec->modifier = VCONTROL_MODIFIER_HOLD;
+		spec->period = consume_num (state);
+	}
+	else if (!strcasecmp (state->token, "tap"))
+	{
+		consume (state, "tap");
+		spec->modifier = VCONTROL_MODIFIER_TAP;
+		spec->period = consume_num (state);
+	}
+	else
+	{
+		consume (state, "turbo");
+		spec->modifier = VCONTROL_MODIFIER_TURBO;
+		spec->period = consume_rate (state);
+	}
+}
+
+static void
+parse_joybinding (parse_state *state, VControl_BindingSpec *spec)
+{
+	consume (state, "joystick");
+	spec->port = consume_num (state);
+	if (!state->error)
+	{
+		if (!strcasecmp (state->token, "axis"))
+		{
+			consume (state, "axis");
+			spec->type = VCONTROL_SPEC_JOYAXIS;
+			spec->index = consume_num (state);
+			if (!state->error)
+			{
+				spec->value = consume_polarity (state);
+			}
+		} 
+		else if (!strcasecmp (state->token, "button"))
+		{
+			consume (state, "button");
+			spec->type = VCONTROL_SPEC_JOYBUTTON;
+			spec->index = consume_num (state);
+		}
+		else if (!strcasecmp (state->token, "hat"))
+		{
+			consume (state, "hat");
+			spec->type = VCONTROL_SPEC_JOYHAT;
+			spec->index = consume_num (state);
+			if (!state->error)
+			{
+				spec->value = consume_dir (state);
+			}
+		}
+		else
+		{
+			expected_error (state, "axis', 'button', or 'hat");
+		}
+	}
+}
+
+static void
+parse_input (parse_state *state, VControl_BindingSpec *spec)
+{
+	memset (spec, 0, sizeof (*spec));
+	if (!strcasecmp (state->token, "key"))
+	{
+		consume (state, "key");
+		spec->type = VCONTROL_SPEC_KEY;
+		spec->symbol = consume_keyname (state);
+	}
+	else if (!strcasecmp (state->token, "scancode"))
+	{
+		consume (state, "scancode");
+		spec->type = VCONTROL_SPEC_SCANCODE;
+		spec->index = consume_scanname (state);
+	}
+	else if (!strcasecmp (state->token, "joystick"))
+	{
+		parse_joybinding (state, spec);
+	}
+	else
+	{
+		expected_error (state, "key', 'scancode' or 'joystick");
+	}
+}
+
+static void
+parse_combo (parse_state *state, const char *name)
+{
+	char names[MAX_COMBO_LENGTH][TOKEN_SIZE];
+	const char *steps[MAX_COMBO_LENGTH];
+	int length = 0, window = 0;
+	consume (state, "combo");
+	while (state->token[0] && strcasecmp (state->token, "within"))
+	{
+		if (length == MAX_COMBO_LENGTH)
+		{
+			parse_error (state, "Too many steps in combo");
+			return;
+		}
+		strcpy (names[length], state->token);
+		steps[length] = names[length];
+		length++;
+		next_token (state);
+	}
+	consume (state, "within");
+	if (!state->error) window = consume_num (state);
+	if (!state->error && state->cb->combo)
+	{
+		if (state->cb->combo (state->data, state->linenum, name, steps, length, (Uint32)window))
+		{
+			state->error = 1;
+		}
+	}
+}
+
+static void
+parse_binding (parse_state *state)
+{
+	VControl_BindingSpec inputs[MAX_CHORD_LENGTH];
+	char name[TOKEN_SIZE];
+	int i, count = 0;
+	consume_idname (state, name);
+	if (state->error)
+	{
+		return;
+	}
+	if (!strcasecmp (state->token, "combo"))
+	{
+		parse_combo (state, name);
+		return;
+	}
+	parse_input (state, &inputs[count++]);
+	while (!state->error && !strcasecmp (state->token, "+"))
+	{
+		if (count == MAX_CHORD_LENGTH)
+		{
+			parse_error (state, "Too many inputs in chord");
+			return;
+		}
+		consume (state, "+");
+		parse_input (state, &inputs[count++]);
+	}
+	if (!state->error && is_modifier (state->token))
+	{
+		if (count > 1)
+		{
+			parse_error (state, "Modifiers can't be used with chords");
+			return;
+		}
+		parse_modifier (state, &inputs[0]);
+	}
+	for (i = 0; i < count; i++)
+	{
+		inputs[i].name = name;
+	}
+	if (!state->error && state->cb->binding)
+	{
+		if (state->cb->binding (state->data, state->linenum, inputs, count))
+		{
+			state->error = 1;
+		}
+	}
+}
+
+static void
+parse_joysetting (parse_state *state, VControl_BindingSpec *spec)
+{
+	memset (spec, 0, sizeof (*spec));
+	consume (state, "joystick");
+	spec->port = consume_num (state);
+	if (state->error)
+		return;
+	if (!strcasecmp (state->token, "threshold"))
+	{
+		consume (state, "threshold");
+		spec->type = VCONTROL_SPEC_JOYTHRESHOLD;
+		spec->value = consume_num (state);
+	}
+	else if (!strcasecmp (state->token, "axis"))
+	{
+		consume (state, "axis");
+		spec->type = VCONTROL_SPEC_JOYAXISTHRESHOLD;
+		spec->index = consume_num (state);
+		if (!state->error) consume (state, "threshold");
+		if (!state->error) spec->value = consume_num (state);
+		spec->extra = spec->value;
+		if (!state->error && state->token[0])
+		{
+			spec->extra = consume_num (state);
+		}
+	}
+	else if (!strcasecmp (state->token, "stick"))
+	{
+		consume (state, "stick");
+		spec->type = VCONTROL_SPEC_JOYDEADZONE;
+		spec->index = consume_num (state);
+		if (!state->error) spec->extra = consume_num (state);
+		if (!state->error) consume (state, "deadzone");
+		if (!state->error) spec->value = consume_num (state);
+	}
+	else if (!strcasecmp (state->token, "debounce"))
+	{
+		consume (state, "debounce");
+		spec->type = VCONTROL_SPEC_JOYDEBOUNCE;
+		spec->value = consume_num (state);
+	}
+	else
+	{
+		expected_error (state, "threshold', 'axis', 'stick', or 'debounce");
+	}
+}
+
+static void
+parse_config_line (parse_state *state)
+{
+	state->error = 0;
+	next_token (state);
+	if (!state->token[0])
+	{
+		/* Blank line, skip it */
+		return;
+	}
+	if (!strcasecmp (state->token, "joystick"))
+	{
+		VControl_BindingSpec spec;
+		parse_joysetting (state, &spec);
+		if (!state->error && state->cb->binding)
+		{
+			if (state->cb->binding (state->data, state->linenum, &spec, 1))
+			{
+				state->error = 1;
+			}
+		}
+		return;
+	}
+	if (!strcasecmp (state->token, "layer"))
+	{
+		consume (state, "layer");
+		if (!state->token[0])
+		{
+			expected_error (state, "layer name");
+			return;
+		}
+		if (state->cb->layer && state->cb->layer (state->data, state->linenum, state->token))
+		{
+			state->error = 1;
+		}
+		next_token (state);
+		return;
+	}
+	/* Otherwise, it must be a binding */
+	parse_binding (state);
+}
+
+int
+VControl_ParseConfiguration (FILE *in, const VControl_ParseCallbacks *callbacks, void *data)
+{
+	parse_state ps;
+	int errors;
+	if (!in)
+	{
+		return 1;
+	}
+	ps.linenum = 0;
+	ps.cb = callbacks;
+	ps.data = data;
+	errors = 0;
+	TRACE_PARSE_START ();
+	while (1)
+	{
+		next_line (&ps, in);
+		if (!ps.line[0])
+			break;
+		parse_config_line (&ps);
+		if (ps.error)
+		{
+			errors++;
+		}
+	}
+	TRACE_PARSE_DONE (ps.linenum - 1, errors);
+	return errors;
+}
+
+/* ReadConfiguration is ParseConfiguration with callbacks that bind */
+
+static int
+config_binding (void *data, int line, const VControl_BindingSpec *inputs, int count)
+{
+	int *target = NULL;
+	if (!joystick_setting (inputs[0].type))
+	{
+		target = name2target (inputs[0].name);
+		if (!target)
+		{
+			fprintf (stderr, "VControl: Illegal command type '%s' on config file line %d\n", inputs[0].name, line);
+			return -1;
+		}
+	}
+	if (count == 1)
+		return add_spec (&inputs[0], target);
+	return VControl_AddChordBinding (inputs, count, target);
+}
+
+static int
+config_combo (void *data, int line, const char *name, const char **steps, int length, Uint32 window)
+{
+	int *sequence[MAX_COMBO_LENGTH];
+	int *target = name2target (name);
+	int i;
+	if (!target)
+	{
+		fprintf (stderr, "VControl: Illegal command type '%s' on config file line %d\n", name, line);
+		return -1;
+	}
+	for (i = 0; i < length; i++)
+	{
+		sequence[i] = name2target (steps[i]);
+		if (!sequence[i])
+		{
+			fprintf (stderr, "VControl: Illegal command type '%s' in combo on config file line %d\n", steps[i], line);
+			return -1;
+		}
+	}
+	return combo_add (sequence, length, window, target);
+}
+
+static int
+config_layer (void *data, int line, const char *name)
+{
+	int layer = VControl_CreateLayer (name);
+	if (layer < 0)
+	{
+		return -1;
+	}
+	edit_layer = layer;
+	return 0;
+}
+
+static void
+config_error (void *data, int line, const char *message)
+{
+	fprintf (stderr, "VControl: %s on config file line %d\n", message, line);
+}
+
+static const VControl_ParseCallbacks config_callbacks = {
+	config_binding, config_combo, config_layer, config_error
+};
+
+int
+VControl_ReadConfiguration (FILE *in)
+{
+	int errors, saved_layer;
+	if (!in)
+	{
+		fprintf (stderr, "VControl: Invalid configuration file stream\n");
+		return 1;
+	}
+	saved_layer = edit_layer;
+	errors = VControl_ParseConfiguration (in, &config_callbacks, NULL);
+	edit_layer = saved_layer;
+	return errors;
+}
+
+static int load_replace;
+
+/* What a loaded configuration needs once the bindings are removed,
+ * gathered by a pass over it that changes nothing */
+typedef struct vcontrol_config_check_s {
+	size_t slots;
+	int chords, timed, combos;
+	VControl_BindingSpec chord_inputs[MAX_CHORD_INPUTS];
+	int chord_inputcount;
+	const char *layers[MAX_LAYERS];
+	int layercount;
+} config_check;
+
+static int
+check_input (const VControl_BindingSpec *s, int line)
+{
+	int status;
+	if (!find_source (s, &status))
+	{
+		fprintf (stderr, "VControl: Illegal input on config file line %d\n", line);
+		return -1;
+	}
+	return 0;
+}
+
+static int
+check_binding (void *data, int line, const VControl_BindingSpec *inputs, int count)
+{
+	config_check *c = data;
+	int i, j;
+	if (joystick_setting (inputs[0].type))
+	{
+		if (check_setting (&inputs[0]) != VCONTROL_BIND_OK)
+		{
+			fprintf (stderr, "VControl: Illegal joystick setting on config file line %d\n", line);
+			return -1;
+		}
+		return 0;
+	}
+	if (!name2target (inputs[0].name))
+	{
+		fprintf (stderr, "VControl: Illegal command type '%s' on config file line %d\n", inputs[0].name, line);
+		return -1;
+	}
+	if (count == 1)
+	{
+		const VControl_BindingSpec *s = &inputs[0];
+		if (check_input (s, line))
+			return -1;
+		if (s->modifier != VCONTROL_MODIFIER_NONE)
+		{
+			if ((s->modifier != VCONTROL_MODIFIER_HOLD && s->modifier != VCONTROL_MODIFIER_TAP &&
+			     s->modifier != VCONTROL_MODIFIER_TURBO) || s->period < 0 ||
+			    (s->modifier == VCONTROL_MODIFIER_TURBO && s->period == 0))
 			{
-				state->line[i] = '\n';
-				i++;
-			} 
-			break;
+				fprintf (stderr, "VControl: Illegal modifier on config file line %d\n", line);
+				return -1;
+			}
+			c->timed++;
 		}
-		state->line[i] = ch;
+		c->slots++;
+		return 0;
 	}
-	state->line[i] = '\0';
-	/* Skip to end of line */
-	while (ch != '\n' && !feof (in))
+	if (count > MAX_CHORD_LENGTH)
 	{
-		ch = fgetc (in);
+		fprintf (stderr, "VControl: Chords must have between 1 and %d inputs\n", MAX_CHORD_LENGTH);
+		return -1;
 	}
-	state->token[0] = 0;
-	state->index = 0;
-	state->error = 0;
+	/* Each distinct chord input takes one binding */
+	for (i = 0; i < count; i++)
+	{
+		if (check_input (&inputs[i], line))
+			return -1;
+		for (j = 0; j < c->chord_inputcount; j++)
+		{
+			if (same_input (&c->chord_inputs[j], &inputs[i]))
+				break;
+		}
+		if (j < c->chord_inputcount)
+			continue;
+		if (c->chord_inputcount == MAX_CHORD_INPUTS)
+		{
+			fprintf (stderr, "VControl: Too many distinct chord inputs (limit %d)\n", MAX_CHORD_INPUTS);
+			return -1;
+		}
+		c->chord_inputs[c->chord_inputcount++] = inputs[i];
+		c->slots++;
+	}
+	c->chords++;
+	return 0;
 }
 
-static void
-expected_error (parse_state *state, char *expected)
+static int
+check_combo (void *data, int line, const char *name, const char **steps, int length, Uint32 window)
 {
-	fprintf (stderr, "VControl: Expected '%s' on config file line %d\n", expected, state->linenum);
-	state->error = 1;
+	config_check *c = data;
+	int i;
+	if (!name2target (name))
+	{
+		fprintf (stderr, "VControl: Illegal command type '%s' on config file line %d\n", name, line);
+		return -1;
+	}
+	for (i = 0; i < length; i++)
+	{
+		if (!name2target (steps[i]))
+		{
+			fprintf (stderr, "VControl: Illegal command type '%s' in combo on config file line %d\n", steps[i], line);
+			return -1;
+		}
+	}
+	if (length < 1 || length > MAX_COMBO_LENGTH)
+	{
+		fprintf (stderr, "VControl: Combos must have between 1 and %d steps\n", MAX_COMBO_LENGTH);
+		return -1;
+	}
+	c->combos++;
+	return 0;
 }
 
-static void
-consume (parse_state *state, char *expected)
+/* Layers aren't removed with the bindings, so only new names count
+ * against the limit */
+static int
+check_layer (void *data, int line, const char *name)
 {
-	if (strcasecmp (expected, state->token))
+	config_check *c = data;
+	int i;
+	if (VControl_FindLayer (name) >= 0)
+		return 0;
+	for (i = 0; i < c->layercount; i++)
 	{
-		expected_error (state, expected);
+		if (!strcasecmp (name, c->layers[i]))
+			return 0;
 	}
-	next_token (state);
+	if (strlen (name) >= LAYER_NAME_SIZE)
+	{
+		fprintf (stderr, "VControl: Layer name '%s' is too long\n", name);
+		return -1;
+	}
+	if (layercount + c->layercount == MAX_LAYERS)
+	{
+		fprintf (stderr, "VControl: Too many layers (limit %d)\n", MAX_LAYERS);
+		return -1;
+	}
+	c->layers[c->layercount++] = name;
+	return 0;
 }
 
+static const VControl_ParseCallbacks check_callbacks = {
+	check_binding, check_combo, check_layer, config_error
+};
+
+/* Make sure that, once every binding is removed, replaying what c
+ * describes needs no more memory */
 static int
-consume_keyname (parse_state *state)
+reserve_config (const config_check *c)
 {
-	int keysym = VControl_name2code (state->token);
-	if (!keysym)
+	keypool *x;
+	size_t used = 0;
+	for (x = pool; x != NULL; x = x->next)
+		used += POOL_CHUNK_SIZE - x->remaining;
+	if (c->slots > used && reserve_slots (c->slots - used))
+		return -1;
+	if ((int)c->slots > targetcount && reserve_targets ((int)c->slots - targetcount))
+		return -1;
+	if (reserve_chords (c->chords) || reserve_timed (c->timed) || combo_reserve (c->combos))
+		return -1;
+	return 0;
+}
+
+int
+VControl_LoadConfigurationAsync (const char *path, int replace)
+{
+	if (!path || loader_start (path))
 	{
-		fprintf (stderr, "VControl: Illegal key name '%s' on config file line %d\n", state->token, state->linenum);
-		state->error = 1;
+		return -1;
 	}
-	next_token (state);
-	return keysym;
+	load_replace = replace;
+	return 0;
 }
 
-static int *
-consume_idname (parse_state *state)
+int
+VControl_CommitConfiguration (int *errors)
 {
-	int *result = NULL;
-	int index = 0;
-	while (state->token[index]) 
+	int result = loader_poll (), saved_layer, count = 0;
+	if (result <= 0)
 	{
-		index++;
+		if (result < 0)
+			fprintf (stderr, "VControl: Couldn't load configuration file\n");
+		return result;
 	}
-
-	if (index == 0)
+	lock_dispatch ();
+	if (load_replace)
 	{
-		fprintf (stderr, "VControl: Can't happen: blank token to consume_idname (line %d)\n", state->linenum);
-		state->error = 1;
-		return NULL;
+		/* Check the whole file and reserve what it needs first, so
+		 * that the old bindings only go once the new ones are sure
+		 * to take their place */
+		config_check check;
+		memset (&check, 0, sizeof (check));
+		count = loader_check (&check_callbacks, &check);
+		if (!count && reserve_config (&check))
+		{
+			fprintf (stderr, "VControl: Out of memory applying configuration file\n");
+			count = -1;
+		}
+		if (count)
+		{
+			loader_discard ();
+			unlock_dispatch ();
+			if (errors)
+				*errors = (count < 0) ? 0 : count;
+			return -1;
+		}
+		VControl_RemoveAllBindings ();
 	}
+	saved_layer = edit_layer;
+	count = loader_replay (&config_callbacks, NULL);
+	edit_layer = saved_layer;
+	unlock_dispatch ();
+	if (errors)
+		*errors = count;
+	return 1;
+}
 
-	index--;
-	if (state->token[index] != ':')
+int
+VControl_AddBindings (const VControl_BindingSpec *specs, int count)
+{
+	int i, errors = 0;
+	for (i = 0; i < count; i++)
 	{
-		expected_error (state, ":");
-		return NULL;
+		const VControl_BindingSpec *s = &specs[i];
+		int *target = s->target;
+		if (!joystick_setting (s->type) && !target)
+		{
+			target = name2target (s->name);
+			if (!target)
+			{
+				fprintf (stderr, "VControl: Illegal command type '%s' in binding %d\n", s->name ? s->name : "", i);
+				errors++;
+				continue;
+			}
+		}
+		if (add_spec (s, target))
+		{
+			errors++;
+		}
 	}
+	return errors;
+}
 
-	state->token[index] = 0;  /* remove trailing colon */
-
-	result = name2target (state->token);
-	next_token (state);
+#define NO_PENDING ((size_t)-1)
 
-	if (!result)
-	{
-		fprintf (stderr, "VControl: Illegal command type '%s' on config file line %d\n", state->token, state->linenum);
-		state->error = 1;
-	}
-	return result;
+static size_t
+pending_hash (const pending *p)
+{
+	size_t h = (size_t)p->source * 2654435761u;
+	h ^= ((size_t)p->target >> 2) * 40503u;
+	return h ^ (h >> 15);
 }
 
 static int
-consume_num (parse_state *state)
+same_pending (const pending *a, const pending *b)
 {
-	char *end;
-	int result = strtol (state->token, &end, 10);
-	if (*end != '\0')
-	{
-		fprintf (stderr, "VControl: Expected integer on config line %d\n", state->linenum);
-		state->error = 1;
-	}
-	next_token (state);
-	return result;
+	return (a->source == b->source) && (a->target == b->target);
 }
 
+/* Check spec i and record where it goes.  Bindings are checked for
+ * duplicates against the chain they would join and, through the hash
+ * table, against the rest of the batch.  Returns 1 if it would add a
+ * binding. */
 static int
-consume_polarity (parse_state *state)
+check_spec (const VControl_BindingSpec *s, pending *p, size_t i, size_t *table, size_t mask)
 {
-	int result = 0;
-	if (!strcasecmp (state->token, "positive"))
+	keybinding *b;
+	size_t h;
+	pending *e = &p[i];
+	e->status = VCONTROL_BIND_OK;
+	e->source = 0;
+	e->target = s->target;
+	if (joystick_setting (s->type))
 	{
-		result = 1;
+		e->status = check_setting (s);
+		return 0;
 	}
-	else if (!strcasecmp (state->token, "negative"))
+	if (s->modifier != VCONTROL_MODIFIER_NONE)
 	{
-		result = -1;
+		e->status = VCONTROL_BIND_BADTYPE;
+		return 0;
 	}
-	else
+	if (!e->target && s->name)
+		e->target = name2target (s->name);
+	if (!e->target)
 	{
-		expected_error (state, "positive' or 'negative");
+		e->status = VCONTROL_BIND_BADNAME;
+		return 0;
 	}
-	next_token (state);
-	return result;
-}
-
-static Uint8
-consume_dir (parse_state *state)
-{
-	Uint8 result = 0;
-	if (!strcasecmp (state->token, "left"))
+	e->source = find_source (s, &e->status);
+	if (!e->source)
+		return 0;
+	for (h = pending_hash (e) & mask; table[h] != NO_PENDING; h = (h + 1) & mask)
 	{
-		result = SDL_HAT_LEFT;
+		if (same_pending (&p[table[h]], e))
+		{
+			e->status = VCONTROL_BIND_DUPLICATE;
+			return 0;
+		}
 	}
-	else if (!strcasecmp (state->token, "right"))
+	for (b = *source_chain (e->source); b != NULL; b = b->next)
 	{
-		result = SDL_HAT_RIGHT;
+		if (same_binding (b, e->target, e->source))
+		{
+			e->status = VCONTROL_BIND_DUPLICATE;
+			return 0;
+		}
 	}
-	else if (!strcasecmp (state->token, "up"))
+	table[h] = i;
+	return 1;
+}
+
+int
+VControl_ReserveBindings (int count)
+{
+	if (count <= 0)
+		return 0;
+	if (reserve_slots ((size_t)count) || reserve_targets (count) || reserve_scratch ((size_t)count))
 	{
-		result = SDL_HAT_UP;
+		fprintf (stderr, "VControl: Out of memory reserving %d bindings\n", count);
+		return -1;
 	}
-	else if (!strcasecmp (state->token, "down"))
+	return 0;
+}
+
+int
+VControl_ApplyBindings (const VControl_BindingSpec *specs, size_t n, int *status)
+{
+	pending *p;
+	size_t *table;
+	size_t i, size, needed = 0;
+	int errors = 0;
+
+	if (n == 0)
+		return 0;
+	if (reserve_scratch (n))
 	{
-		result = SDL_HAT_DOWN;
+		for (i = 0; status && i < n; i++)
+			status[i] = VCONTROL_BIND_NOMEMORY;
+		return (int)n;
 	}
-	else
+	p = scratch;
+	table = scratchtable;
+	size = pending_table_size (n);
+	for (i = 0; i < size; i++)
+		table[i] = NO_PENDING;
+
+	/* Nothing is changed until every spec has been checked, except
+	 * that joysticks are opened to find out what inputs they have. */
+	for (i = 0; i < n; i++)
 	{
-		expected_error (state, "left', 'right', 'up' or 'down");
+		needed += check_spec (&specs[i], p, i, table, size - 1);
+		if (p[i].status != VCONTROL_BIND_OK && p[i].status != VCONTROL_BIND_DUPLICATE)
+			errors++;
 	}
-	next_token (state);
-	return result;
-}
-
-static void
-parse_joybinding (parse_state *state, int *target)
-{
-	int sticknum;
-	consume (state, "joystick");
-	sticknum = consume_num (state);
-	if (!state->error)
+	if (!errors)
+		rcu_collect (free_binding);
+	if (!errors && (reserve_slots (needed) || reserve_targets ((int)needed)))
 	{
-		if (!strcasecmp (state->token, "axis"))
+		for (i = 0; i < n; i++)
 		{
-			int axisnum;
-			consume (state, "axis");
-			axisnum = consume_num (state);
-			if (!state->error)
+			if (p[i].status == VCONTROL_BIND_OK)
 			{
-				int polarity = consume_polarity (state);
-				if (!state->error)
-				{
-					if (VControl_AddJoyAxisBinding (sticknum, axisnum, polarity, target))
-					{
-						state->error = 1;
-					}
-				}
+				p[i].status = VCONTROL_BIND_NOMEMORY;
+				errors++;
 			}
-		} 
-		else if (!strcasecmp (state->token, "button"))
+		}
+	}
+
+	if (errors)
+	{
+		for (i = 0; i < n; i++)
 		{
-			int buttonnum;
-			consume (state, "button");
-			buttonnum = consume_num (state);
-			if (!state->error)
-			{
-				if (VControl_AddJoyButtonBinding (sticknum, buttonnum, target))
-				{
-					state->error = 1;
-				}
-			}
+			if (p[i].status == VCONTROL_BIND_OK)
+				p[i].status = VCONTROL_BIND_SKIPPED;
 		}
-		else if (!strcasecmp (state->token, "hat"))
+	}
+	else
+	{
+		/* Commit.  Free slots are handed out in pool order, so the
+		 * whole batch takes one pass over the pool. */
+		keypool *chunk = pool;
+		int slot = 0;
+		for (i = 0; i < n; i++)
 		{
-			int hatnum;
-			consume (state, "hat");
-			hatnum = consume_num (state);
-			if (!state->error)
+			keybinding **tail;
+			if (p[i].status != VCONTROL_BIND_OK)
+				continue;
+			if (joystick_setting (specs[i].type))
 			{
-				Uint8 dir = consume_dir (state);
-				if (!state->error)
-				{
-					if (VControl_AddJoyHatBinding (sticknum, hatnum, dir, target))
-					{
-						state->error = 1;
-					}
-				}
+				apply_setting (&specs[i]);
+				continue;
 			}
-		}
-		else
-		{
-			expected_error (state, "axis', 'button', or 'hat");
+			while (chunk->remaining == 0)
+			{
+				chunk = chunk->next;
+				slot = 0;
+			}
+			while (chunk->pool[slot].target != NULL)
+				slot++;
+			for (tail = source_chain (p[i].source); *tail != NULL; tail = &((*tail)->next))
+				;
+			link_binding (tail, &chunk->pool[slot], p[i].target, p[i].source);
 		}
 	}
+
+	for (i = 0; status && i < n; i++)
+		status[i] = p[i].status;
+	return errors;
 }
 
-static void
-parse_binding (parse_state *state)
+/* Turn a list of control names separated by whitespace into targets.
+ * Returns the number of names, or -1 if any is unknown. */
+static int
+sequence2targets (const char *sequence, int **steps)
 {
-	int *target = consume_idname (state);
-	if (!state->error)
+	char name[TOKEN_SIZE];
+	int length = 0;
+	while (*sequence)
 	{
-		if (!strcasecmp (state->token, "key"))
+		int n = 0;
+		while (*sequence && isspace (*sequence))
+			sequence++;
+		if (!*sequence)
+			break;
+		while (*sequence && !isspace (*sequence))
 		{
-			/* Parse key binding */
-			int keysym;
-			consume (state, "key");
-			keysym = consume_keyname (state);
-			if (!state->error)
-			{
-				if (VControl_AddKeyBinding (keysym, target))
-				{
-					state->error = 1;
-				}
-			}
+			if (n < TOKEN_SIZE - 1)
+				name[n++] = *sequence;
+			sequence++;
 		}
-		else if (!strcasecmp (state->token, "joystick"))
+		name[n] = 0;
+		if (length == MAX_COMBO_LENGTH)
 		{
-			parse_joybinding (state, target);
+			fprintf (stderr, "VControl: Too many steps in combo '%s'\n", name);
+			return -1;
 		}
-		else
+		steps[length] = name2target (name);
+		if (!steps[length])
 		{
-			expected_error (state, "key' or 'joystick");
+			fprintf (stderr, "VControl: Illegal command type '%s' in combo\n", name);
+			return -1;
 		}
+		length++;
 	}
+	return length;
 }
 
-static void
-parse_config_line (parse_state *state)
+int
+VControl_AddComboBinding (const char *sequence, Uint32 window, int *target)
 {
-	state->error = 0;
-	next_token (state);
-	if (!state->token[0])
-	{
-		/* Blank line, skip it */
-		return;
-	}
-	if (!strcasecmp (state->token, "joystick"))
+	int *steps[MAX_COMBO_LENGTH];
+	int length = sequence2targets (sequence, steps);
+	if (length < 0)
 	{
-		int sticknum, threshold = 0;
-		consume (state, "joystick");
-		sticknum = consume_num (state);
-		if (!state->error) consume (state, "threshold");
-		if (!state->error) threshold = consume_num (state);
-		if (!state->error)
-		{
-			if (VControl_SetJoyThreshold (sticknum, threshold))
-			{
-				state->error = 1;
-			}
-		}
-		return;
+		return -1;
 	}
-	/* Otherwise, it must be a binding */
-	parse_binding (state);
+	return combo_add (steps, length, window, target);
 }
 
-int
-VControl_ReadConfiguration (FILE *in)
+void
+VControl_RemoveComboBinding (const char *sequence, int *target)
 {
-	parse_state ps;
-	int errors;
-	if (!in)
+	int *steps[MAX_COMBO_LENGTH];
+	int length = sequence2targets (sequence, steps);
+	if (length > 0)
 	{
-		fprintf (stderr, "VControl: Invalid configuration file stream\n");
-		return 1;
-	}
-	ps.linenum = 0;
-	errors = 0;
-	while (1)
-	{
-		next_line (&ps, in);
-		if (!ps.line[0])
-			break;
-		parse_config_line (&ps);
-		if (ps.error)
-		{
-			errors++;
-		}
+		combo_remove (steps, length, target);
 	}
-	return errors;
 }
 
 #if 0
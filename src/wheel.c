@@ -0,0 +1,165 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#include <SDL.h>
+#include "wheel.h"
+
+/* A hierarchical timing wheel with millisecond resolution.  Level 0
+ * has a slot for each of the next 64 milliseconds, level 1 a slot for
+ * each of the next 64 blocks of 64 milliseconds, and so on.  Adding or
+ * cancelling a timer is constant time.  Advancing visits one level 0
+ * slot per millisecond, and each time level 0 comes round, the next
+ * level 1 slot is emptied back down into the lower levels, so the
+ * work done depends on elapsed time and on the timers that expire,
+ * not on how many are waiting.  Four levels reach about 4.6 hours;
+ * later timers wait in the top level and are placed again when their
+ * slot comes round. */
+#define WHEEL_BITS 6
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SIZE - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((Uint32)1 << (WHEEL_BITS * WHEEL_LEVELS))
+
+static wheel_timer *slots[WHEEL_LEVELS][WHEEL_SIZE];
+
+/* The next millisecond to be processed, and the timers waiting */
+static Uint32 current;
+static int pending;
+
+static void
+place (wheel_timer *t)
+{
+	Uint32 delta = t->deadline - current;
+	Uint32 when = t->deadline;
+	wheel_timer **slot;
+	int level;
+
+	if ((Sint32)delta < 0)
+	{
+		/* Already due; it goes off at the next millisecond */
+		delta = 0;
+		when = current;
+	}
+	else if (delta >= WHEEL_SPAN)
+	{
+		delta = WHEEL_SPAN - 1;
+		when = current + delta;
+	}
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+	{
+		if (delta < ((Uint32)1 << (WHEEL_BITS * (level + 1))))
+			break;
+	}
+	slot = &slots[level][(when >> (WHEEL_BITS * level)) & WHEEL_MASK];
+	t->next = *slot;
+	if (t->next)
+		t->next->pprev = &t->next;
+	t->pprev = slot;
+	*slot = t;
+}
+
+static void
+unlink_timer (wheel_timer *t)
+{
+	*(t->pprev) = t->next;
+	if (t->next)
+		t->next->pprev = t->pprev;
+	t->next = NULL;
+	t->pprev = NULL;
+}
+
+/* Move the timers in the current slot of level down a level.  Returns
+ * the slot index, which is 0 when the level above is due as well. */
+static int
+cascade (int level)
+{
+	int index = (current >> (WHEEL_BITS * level)) & WHEEL_MASK;
+	wheel_timer *t = slots[level][index];
+	slots[level][index] = NULL;
+	while (t)
+	{
+		wheel_timer *next = t->next;
+		place (t);
+		t = next;
+	}
+	return index;
+}
+
+void
+wheel_clear (void)
+{
+	int i, j;
+	for (i = 0; i < WHEEL_LEVELS; i++)
+	{
+		for (j = 0; j < WHEEL_SIZE; j++)
+		{
+			while (slots[i][j])
+				unlink_timer (slots[i][j]);
+		}
+	}
+	pending = 0;
+}
+
+void
+wheel_add (wheel_timer *t, Uint32 deadline, Uint32 now)
+{
+	if (t->pprev)
+		wheel_cancel (t);
+	if (!pending)
+		current = now;
+	t->deadline = deadline;
+	place (t);
+	pending++;
+}
+
+void
+wheel_cancel (wheel_timer *t)
+{
+	if (t->pprev)
+	{
+		unlink_timer (t);
+		pending--;
+	}
+}
+
+void
+wheel_advance (Uint32 now)
+{
+	while (pending && (Sint32)(now - current) >= 0)
+	{
+		int index = current & WHEEL_MASK, level;
+		wheel_timer *expired;
+		for (level = 1; level < WHEEL_LEVELS && !index; level++)
+			index = cascade (level);
+
+		/* Take the slot as a list of its own.  Timers added on expiry
+		 * land after it, and one cancelled just leaves the list. */
+		index = current & WHEEL_MASK;
+		expired = slots[0][index];
+		slots[0][index] = NULL;
+		if (expired)
+			expired->pprev = &expired;
+		current++;
+		while (expired)
+		{
+			wheel_timer *t = expired;
+			unlink_timer (t);
+			pending--;
+			t->expire (t);
+		}
+	}
+	if (!pending)
+		current = now + 1;
+}
+
+/* The next millisecond to be processed.  Adding the first timer after
+ * a clear with this as now puts the wheel back where it was. */
+Uint32
+wheel_current (void)
+{
+	return current;
+}
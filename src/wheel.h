@@ -0,0 +1,24 @@
+/*
+ * VControl Library, Copyright (c) 2003, Michael Martin
+ *
+ * VControl is distributed under the terms of the zlib license, and as
+ * such has NO WARRANTY.  See the LICENSE file for details.
+ */
+
+#ifndef WHEEL_H_
+#define WHEEL_H_
+
+/* A timer, embedded in whatever it times.  pprev is NULL while the
+ * timer isn't pending.  expire is called when it goes off. */
+typedef struct vcontrol_wheel_timer_s {
+	Uint32 deadline;
+	struct vcontrol_wheel_timer_s *next, **pprev;
+	void (*expire) (struct vcontrol_wheel_timer_s *t);
+} wheel_timer;
+
+void wheel_clear (void);
+void wheel_add (wheel_timer *t, Uint32 deadline, Uint32 now);
+void wheel_cancel (wheel_timer *t);
+void wheel_advance (Uint32 now);
+Uint32 wheel_current (void);
+#endif